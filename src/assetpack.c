@@ -0,0 +1,281 @@
+#include "assetpack.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "atomicfile.h"
+#include "hash.h"
+#include "lz.h"
+
+struct AssetPack {
+  const unsigned char *base;
+  size_t length;
+  const AssetEntry *entries;
+  uint32_t count;
+  const char *names;
+  uint32_t namesSize;
+};
+
+static AssetPack *mounted;
+
+// Names are relative paths; a leading "./" is not part of them.
+static const char *normalize(const char *name) {
+  while (name[0] == '.' && name[1] == '/') {
+    name += 2;
+  }
+  return name;
+}
+
+static int validate(const AssetPack *pack) {
+  AssetPackHeader header;
+  if (pack->length < sizeof(header)) {
+    return 0;
+  }
+  memcpy(&header, pack->base, sizeof(header));
+  size_t tableEnd = sizeof(header) + (size_t)header.entryCount * sizeof(AssetEntry);
+  if (memcmp(header.magic, ASSET_PACK_MAGIC, 4) != 0 || header.version != ASSET_PACK_VERSION ||
+      tableEnd + header.namesSize > pack->length || header.namesSize == 0 ||
+      pack->base[tableEnd + header.namesSize - 1] != 0) {
+    return 0;
+  }
+  const AssetEntry *entries = (const AssetEntry *)(pack->base + sizeof(header));
+  for (uint32_t i = 0; i < header.entryCount; ++i) {
+    if (entries[i].offset > pack->length || entries[i].storedSize > pack->length - entries[i].offset ||
+        entries[i].name >= header.namesSize || entries[i].compression > ASSET_LZ4) {
+      return 0;
+    }
+    // a decoded size no stored block can reach would only make reading
+    // the entry allocate whatever the file claims
+    if (entries[i].compression == ASSET_LZ4 && entries[i].size / LZ_MAX_RATIO > entries[i].storedSize) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+AssetPack *assetPackOpen(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    if (errno != ENOENT) {
+      perror(path);
+    }
+    return NULL;
+  }
+  struct stat st;
+  AssetPack *pack = calloc(1, sizeof(AssetPack));
+  void *base = MAP_FAILED;
+  if (pack && fstat(fd, &st) == 0 && st.st_size > 0) {
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror(path);
+    free(pack);
+    return NULL;
+  }
+  pack->base = base;
+  pack->length = (size_t)st.st_size;
+  // read ahead the whole file in large requests, instead of faulting it in
+  // page by page as assets are touched
+  madvise(base, pack->length, MADV_WILLNEED);
+  if (!validate(pack)) {
+    fprintf(stderr, "%s: not an asset pack\n", path);
+    assetPackClose(pack);
+    return NULL;
+  }
+  const AssetPackHeader *header = (const AssetPackHeader *)pack->base;
+  pack->count = header->entryCount;
+  pack->entries = (const AssetEntry *)(pack->base + sizeof(AssetPackHeader));
+  pack->names = (const char *)(pack->entries + pack->count);
+  pack->namesSize = header->namesSize;
+  return pack;
+}
+
+void assetPackClose(AssetPack *pack) {
+  if (pack == NULL) {
+    return;
+  }
+  munmap((void *)pack->base, pack->length);
+  free(pack);
+}
+
+size_t assetPackCount(const AssetPack *pack) {
+  return pack->count;
+}
+
+const unsigned char *assetPackBase(const AssetPack *pack) {
+  return pack->base;
+}
+
+const AssetEntry *assetPackFind(const AssetPack *pack, const char *name) {
+  name = normalize(name);
+  uint64_t hash = hashString(HASH_SEED, name);
+  // first entry with that hash, then every entry sharing it
+  uint32_t low = 0, high = pack->count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (pack->entries[middle].hash < hash) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  for (uint32_t i = low; i < pack->count && pack->entries[i].hash == hash; ++i) {
+    if (strcmp(pack->names + pack->entries[i].name, name) == 0) {
+      return &pack->entries[i];
+    }
+  }
+  return NULL;
+}
+
+int assetPackRead(const AssetPack *pack, const char *name, Asset *asset) {
+  memset(asset, 0, sizeof(*asset));
+  const AssetEntry *entry = assetPackFind(pack, name);
+  if (entry == NULL) {
+    return 0;
+  }
+  const unsigned char *stored = pack->base + entry->offset;
+  if (entry->compression == ASSET_STORED) {
+    asset->data = stored;
+    asset->size = (size_t)entry->storedSize;
+    return 1;
+  }
+  asset->owned = malloc(entry->size ? (size_t)entry->size : 1);
+  if (asset->owned == NULL || !lzDecompress(stored, (size_t)entry->storedSize, asset->owned, (size_t)entry->size)) {
+    fprintf(stderr, "%s: corrupt in the asset pack\n", name);
+    free(asset->owned);
+    asset->owned = NULL;
+    return 0;
+  }
+  asset->data = asset->owned;
+  asset->size = (size_t)entry->size;
+  return 1;
+}
+
+void assetMount(AssetPack *pack) {
+  mounted = pack;
+}
+
+AssetPack *assetMounted(void) {
+  return mounted;
+}
+
+int assetRead(const char *path, Asset *asset) {
+  if (mounted && assetPackRead(mounted, path, asset)) {
+    return 1;
+  }
+  memset(asset, 0, sizeof(*asset));
+  struct stat st;
+  FILE *file = stat(path, &st) == 0 ? fopen(path, "rb") : NULL;
+  if (file == NULL) {
+    if (errno != ENOENT) {
+      perror(path);
+    }
+    return 0;
+  }
+  size_t size = (size_t)st.st_size;
+  asset->owned = malloc(size ? size : 1);
+  if (asset->owned == NULL || fread(asset->owned, 1, size, file) != size) {
+    perror(path);
+    fclose(file);
+    free(asset->owned);
+    asset->owned = NULL;
+    return 0;
+  }
+  fclose(file);
+  asset->data = asset->owned;
+  asset->size = size;
+  return 1;
+}
+
+void assetRelease(Asset *asset) {
+  free(asset->owned);
+  memset(asset, 0, sizeof(*asset));
+}
+
+static int compareEntries(const void *a, const void *b) {
+  uint64_t x = ((const AssetEntry *)a)->hash, y = ((const AssetEntry *)b)->hash;
+  return x < y ? -1 : x > y;
+}
+
+int assetPackWrite(const char *path, const char *const *names, const unsigned char *const *data,
+                   const size_t *sizes, const int *compress, size_t count) {
+  AssetEntry *entries = calloc(count ? count : 1, sizeof(AssetEntry));
+  const unsigned char **stored = calloc(count ? count : 1, sizeof(unsigned char *));
+  unsigned char **compressed = calloc(count ? count : 1, sizeof(unsigned char *));
+  int ok = entries && stored && compressed;
+
+  size_t namesSize = 0;
+  for (size_t i = 0; ok && i < count; ++i) {
+    namesSize += strlen(normalize(names[i])) + 1;
+  }
+  char *namesData = ok ? malloc(namesSize) : NULL;
+  ok = ok && namesData;
+
+  size_t nameOffset = 0;
+  for (size_t i = 0; ok && i < count; ++i) {
+    const char *name = normalize(names[i]);
+    size_t length = strlen(name) + 1;
+    memcpy(namesData + nameOffset, name, length);
+    entries[i] = (AssetEntry){hashString(HASH_SEED, name), 0, sizes[i], sizes[i], (uint32_t)nameOffset, ASSET_STORED};
+    nameOffset += length;
+    stored[i] = data[i];
+    if (compress[i] && sizes[i] > 0) {
+      size_t bound = lzCompressBound(sizes[i]);
+      compressed[i] = malloc(bound);
+      size_t size = compressed[i] ? lzCompress(data[i], sizes[i], compressed[i], bound) : 0;
+      if (size > 0 && size <= sizes[i] - sizes[i] / 8) {
+        entries[i].storedSize = size;
+        entries[i].compression = ASSET_LZ4;
+        stored[i] = compressed[i];
+      }
+    }
+  }
+
+  // the data goes in the order given; only the table is sorted, by hash
+  size_t offset = sizeof(AssetPackHeader) + count * sizeof(AssetEntry) + namesSize;
+  for (size_t i = 0; ok && i < count; ++i) {
+    offset = (offset + ASSET_ALIGNMENT - 1) & ~(size_t)(ASSET_ALIGNMENT - 1);
+    entries[i].offset = offset;
+    offset += entries[i].storedSize;
+  }
+  AssetEntry *sorted = ok ? malloc((count ? count : 1) * sizeof(AssetEntry)) : NULL;
+  ok = ok && sorted;
+  if (ok) {
+    memcpy(sorted, entries, count * sizeof(AssetEntry));
+    qsort(sorted, count, sizeof(AssetEntry), compareEntries);
+  }
+
+  if (ok) {
+    AssetPackHeader header = {{'L', 'P', 'A', 'K'}, ASSET_PACK_VERSION, (uint32_t)count, (uint32_t)namesSize};
+    AtomicFile f;
+    atomicFileOpen(&f, path);
+    atomicFileWrite(&f, &header, sizeof(header));
+    atomicFileWrite(&f, sorted, count * sizeof(AssetEntry));
+    atomicFileWrite(&f, namesData, namesSize);
+    for (size_t i = 0; i < count; ++i) {
+      atomicFilePadTo(&f, (size_t)entries[i].offset);
+      atomicFileWrite(&f, stored[i], (size_t)entries[i].storedSize);
+    }
+    ok = atomicFileClose(&f, 1);
+  }
+  if (!ok) {
+    fprintf(stderr, "%s: could not be written\n", path);
+  }
+
+  for (size_t i = 0; compressed && i < count; ++i) {
+    free(compressed[i]);
+  }
+  free(compressed);
+  free(stored);
+  free(entries);
+  free(sorted);
+  free(namesData);
+  return ok;
+}
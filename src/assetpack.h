@@ -0,0 +1,83 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Many assets in one file, mapped into memory whole, so that opening it is
+// one open and a few large sequential reads, and an asset is just a span of
+// the mapping:
+//
+//   AssetPackHeader
+//   AssetEntry        entryCount of them, sorted by hash
+//   names             NUL terminated, namesSize bytes in all
+//   data              each entry starting on an ASSET_ALIGNMENT boundary
+//
+// All fields are little endian. Entries are found by the hash of their name
+// (hashString in hash.h), then compared by name. An entry may be compressed
+// (lz.h); reading it then decodes it into memory of its own.
+#define ASSET_PACK_MAGIC "LPAK"
+#define ASSET_PACK_VERSION 1
+#define ASSET_ALIGNMENT 64
+
+enum {
+  ASSET_STORED,
+  ASSET_LZ4,
+};
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t namesSize;
+} AssetPackHeader;
+
+typedef struct {
+  uint64_t hash;
+  uint64_t offset;     // from the start of the file
+  uint64_t size;       // once decompressed
+  uint64_t storedSize; // in the file
+  uint32_t name;       // offset into the names
+  uint32_t compression;
+} AssetEntry;
+
+typedef struct AssetPack AssetPack;
+
+// An asset's bytes, either inside a pack or held by the asset itself.
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  void *owned; // freed by assetRelease
+} Asset;
+
+// Maps a pack and asks the kernel to start reading all of it. Returns NULL,
+// quietly if the file does not exist.
+AssetPack *assetPackOpen(const char *path);
+void assetPackClose(AssetPack *pack);
+
+size_t assetPackCount(const AssetPack *pack);
+
+// Returns 0 if the pack has no asset by that name. Stored assets point into
+// the mapping; compressed ones are decoded. Safe from any thread.
+int assetPackRead(const AssetPack *pack, const char *name, Asset *asset);
+
+// The entry for `name`, or NULL, for reading a stored asset in pieces.
+const AssetEntry *assetPackFind(const AssetPack *pack, const char *name);
+const unsigned char *assetPackBase(const AssetPack *pack);
+
+// The pack assetRead looks in before the file system, NULL for none. Set
+// it before any thread reads assets.
+void assetMount(AssetPack *pack);
+AssetPack *assetMounted(void);
+
+// Reads `path` from the mounted pack, or else the whole file. Prints why
+// and returns 0 if neither has it.
+int assetRead(const char *path, Asset *asset);
+void assetRelease(Asset *asset);
+
+// Packs `count` assets; those with compress[i] set are stored compressed
+// when that saves at least an eighth of their size.
+int assetPackWrite(const char *path, const char *const *names, const unsigned char *const *data,
+                   const size_t *sizes, const int *compress, size_t count);
+
+#endif
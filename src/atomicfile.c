@@ -0,0 +1,39 @@
+#include "atomicfile.h"
+
+#include <string.h>
+#include <unistd.h>
+
+void atomicFileOpen(AtomicFile *file, const char *path) {
+  memset(file, 0, sizeof(*file));
+  snprintf(file->path, sizeof(file->path), "%s", path);
+  snprintf(file->temporary, sizeof(file->temporary), "%s.%d", path, (int)getpid());
+  file->file = strlen(path) < sizeof(file->path) ? fopen(file->temporary, "wb") : NULL;
+  file->ok = file->file != NULL;
+}
+
+void atomicFileWrite(AtomicFile *file, const void *data, size_t size) {
+  if (file->ok && size > 0) {
+    file->ok = fwrite(data, 1, size, file->file) == size;
+    file->size += size;
+  }
+}
+
+void atomicFilePadTo(AtomicFile *file, size_t offset) {
+  static const unsigned char zeros[64];
+  while (file->ok && file->size < offset) {
+    size_t size = offset - file->size;
+    atomicFileWrite(file, zeros, size < sizeof(zeros) ? size : sizeof(zeros));
+  }
+}
+
+int atomicFileClose(AtomicFile *file, int keep) {
+  if (file->file == NULL) {
+    return 0;
+  }
+  int ok = fclose(file->file) == 0 && file->ok && keep && rename(file->temporary, file->path) == 0;
+  if (!ok) {
+    remove(file->temporary);
+  }
+  file->file = NULL;
+  return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef ATOMICFILE_H
+#define ATOMICFILE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// A file written whole or not at all. The data goes to a temporary file
+// next to the target, named after it and the process, which is renamed
+// over the target once everything is written, so that a reader, whether
+// another run or a tool, never sees half a file.
+typedef struct {
+  FILE *file;
+  size_t size; // written so far
+  int ok;      // 0 once anything failed
+  char path[4096];
+  char temporary[4096 + 16];
+} AtomicFile;
+
+// Creates the temporary file. A failure is remembered for atomicFileClose,
+// so that the writes in between need no checks of their own.
+void atomicFileOpen(AtomicFile *file, const char *path);
+
+void atomicFileWrite(AtomicFile *file, const void *data, size_t size);
+
+// Writes zeros up to `offset`, for formats that align their sections.
+void atomicFilePadTo(AtomicFile *file, size_t offset);
+
+// Closes the temporary file and, if every write went through and `keep` is
+// set, renames it into place; otherwise removes it. Returns 1 if the file
+// is in place.
+int atomicFileClose(AtomicFile *file, int keep);
+
+#endif
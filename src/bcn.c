@@ -0,0 +1,303 @@
+#include "bcn.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+size_t bcBlockSize(BcFormat format) {
+  return format == BC1 ? 8 : 16;
+}
+
+size_t bcImageSize(BcFormat format, int width, int height) {
+  return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * bcBlockSize(format);
+}
+
+static int clampInt(int v, int lo, int hi) {
+  return v < lo ? lo : v > hi ? hi : v;
+}
+
+static unsigned short pack565(const float *rgb) {
+  int r = clampInt((int)(rgb[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+  int g = clampInt((int)(rgb[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+  int b = clampInt((int)(rgb[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+  return (unsigned short)(r << 11 | g << 5 | b);
+}
+
+static void unpack565(unsigned short c, unsigned char *rgb) {
+  int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+  rgb[0] = (unsigned char)(r << 3 | r >> 2);
+  rgb[1] = (unsigned char)(g << 2 | g >> 4);
+  rgb[2] = (unsigned char)(b << 3 | b >> 2);
+}
+
+// Colour 0 > colour 1 selects four colours. Otherwise BC1 has three and
+// black, which is opaque in the RGB variant used here; BC3 always has four.
+static void colorPalette(unsigned short c0, unsigned short c1, int fourColors, unsigned char palette[4][4]) {
+  unpack565(c0, palette[0]);
+  unpack565(c1, palette[1]);
+  for (int k = 0; k < 3; ++k) {
+    if (fourColors) {
+      palette[2][k] = (unsigned char)((2 * palette[0][k] + palette[1][k] + 1) / 3);
+      palette[3][k] = (unsigned char)((palette[0][k] + 2 * palette[1][k] + 1) / 3);
+    } else {
+      palette[2][k] = (unsigned char)((palette[0][k] + palette[1][k] + 1) / 2);
+      palette[3][k] = 0;
+    }
+  }
+  palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+}
+
+// Picks the closest palette entry for every texel; returns the total error.
+static int colorIndices(const unsigned char *rgba, unsigned char palette[4][4], unsigned int *indices) {
+  int error = 0;
+  *indices = 0;
+  for (int i = 0; i < 16; ++i) {
+    int best = 0, bestError = 1 << 30;
+    for (int p = 0; p < 4; ++p) {
+      int dr = rgba[4 * i] - palette[p][0];
+      int dg = rgba[4 * i + 1] - palette[p][1];
+      int db = rgba[4 * i + 2] - palette[p][2];
+      int e = dr * dr + dg * dg + db * db;
+      if (e < bestError) {
+        best = p;
+        bestError = e;
+      }
+    }
+    *indices |= (unsigned int)best << (2 * i);
+    error += bestError;
+  }
+  return error;
+}
+
+// Orders the endpoints for four colour mode and fills in the indices.
+static int fitColors(const unsigned char *rgba, const float *hi, const float *lo,
+                     unsigned short *c0, unsigned short *c1, unsigned int *indices) {
+  *c0 = pack565(hi);
+  *c1 = pack565(lo);
+  if (*c0 < *c1) {
+    unsigned short t = *c0;
+    *c0 = *c1;
+    *c1 = t;
+  }
+  unsigned char palette[4][4];
+  colorPalette(*c0, *c1, 1, palette);
+  if (*c0 != *c1) {
+    return colorIndices(rgba, palette, indices);
+  }
+  // a single colour, which BC1 and BC3 would read differently past index 0
+  *indices = 0;
+  int error = 0;
+  for (int i = 0; i < 16; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      int d = rgba[4 * i + k] - palette[0][k];
+      error += d * d;
+    }
+  }
+  return error;
+}
+
+static void encodeColor(const unsigned char *rgba, unsigned char *block) {
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      mean[k] += rgba[4 * i + k] / 16.0f;
+    }
+  }
+  float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; ++i) {
+    float r = rgba[4 * i] - mean[0], g = rgba[4 * i + 1] - mean[1], b = rgba[4 * i + 2] - mean[2];
+    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+  }
+
+  // the colours spread mostly along the principal axis of the covariance,
+  // found by a few rounds of power iteration
+  float axis[3] = {cov[0] + cov[1] + cov[2], cov[1] + cov[3] + cov[4], cov[2] + cov[4] + cov[5]};
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    float m = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+    if (m < 1e-6f) {
+      break;
+    }
+    axis[0] = x / m;
+    axis[1] = y / m;
+    axis[2] = z / m;
+  }
+  float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  if (length < 1e-6f) {
+    axis[0] = axis[1] = axis[2] = 0.57735027f;
+  } else {
+    axis[0] /= length;
+    axis[1] /= length;
+    axis[2] /= length;
+  }
+
+  float minT = INFINITY, maxT = -INFINITY;
+  for (int i = 0; i < 16; ++i) {
+    float t = (rgba[4 * i] - mean[0]) * axis[0] + (rgba[4 * i + 1] - mean[1]) * axis[1] + (rgba[4 * i + 2] - mean[2]) * axis[2];
+    minT = fminf(minT, t);
+    maxT = fmaxf(maxT, t);
+  }
+  float hi[3], lo[3];
+  for (int k = 0; k < 3; ++k) {
+    hi[k] = mean[k] + axis[k] * maxT;
+    lo[k] = mean[k] + axis[k] * minT;
+  }
+  unsigned short c0, c1;
+  unsigned int indices;
+  int error = fitColors(rgba, hi, lo, &c0, &c1, &indices);
+
+  // Refit the endpoints to the chosen indices by least squares: each texel
+  // is a * colour0 + (1 - a) * colour1 with a fixed by its index.
+  if (c0 != c1) {
+    static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+      float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+      aa += a * a;
+      ab += a * b;
+      bb += b * b;
+      for (int k = 0; k < 3; ++k) {
+        ax[k] += a * rgba[4 * i + k];
+        bx[k] += b * rgba[4 * i + k];
+      }
+    }
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) > 1e-6f) {
+      float refitHi[3], refitLo[3];
+      for (int k = 0; k < 3; ++k) {
+        refitHi[k] = (ax[k] * bb - bx[k] * ab) / det;
+        refitLo[k] = (bx[k] * aa - ax[k] * ab) / det;
+      }
+      unsigned short r0, r1;
+      unsigned int refitIndices;
+      if (fitColors(rgba, refitHi, refitLo, &r0, &r1, &refitIndices) < error) {
+        c0 = r0;
+        c1 = r1;
+        indices = refitIndices;
+      }
+    }
+  }
+
+  block[0] = (unsigned char)c0;
+  block[1] = (unsigned char)(c0 >> 8);
+  block[2] = (unsigned char)c1;
+  block[3] = (unsigned char)(c1 >> 8);
+  for (int i = 0; i < 4; ++i) {
+    block[4 + i] = (unsigned char)(indices >> (8 * i));
+  }
+}
+
+static void alphaPalette(int a0, int a1, int *palette) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int k = 2; k < 8; ++k) {
+      palette[k] = ((8 - k) * a0 + (k - 1) * a1 + 3) / 7;
+    }
+  } else {
+    for (int k = 2; k < 6; ++k) {
+      palette[k] = ((6 - k) * a0 + (k - 1) * a1 + 2) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+static void encodeAlpha(const unsigned char *rgba, unsigned char *block) {
+  int lo = 255, hi = 0;
+  for (int i = 0; i < 16; ++i) {
+    lo = rgba[4 * i + 3] < lo ? rgba[4 * i + 3] : lo;
+    hi = rgba[4 * i + 3] > hi ? rgba[4 * i + 3] : hi;
+  }
+  block[0] = (unsigned char)hi;
+  block[1] = (unsigned char)lo;
+  unsigned long long bits = 0;
+  if (hi != lo) {
+    int palette[8];
+    alphaPalette(hi, lo, palette);
+    for (int i = 0; i < 16; ++i) {
+      int best = 0, bestError = 256;
+      for (int p = 0; p < 8; ++p) {
+        int e = abs(rgba[4 * i + 3] - palette[p]);
+        if (e < bestError) {
+          best = p;
+          bestError = e;
+        }
+      }
+      bits |= (unsigned long long)best << (3 * i);
+    }
+  }
+  for (int i = 0; i < 6; ++i) {
+    block[2 + i] = (unsigned char)(bits >> (8 * i));
+  }
+}
+
+void bcEncodeBlock(BcFormat format, const unsigned char *rgba, unsigned char *block) {
+  if (format == BC3) {
+    encodeAlpha(rgba, block);
+    block += 8;
+  }
+  encodeColor(rgba, block);
+}
+
+void bcDecodeBlock(BcFormat format, const unsigned char *block, unsigned char *rgba) {
+  const unsigned char *color = format == BC3 ? block + 8 : block;
+  unsigned short c0 = (unsigned short)(color[0] | color[1] << 8);
+  unsigned short c1 = (unsigned short)(color[2] | color[3] << 8);
+  unsigned char palette[4][4];
+  colorPalette(c0, c1, format == BC3 || c0 > c1, palette);
+  for (int i = 0; i < 16; ++i) {
+    int index = (color[4 + i / 4] >> (2 * (i % 4))) & 3;
+    memcpy(rgba + 4 * i, palette[index], 4);
+  }
+
+  if (format == BC3) {
+    int alphas[8];
+    alphaPalette(block[0], block[1], alphas);
+    unsigned long long bits = 0;
+    for (int i = 0; i < 6; ++i) {
+      bits |= (unsigned long long)block[2 + i] << (8 * i);
+    }
+    for (int i = 0; i < 16; ++i) {
+      rgba[4 * i + 3] = (unsigned char)alphas[(bits >> (3 * i)) & 7];
+    }
+  }
+}
+
+void bcEncodeRows(BcFormat format, const unsigned char *rgba, int width, int height,
+                  int firstRow, int lastRow, unsigned char *blocks) {
+  int blocksWide = (width + 3) / 4;
+  size_t blockSize = bcBlockSize(format);
+  unsigned char texels[64];
+  for (int by = firstRow; by < lastRow; ++by) {
+    for (int bx = 0; bx < blocksWide; ++bx) {
+      for (int y = 0; y < 4; ++y) {
+        int sy = clampInt(by * 4 + y, 0, height - 1);
+        for (int x = 0; x < 4; ++x) {
+          int sx = clampInt(bx * 4 + x, 0, width - 1);
+          memcpy(texels + 4 * (4 * y + x), rgba + 4 * ((size_t)sy * width + sx), 4);
+        }
+      }
+      bcEncodeBlock(format, texels, blocks + ((size_t)by * blocksWide + bx) * blockSize);
+    }
+  }
+}
+
+void bcDecodeImage(BcFormat format, const unsigned char *blocks, int width, int height, unsigned char *rgba) {
+  int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+  size_t blockSize = bcBlockSize(format);
+  unsigned char texels[64];
+  for (int by = 0; by < blocksHigh; ++by) {
+    for (int bx = 0; bx < blocksWide; ++bx) {
+      bcDecodeBlock(format, blocks + ((size_t)by * blocksWide + bx) * blockSize, texels);
+      for (int y = 0; y < 4 && by * 4 + y < height; ++y) {
+        for (int x = 0; x < 4 && bx * 4 + x < width; ++x) {
+          memcpy(rgba + 4 * ((size_t)(by * 4 + y) * width + bx * 4 + x), texels + 4 * (4 * y + x), 4);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,32 @@
+#ifndef BCN_H
+#define BCN_H
+
+#include <stddef.h>
+
+// S3TC block compression, as exposed by EXT_texture_compression_s3tc. Both
+// formats store 4x4 texel blocks: BC1 (DXT1) packs RGB into 8 bytes, BC3
+// (DXT5) adds an 8 byte alpha block in front of the colour block.
+typedef enum {
+  BC1,
+  BC3,
+} BcFormat;
+
+size_t bcBlockSize(BcFormat format);
+
+// Bytes taken by a width x height image, partial blocks included.
+size_t bcImageSize(BcFormat format, int width, int height);
+
+// Blocks take 16 RGBA8 texels in row order.
+void bcEncodeBlock(BcFormat format, const unsigned char *rgba, unsigned char *block);
+void bcDecodeBlock(BcFormat format, const unsigned char *block, unsigned char *rgba);
+
+// Encode the block rows [firstRow, lastRow) of an RGBA8 image into `blocks`,
+// which holds the whole image. Texels past the right and bottom edges repeat
+// the last column and row. Rows can be encoded on different threads.
+void bcEncodeRows(BcFormat format, const unsigned char *rgba, int width, int height,
+                  int firstRow, int lastRow, unsigned char *blocks);
+
+// Decode a whole image to RGBA8, for drivers without S3TC.
+void bcDecodeImage(BcFormat format, const unsigned char *blocks, int width, int height, unsigned char *rgba);
+
+#endif
@@ -0,0 +1,438 @@
+#include "bvh.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  float min[3];
+  float max[3];
+} Box;
+
+// An object's box and the center of its sphere. The build partitions these
+// rather than object indices, so that every level reads them in order
+// instead of jumping about the sphere set.
+typedef struct {
+  Box box;
+  float center[3];
+  uint32_t object;
+} BuildItem;
+
+typedef struct {
+  Bvh *bvh;
+  BuildItem *items;
+  JobSystem *jobs;
+  JobCounter *counter;
+} BuildContext;
+
+typedef struct {
+  const BuildContext *context;
+  uint32_t node;
+  uint32_t begin;
+  uint32_t end;
+  unsigned int depth;
+  int inTask;
+} BuildJob;
+
+// plain comparisons, which compile to single instructions where fminf and
+// fmaxf are calls that handle NaN
+static float minf(float a, float b) {
+  return a < b ? a : b;
+}
+
+static float maxf(float a, float b) {
+  return a > b ? a : b;
+}
+
+static void boxEmpty(Box *box) {
+  for (int a = 0; a < 3; ++a) {
+    box->min[a] = INFINITY;
+    box->max[a] = -INFINITY;
+  }
+}
+
+static void boxGrowSphere(Box *box, const SphereSet *spheres, uint32_t i) {
+  float center[3] = {spheres->x[i], spheres->y[i], spheres->z[i]};
+  for (int a = 0; a < 3; ++a) {
+    box->min[a] = minf(box->min[a], center[a] - spheres->radius[i]);
+    box->max[a] = maxf(box->max[a], center[a] + spheres->radius[i]);
+  }
+}
+
+static void boxGrowBox(Box *box, const float *min, const float *max) {
+  for (int a = 0; a < 3; ++a) {
+    box->min[a] = minf(box->min[a], min[a]);
+    box->max[a] = maxf(box->max[a], max[a]);
+  }
+}
+
+static float boxArea(const Box *box) {
+  float dx = box->max[0] - box->min[0], dy = box->max[1] - box->min[1], dz = box->max[2] - box->min[2];
+  return dx < 0.0f ? 0.0f : 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static int binOf(float value, float min, float scale, int bins) {
+  int bin = (int)((value - min) * scale);
+  return bin < 0 ? 0 : bin >= bins ? bins - 1 : bin;
+}
+
+// Where to split objects [begin, end), after putting those that go left
+// first; `begin` to make a leaf of them instead. The split is the cheapest
+// bin boundary on any axis, where a side costs its area times its objects.
+static uint32_t split(const BuildContext *context, uint32_t begin, uint32_t end, const Box *bounds,
+                      const Box *centroids, unsigned int depth) {
+  BuildItem *items = context->items;
+  uint32_t count = end - begin;
+  if (count <= BVH_MIN_LEAF) {
+    return begin;
+  }
+  // all three axes are binned in one pass over the objects; small nodes,
+  // of which there are many, get no more bins than objects
+  int bins = count < BVH_BINS ? (int)count : BVH_BINS;
+  Box boxes[3][BVH_BINS];
+  uint32_t counts[3][BVH_BINS] = {{0}};
+  float scale[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    float extent = centroids->max[axis] - centroids->min[axis];
+    scale[axis] = extent > 0.0f ? bins / extent : 0.0f;
+    for (int b = 0; b < bins; ++b) {
+      boxEmpty(&boxes[axis][b]);
+    }
+  }
+  for (uint32_t i = begin; i < end; ++i) {
+    const BuildItem *item = &items[i];
+    for (int axis = 0; axis < 3; ++axis) {
+      int b = binOf(item->center[axis], centroids->min[axis], scale[axis], bins);
+      counts[axis][b]++;
+      boxGrowBox(&boxes[axis][b], item->box.min, item->box.max);
+    }
+  }
+
+  int bestAxis = -1, bestBin = 0;
+  float bestCost = INFINITY;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (scale[axis] == 0.0f) {
+      continue;
+    }
+    // everything from bin b on, swept from the right
+    float rightArea[BVH_BINS];
+    uint32_t rightCount[BVH_BINS];
+    Box right;
+    boxEmpty(&right);
+    uint32_t n = 0;
+    for (int b = bins - 1; b > 0; --b) {
+      boxGrowBox(&right, boxes[axis][b].min, boxes[axis][b].max);
+      n += counts[axis][b];
+      rightArea[b] = boxArea(&right);
+      rightCount[b] = n;
+    }
+    Box left;
+    boxEmpty(&left);
+    n = 0;
+    for (int b = 0; b < bins - 1; ++b) {
+      boxGrowBox(&left, boxes[axis][b].min, boxes[axis][b].max);
+      n += counts[axis][b];
+      if (n == 0 || rightCount[b + 1] == 0) {
+        continue;
+      }
+      float cost = boxArea(&left) * n + rightArea[b + 1] * rightCount[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = b + 1;
+      }
+    }
+  }
+  // visiting a node costs about as much as testing one sphere
+  float area = boxArea(bounds);
+  if (count <= BVH_MAX_LEAF && area * count <= area + bestCost) {
+    return begin;
+  }
+  // past this depth, halving by count keeps the tree within BVH_MAX_DEPTH
+  uint32_t middle = begin + count / 2;
+  if (bestAxis < 0 || depth + 32 >= BVH_MAX_DEPTH) {
+    return middle;
+  }
+  uint32_t i = begin, j = end;
+  while (i < j) {
+    if (binOf(items[i].center[bestAxis], centroids->min[bestAxis], scale[bestAxis], bins) < bestBin) {
+      i++;
+    } else {
+      BuildItem item = items[i];
+      items[i] = items[--j];
+      items[j] = item;
+    }
+  }
+  return i == begin || i == end ? middle : i;
+}
+
+static void buildJob(void *data, unsigned int thread);
+
+static void buildNode(const BuildContext *context, uint32_t node, uint32_t begin, uint32_t end, unsigned int depth,
+                      int inTask) {
+  Bvh *bvh = context->bvh;
+  // the right child goes to another job or a recursive call, the left one
+  // round the loop
+  for (;;) {
+    Box bounds, centroids;
+    boxEmpty(&bounds);
+    boxEmpty(&centroids);
+    for (uint32_t i = begin; i < end; ++i) {
+      const BuildItem *item = &context->items[i];
+      boxGrowBox(&bounds, item->box.min, item->box.max);
+      boxGrowBox(&centroids, item->center, item->center);
+    }
+    BvhNode *n = &bvh->nodes[node];
+    memcpy(n->min, bounds.min, sizeof(n->min));
+    memcpy(n->max, bounds.max, sizeof(n->max));
+    if (!inTask && end - begin <= BVH_TASK_SIZE) {
+      bvh->tasks[atomic_fetch_add(&bvh->taskCount, 1)] = node;
+      inTask = 1;
+    }
+
+    uint32_t middle = split(context, begin, end, &bounds, &centroids, depth);
+    if (middle == begin) {
+      for (uint32_t i = begin; i < end; ++i) {
+        bvh->objects[i] = context->items[i].object;
+      }
+      n->first = begin;
+      n->count = end - begin;
+      return;
+    }
+    uint32_t children = atomic_fetch_add(&bvh->nodeCount, 2);
+    n->first = children;
+    n->count = 0;
+    BuildJob *job = context->jobs && end - middle >= BVH_PARALLEL_SIZE ? malloc(sizeof(BuildJob)) : NULL;
+    if (job) {
+      *job = (BuildJob){context, children + 1, middle, end, depth + 1, inTask};
+      jobSubmit(context->jobs, buildJob, job, context->counter);
+    } else {
+      buildNode(context, children + 1, middle, end, depth + 1, inTask);
+    }
+    node = children;
+    end = middle;
+    depth++;
+  }
+}
+
+static void buildJob(void *data, unsigned int thread) {
+  BuildJob *job = data;
+  buildNode(job->context, job->node, job->begin, job->end, job->depth, job->inTask);
+  free(job);
+}
+
+int bvhInit(Bvh *bvh, size_t capacity) {
+  memset(bvh, 0, sizeof(*bvh));
+  bvh->capacity = capacity;
+  // a leaf has at least one object, so there are fewer than twice as many
+  // nodes; tasks cover disjoint runs of at least one object each, and a
+  // chain of lopsided splits can peel off a small one at every level, so
+  // there can be as many as there are objects
+  bvh->taskCapacity = capacity ? capacity : 1;
+  bvh->nodes = malloc((2 * capacity + 1) * sizeof(BvhNode));
+  bvh->objects = malloc((capacity ? capacity : 1) * sizeof(uint32_t));
+  bvh->tasks = malloc(bvh->taskCapacity * sizeof(uint32_t));
+  if (!bvh->nodes || !bvh->objects || !bvh->tasks) {
+    bvhFree(bvh);
+    return 0;
+  }
+  return 1;
+}
+
+void bvhFree(Bvh *bvh) {
+  free(bvh->nodes);
+  free(bvh->objects);
+  free(bvh->tasks);
+  memset(bvh, 0, sizeof(*bvh));
+}
+
+int bvhBuild(Bvh *bvh, JobSystem *jobs, const SphereSet *spheres) {
+  if (spheres->count > bvh->capacity) {
+    return 0;
+  }
+  BuildItem *items = malloc((spheres->count ? spheres->count : 1) * sizeof(BuildItem));
+  if (!items) {
+    return 0;
+  }
+  bvh->objectCount = spheres->count;
+  for (size_t i = 0; i < spheres->count; ++i) {
+    items[i].object = (uint32_t)i;
+    boxEmpty(&items[i].box);
+    boxGrowSphere(&items[i].box, spheres, (uint32_t)i);
+    items[i].center[0] = spheres->x[i];
+    items[i].center[1] = spheres->y[i];
+    items[i].center[2] = spheres->z[i];
+  }
+  atomic_store(&bvh->nodeCount, 1);
+  atomic_store(&bvh->taskCount, 0);
+  JobCounter built = {0};
+  BuildContext context = {bvh, items, jobs, &built};
+  buildNode(&context, 0, 0, (uint32_t)spheres->count, 0, 0);
+  if (jobs) {
+    jobWait(jobs, &built);
+  }
+  free(items);
+  return 1;
+}
+
+void bvhRefit(Bvh *bvh, const SphereSet *spheres) {
+  for (uint32_t i = atomic_load(&bvh->nodeCount); i-- > 0;) {
+    BvhNode *node = &bvh->nodes[i];
+    Box box;
+    boxEmpty(&box);
+    if (node->count > 0) {
+      for (uint32_t k = node->first; k < node->first + node->count; ++k) {
+        boxGrowSphere(&box, spheres, bvh->objects[k]);
+      }
+    } else {
+      boxGrowBox(&box, bvh->nodes[node->first].min, bvh->nodes[node->first].max);
+      boxGrowBox(&box, bvh->nodes[node->first + 1].min, bvh->nodes[node->first + 1].max);
+    }
+    memcpy(node->min, box.min, sizeof(node->min));
+    memcpy(node->max, box.max, sizeof(node->max));
+  }
+}
+
+size_t bvhCullFrustum(const Bvh *bvh, const SphereSet *spheres, const Frustum *f, uint32_t root,
+                      unsigned int *visible) {
+  if (bvh->objectCount == 0) {
+    return 0;
+  }
+  // each entry carries the planes its box is not yet known to be inside of
+  struct {
+    uint32_t node;
+    unsigned int planes;
+  } stack[BVH_MAX_DEPTH + 1];
+  size_t top = 0, n = 0;
+  stack[top].node = root;
+  stack[top++].planes = 0x3f;
+  while (top > 0) {
+    top--;
+    const BvhNode *node = &bvh->nodes[stack[top].node];
+    unsigned int planes = stack[top].planes;
+    float center[3], extent[3];
+    for (int a = 0; a < 3; ++a) {
+      center[a] = (node->min[a] + node->max[a]) * 0.5f;
+      extent[a] = (node->max[a] - node->min[a]) * 0.5f;
+    }
+    int outside = 0;
+    for (unsigned int remaining = planes; remaining && !outside; remaining &= remaining - 1) {
+      int p = __builtin_ctz(remaining);
+      float dist = f->a[p] * center[0] + f->b[p] * center[1] + f->c[p] * center[2] + f->d[p];
+      float radius = fabsf(f->a[p]) * extent[0] + fabsf(f->b[p]) * extent[1] + fabsf(f->c[p]) * extent[2];
+      outside = dist < -radius;
+      if (dist >= radius) {
+        planes &= ~(1u << p);
+      }
+    }
+    if (outside) {
+      continue;
+    }
+    if (node->count == 0) {
+      stack[top].node = node->first + 1;
+      stack[top++].planes = planes;
+      stack[top].node = node->first;
+      stack[top++].planes = planes;
+      continue;
+    }
+    for (uint32_t k = node->first; k < node->first + node->count; ++k) {
+      uint32_t i = bvh->objects[k];
+      int inside = 1;
+      for (unsigned int remaining = planes; remaining && inside; remaining &= remaining - 1) {
+        int p = __builtin_ctz(remaining);
+        float dist = f->a[p] * spheres->x[i] + f->b[p] * spheres->y[i] + f->c[p] * spheres->z[i] + f->d[p];
+        inside = dist >= -spheres->radius[i];
+      }
+      if (inside) {
+        visible[n++] = i;
+      }
+    }
+  }
+  return n;
+}
+
+// Distance along the ray to where it enters the node's box, or INFINITY if
+// it misses it or only gets there after `limit`.
+static float rayBox(const BvhNode *node, const float origin[3], const float inverse[3], float limit) {
+  float near = 0.0f, far = limit;
+  for (int a = 0; a < 3; ++a) {
+    float t0 = (node->min[a] - origin[a]) * inverse[a];
+    float t1 = (node->max[a] - origin[a]) * inverse[a];
+    // fminf and fmaxf skip the NaN of a ray lying in a slab's plane
+    near = fmaxf(near, fminf(t0, t1));
+    far = fminf(far, fmaxf(t0, t1));
+  }
+  return near <= far ? near : INFINITY;
+}
+
+static float raySphere(const SphereSet *spheres, uint32_t i, const float origin[3], const float direction[3]) {
+  float oc[3] = {origin[0] - spheres->x[i], origin[1] - spheres->y[i], origin[2] - spheres->z[i]};
+  float a = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+  float b = oc[0] * direction[0] + oc[1] * direction[1] + oc[2] * direction[2];
+  float c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - spheres->radius[i] * spheres->radius[i];
+  float discriminant = b * b - a * c;
+  if (discriminant < 0.0f || a == 0.0f) {
+    return INFINITY;
+  }
+  float root = sqrtf(discriminant);
+  float t = (-b - root) / a;
+  // from inside the sphere, where the ray leaves it
+  if (t < 0.0f) {
+    t = (-b + root) / a;
+  }
+  return t >= 0.0f ? t : INFINITY;
+}
+
+int bvhRaycast(const Bvh *bvh, const SphereSet *spheres, const float origin[3], const float direction[3],
+               unsigned int *object, float *distance, size_t *visited) {
+  float inverse[3] = {1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2]};
+  float best = INFINITY;
+  size_t count = 0;
+  struct {
+    uint32_t node;
+    float entry;
+  } stack[BVH_MAX_DEPTH + 1];
+  size_t top = 0;
+  if (bvh->objectCount > 0) {
+    stack[top].node = 0;
+    stack[top++].entry = rayBox(&bvh->nodes[0], origin, inverse, best);
+  }
+  while (top > 0) {
+    top--;
+    if (stack[top].entry >= best) {
+      continue;
+    }
+    const BvhNode *node = &bvh->nodes[stack[top].node];
+    count++;
+    if (node->count > 0) {
+      for (uint32_t k = node->first; k < node->first + node->count; ++k) {
+        float t = raySphere(spheres, bvh->objects[k], origin, direction);
+        if (t < best) {
+          best = t;
+          *object = bvh->objects[k];
+        }
+      }
+      continue;
+    }
+    // the nearer child goes on top, so it is searched first and its hits
+    // can rule out the other
+    float entries[2] = {rayBox(&bvh->nodes[node->first], origin, inverse, best),
+                        rayBox(&bvh->nodes[node->first + 1], origin, inverse, best)};
+    int nearer = entries[1] < entries[0];
+    for (int k = 0; k < 2; ++k) {
+      int child = k == 0 ? !nearer : nearer;
+      if (entries[child] < best) {
+        stack[top].node = node->first + (uint32_t)child;
+        stack[top++].entry = entries[child];
+      }
+    }
+  }
+  if (visited) {
+    *visited = count;
+  }
+  if (best == INFINITY) {
+    return 0;
+  }
+  *distance = best;
+  return 1;
+}
@@ -0,0 +1,76 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "frustum.h"
+#include "jobs.h"
+
+// A bounding volume hierarchy over the spheres of a SphereSet: a binary
+// tree of boxes, split where the surface area heuristic, evaluated over
+// BVH_BINS bins a side, says rays and frusta are least likely to have to
+// look into both halves. Culling and picking then skip whole subtrees, so
+// they take time in proportion to what they find rather than to the number
+// of objects.
+//
+// Every subtree covers a contiguous run of `objects`; a leaf holds up to
+// BVH_MAX_LEAF of them, and any run of BVH_MIN_LEAF or fewer is one: a
+// frustum or ray gets through a handful of spheres faster than through
+// another level of boxes. Children are always allocated after their parent.
+#define BVH_BINS 16
+#define BVH_MIN_LEAF 4
+#define BVH_MAX_LEAF 8
+#define BVH_MAX_DEPTH 64
+// subtrees at least this large are built by jobs of their own
+#define BVH_PARALLEL_SIZE 4096
+// the tree is cut into subtrees of at most this many objects, for culling
+// on several threads
+#define BVH_TASK_SIZE 1024
+
+typedef struct {
+  float min[3];
+  uint32_t first; // leaf: first slot in `objects`; otherwise the left child, the right is next to it
+  float max[3];
+  uint32_t count; // objects in a leaf, 0 for other nodes
+} BvhNode;
+
+typedef struct {
+  BvhNode *nodes;
+  atomic_uint nodeCount;
+  uint32_t *objects; // sphere indices, in tree order
+  size_t objectCount;
+  size_t capacity;
+  // roots of subtrees of at most BVH_TASK_SIZE objects, which together
+  // cover every object once
+  uint32_t *tasks;
+  atomic_uint taskCount;
+  size_t taskCapacity;
+} Bvh;
+
+int bvhInit(Bvh *bvh, size_t capacity);
+void bvhFree(Bvh *bvh);
+
+// Builds the tree over all of `spheres`, on `jobs` if it is not NULL.
+// Returns 0 if there are more spheres than the capacity or memory runs out.
+int bvhBuild(Bvh *bvh, JobSystem *jobs, const SphereSet *spheres);
+
+// Recomputes every box, bottom up, after spheres have moved. The tree keeps
+// its shape, so rebuild instead once objects have moved far.
+void bvhRefit(Bvh *bvh, const SphereSet *spheres);
+
+// Writes the indices of the spheres under `root` that intersect the
+// frustum to `visible` and returns how many there are. Subtrees wholly
+// outside are skipped, and those wholly inside are taken without testing
+// their spheres.
+size_t bvhCullFrustum(const Bvh *bvh, const SphereSet *spheres, const Frustum *frustum, uint32_t root,
+                      unsigned int *visible);
+
+// The nearest sphere hit by the ray from `origin` along `direction`. Returns
+// 0 if there is none; otherwise sets `object`, and `distance` in multiples
+// of `direction`. `visited` counts the nodes looked at, if not NULL.
+int bvhRaycast(const Bvh *bvh, const SphereSet *spheres, const float origin[3], const float direction[3],
+               unsigned int *object, float *distance, size_t *visited);
+
+#endif
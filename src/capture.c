@@ -0,0 +1,242 @@
+#include "capture.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomicfile.h"
+#include "png.h"
+
+typedef struct {
+  GLuint buffer;
+  size_t capacity;
+  GLsync fence; // NULL when the buffer is free
+  unsigned long frame;
+  int width;
+  int height;
+} CaptureReadback;
+
+// One frame on its way to disk, owned by its job.
+typedef struct {
+  FrameCapture *capture;
+  unsigned char *rgba; // as read back: bottom row first
+  unsigned long frame;
+  int width;
+  int height;
+} EncodeJob;
+
+struct FrameCapture {
+  JobSystem *jobs;
+  char *pattern;
+  int png;
+  CaptureReadback readbacks[CAPTURE_BUFFERS];
+  unsigned int next;    // readback the next frame goes into
+  unsigned int pending; // readbacks in flight, oldest at next - pending
+  JobCounter encoding;
+  // frames allowed to wait for or be in encoding; more than that and the
+  // GL thread helps, rather than letting memory grow
+  int maxEncoding;
+  size_t captured;
+  size_t stalls;
+  atomic_size_t written;
+  atomic_size_t failed;
+  atomic_size_t bytes;
+};
+
+// A conversion for the frame number, and no other. The number is passed
+// as an unsigned long, so the conversion has to be `lu`, with any flags,
+// width and precision in front.
+static int validPattern(const char *pattern) {
+  int conversions = 0;
+  for (const char *p = pattern; *p; ++p) {
+    if (p[0] == '%' && p[1] == '%') {
+      p++;
+    } else if (*p == '%') {
+      p += 1 + strspn(p + 1, "-+ #0");
+      p += strspn(p, "0123456789");
+      if (*p == '.') {
+        p += 1 + strspn(p + 1, "0123456789");
+      }
+      if (p[0] != 'l' || p[1] != 'u') {
+        return 0;
+      }
+      p++;
+      conversions++;
+    }
+  }
+  return conversions == 1;
+}
+
+static int writeRaw(const char *path, const unsigned char *data, size_t size) {
+  AtomicFile f;
+  atomicFileOpen(&f, path);
+  atomicFileWrite(&f, data, size);
+  if (!atomicFileClose(&f, 1)) {
+    fprintf(stderr, "%s: could not be written\n", path);
+    return 0;
+  }
+  return 1;
+}
+
+static void encodeFrame(void *data, unsigned int thread) {
+  EncodeJob *job = data;
+  FrameCapture *capture = job->capture;
+  size_t rowBytes = (size_t)job->width * 3;
+  // flipped to the top row first, without the alpha the window has no use for
+  unsigned char *rgb = malloc(rowBytes * job->height);
+  int ok = rgb != NULL;
+  for (int y = 0; ok && y < job->height; ++y) {
+    const unsigned char *src = job->rgba + (size_t)(job->height - 1 - y) * job->width * 4;
+    unsigned char *dst = rgb + y * rowBytes;
+    for (int x = 0; x < job->width; ++x) {
+      dst[x * 3 + 0] = src[x * 4 + 0];
+      dst[x * 3 + 1] = src[x * 4 + 1];
+      dst[x * 3 + 2] = src[x * 4 + 2];
+    }
+  }
+  free(job->rgba);
+
+  char path[4096];
+  snprintf(path, sizeof(path), capture->pattern, job->frame);
+  size_t size = 0;
+  if (ok && capture->png) {
+    unsigned char *png = pngEncode(rgb, job->width, job->height, 3, rowBytes, &size);
+    ok = png && writeRaw(path, png, size);
+    free(png);
+  } else if (ok) {
+    size = rowBytes * job->height;
+    ok = writeRaw(path, rgb, size);
+  }
+  free(rgb);
+  if (ok) {
+    atomic_fetch_add(&capture->written, 1);
+    atomic_fetch_add(&capture->bytes, size);
+  } else {
+    atomic_fetch_add(&capture->failed, 1);
+  }
+  free(job);
+}
+
+FrameCapture *captureCreate(JobSystem *jobs, const char *pattern) {
+  if (!validPattern(pattern)) {
+    fprintf(stderr, "%s: wants one conversion for the frame number, like %%05lu\n", pattern);
+    return NULL;
+  }
+  FrameCapture *capture = calloc(1, sizeof(FrameCapture));
+  if (capture == NULL || (capture->pattern = strdup(pattern)) == NULL) {
+    free(capture);
+    return NULL;
+  }
+  size_t length = strlen(pattern);
+  capture->png = length >= 4 && strcmp(pattern + length - 4, ".png") == 0;
+  capture->jobs = jobs;
+  capture->maxEncoding = 2 * (int)jobThreadCount(jobs);
+  for (int i = 0; i < CAPTURE_BUFFERS; ++i) {
+    glGenBuffers(1, &capture->readbacks[i].buffer);
+  }
+  return capture;
+}
+
+// Copies the oldest readback out and queues it for encoding; with `wait`
+// even if the GPU is not done with it yet.
+static int collect(FrameCapture *capture, int wait) {
+  CaptureReadback *readback = &capture->readbacks[(capture->next + CAPTURE_BUFFERS - capture->pending) % CAPTURE_BUFFERS];
+  GLenum status = glClientWaitSync(readback->fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    if (!wait) {
+      return 0;
+    }
+    capture->stalls++;
+    do {
+      status = glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+  }
+  if (status == GL_WAIT_FAILED) {
+    // the fence says nothing any more, but the copy is done once the GL is
+    fprintf(stderr, "capture: waiting for frame %lu failed, finishing instead\n", readback->frame);
+    glFinish();
+  }
+  glDeleteSync(readback->fence);
+  readback->fence = NULL;
+  capture->pending--;
+
+  size_t bytes = (size_t)readback->width * readback->height * 4;
+  EncodeJob *job = malloc(sizeof(EncodeJob));
+  unsigned char *rgba = malloc(bytes);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+  const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_READ_BIT);
+  if (job && rgba && mapped) {
+    memcpy(rgba, mapped, bytes);
+  }
+  if (mapped) {
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (!job || !rgba || !mapped) {
+    free(job);
+    free(rgba);
+    atomic_fetch_add(&capture->failed, 1);
+    return 1;
+  }
+
+  if (atomic_load(&capture->encoding.pending) >= capture->maxEncoding) {
+    capture->stalls++;
+    jobWait(capture->jobs, &capture->encoding);
+  }
+  *job = (EncodeJob){capture, rgba, readback->frame, readback->width, readback->height};
+  jobSubmit(capture->jobs, encodeFrame, job, &capture->encoding);
+  return 1;
+}
+
+void capturePoll(FrameCapture *capture) {
+  while (capture->pending > 0 && collect(capture, 0)) {
+  }
+}
+
+void captureFrame(FrameCapture *capture, unsigned long frame, int width, int height) {
+  if (capture->pending == CAPTURE_BUFFERS) {
+    collect(capture, 1);
+  }
+  CaptureReadback *readback = &capture->readbacks[capture->next];
+  size_t bytes = (size_t)width * height * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+  if (readback->capacity < bytes) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)bytes, NULL, GL_STREAM_READ);
+    readback->capacity = bytes;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback->frame = frame;
+  readback->width = width;
+  readback->height = height;
+  capture->next = (capture->next + 1) % CAPTURE_BUFFERS;
+  capture->pending++;
+  capture->captured++;
+  capturePoll(capture);
+}
+
+void captureStats(FrameCapture *capture, FrameCaptureStats *stats) {
+  stats->captured = capture->captured;
+  stats->written = atomic_load(&capture->written);
+  stats->failed = atomic_load(&capture->failed);
+  stats->bytes = atomic_load(&capture->bytes);
+  stats->stalls = capture->stalls;
+}
+
+void captureDestroy(FrameCapture *capture) {
+  if (capture == NULL) {
+    return;
+  }
+  while (capture->pending > 0) {
+    collect(capture, 1);
+  }
+  jobWait(capture->jobs, &capture->encoding);
+  for (int i = 0; i < CAPTURE_BUFFERS; ++i) {
+    glDeleteBuffers(1, &capture->readbacks[i].buffer);
+  }
+  free(capture->pattern);
+  free(capture);
+}
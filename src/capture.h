@@ -0,0 +1,44 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+#include "jobs.h"
+
+// readbacks in flight before the GL thread has to wait for the oldest
+#define CAPTURE_BUFFERS 3
+
+// Writes rendered frames to disk without stalling on glReadPixels: each
+// frame is read into one of a ring of pixel pack buffers, and copied out
+// once its fence has passed, a few frames later. Encoding and writing run
+// as jobs. Files are named by a printf pattern taking the frame number as
+// an unsigned long, e.g. "capture/%05lu.png": PNG if it ends in .png, else
+// raw RGB, rows top first, for tools like ffmpeg -f rawvideo.
+typedef struct FrameCapture FrameCapture;
+
+typedef struct {
+  size_t captured; // frames read back
+  size_t written;  // frames on disk
+  size_t failed;
+  size_t bytes;    // written
+  size_t stalls;   // times the GL thread waited, on a readback or the encoders
+} FrameCaptureStats;
+
+// Returns NULL if `pattern` has no conversion for the frame number.
+FrameCapture *captureCreate(JobSystem *jobs, const char *pattern);
+
+// Finishes every frame still being read or written.
+void captureDestroy(FrameCapture *capture);
+
+// Reads back the width x height framebuffer bound for reading as frame
+// `frame`. Call after drawing it and before swapping.
+void captureFrame(FrameCapture *capture, unsigned long frame, int width, int height);
+
+// Hands the readbacks that have arrived to the encoders; captureFrame does
+// too, so this is only needed when frames stop.
+void capturePoll(FrameCapture *capture);
+
+void captureStats(FrameCapture *capture, FrameCaptureStats *stats);
+
+#endif
@@ -0,0 +1,288 @@
+#include "frame.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// objects per job; a multiple of 32 so chunks never share a dirty word
+#define FRAME_CHUNK 1024
+
+typedef struct FrameChunk {
+  FramePacket *packet;
+  FramePipeline *pipeline;
+  size_t begin;
+  size_t end;
+  size_t task; // the BVH subtree to cull, if there is one
+} FrameChunk;
+
+// Concatenates the thread lists into drawList, sorted by level so that
+// each level's draws are contiguous.
+static void mergeThreadLists(FramePipeline *pipeline, FramePacket *packet) {
+  memset(packet->levelCounts, 0, sizeof(packet->levelCounts));
+  for (unsigned int t = 0; t < pipeline->threads; ++t) {
+    for (size_t i = 0; i < packet->threadCounts[t]; ++i) {
+      packet->levelCounts[pipeline->levels[packet->threadLists[t][i]]]++;
+    }
+  }
+  size_t start[MESH_MAX_LODS];
+  size_t n = 0;
+  for (unsigned int level = 0; level < MESH_MAX_LODS; ++level) {
+    start[level] = n;
+    n += packet->levelCounts[level];
+  }
+  for (unsigned int t = 0; t < pipeline->threads; ++t) {
+    for (size_t i = 0; i < packet->threadCounts[t]; ++i) {
+      unsigned int object = packet->threadLists[t][i];
+      packet->drawList[start[pipeline->levels[object]]++] = object;
+    }
+  }
+  // every chunk has updated its transforms by now
+  for (size_t i = 0; i < n; ++i) {
+    memcpy(packet->instances[i], pipeline->transforms->world[packet->drawList[i]], sizeof(mat4));
+  }
+  packet->drawCount = n;
+}
+
+// Picks the largest objects drawn this frame, by how far their radius
+// reaches on screen, as the occluders for the next.
+static void pickOccluders(FramePipeline *pipeline, FramePacket *packet) {
+  unsigned int count = 0, max = pipeline->maxOccluders;
+  for (size_t i = 0; i < packet->drawCount && max > 0; ++i) {
+    unsigned int object = packet->drawList[i];
+    float size = pipeline->sizes[object];
+    if (size < FRAME_MIN_OCCLUDER_PIXELS ||
+        (count == max && size <= pipeline->sizes[pipeline->occluders[count - 1]])) {
+      continue;
+    }
+    // insertion into the list, kept largest first
+    unsigned int k = count < max ? count++ : count - 1;
+    for (; k > 0 && pipeline->sizes[pipeline->occluders[k - 1]] < size; --k) {
+      pipeline->occluders[k] = pipeline->occluders[k - 1];
+    }
+    pipeline->occluders[k] = object;
+  }
+  pipeline->occluderCount = count;
+}
+
+static void finishPacket(FramePipeline *pipeline, FramePacket *packet) {
+  mergeThreadLists(pipeline, packet);
+  packet->occludedCount = atomic_load(&packet->occluded);
+  if (pipeline->occluder) {
+    pickOccluders(pipeline, packet);
+  }
+}
+
+static void cullChunk(void *data, unsigned int thread) {
+  FrameChunk *chunk = data;
+  FramePacket *packet = chunk->packet;
+  FramePipeline *pipeline = chunk->pipeline;
+
+  const SphereSet *bounds = pipeline->bounds;
+  const Bvh *bvh = pipeline->bvh;
+  unsigned int *out = packet->threadLists[thread] + packet->threadCounts[thread];
+  size_t n = 0;
+  if (!bvh && !pipeline->frustumCulling) {
+    for (size_t object = chunk->begin; object < chunk->end; ++object) {
+      out[n++] = (unsigned int)object;
+    }
+  } else if (!bvh) {
+    n = frustumCullSphereRange(&packet->frustum, bounds, chunk->begin, chunk->end, out);
+  } else if (chunk->task < atomic_load(&bvh->taskCount)) {
+    n = bvhCullFrustum(bvh, bounds, &packet->frustum, bvh->tasks[chunk->task], out);
+  }
+  int occlusion = pipeline->occluder && packet->occluderCount > 0;
+  size_t kept = 0;
+  for (size_t i = 0; i < n; ++i) {
+    unsigned int object = out[i];
+    vec3 center = {bounds->x[object], bounds->y[object], bounds->z[object]};
+    if (occlusion && !occlusionTestSphere(&pipeline->occlusion, packet->viewProjection, center, bounds->radius[object])) {
+      continue;
+    }
+    // how near the camera the sphere comes, and so what one unit of error
+    // there covers on screen
+    vec3 eye;
+    glm_mat4_mulv3(packet->view, center, 1.0f, eye);
+    float distance = glm_vec3_norm(eye) - bounds->radius[object];
+    unsigned int level = 0;
+    float size = INFINITY;
+    if (distance > 0.0f) {
+      float pixelsPerUnit = pipeline->lodScale / distance;
+      level = lodSelect(pipeline->lods, pipeline->lodCount, pixelsPerUnit, pipeline->levels[object]);
+      size = bounds->radius[object] * pixelsPerUnit;
+    }
+    pipeline->levels[object] = (unsigned char)level;
+    pipeline->sizes[object] = size;
+    out[kept++] = object;
+  }
+  packet->threadCounts[thread] += kept;
+  if (kept < n) {
+    atomic_fetch_add(&packet->occluded, n - kept);
+  }
+
+  if (atomic_fetch_sub(&packet->chunksLeft, 1) == 1) {
+    finishPacket(pipeline, packet);
+  }
+}
+
+// Draws last frame's occluders, now that their transforms are up to date,
+// and culls against them.
+static void startCulling(FramePipeline *pipeline, FramePacket *packet) {
+  packet->occluderCount = pipeline->occluder ? pipeline->occluderCount : 0;
+  if (packet->occluderCount > 0) {
+    occlusionClear(&pipeline->occlusion);
+    for (unsigned int i = 0; i < packet->occluderCount; ++i) {
+      mat4 modelViewProjection;
+      glm_mat4_mul(packet->viewProjection, pipeline->transforms->world[pipeline->occluders[i]], modelViewProjection);
+      occlusionRasterize(&pipeline->occlusion, modelViewProjection, pipeline->occluder);
+    }
+    occlusionBuildPyramid(&pipeline->occlusion);
+  }
+
+  size_t chunks = pipeline->bvh ? atomic_load(&pipeline->bvh->taskCount) : packet->updateCount;
+  if (chunks == 0) {
+    finishPacket(pipeline, packet);
+    return;
+  }
+  atomic_store(&packet->chunksLeft, chunks);
+  for (size_t c = 0; c < chunks; ++c) {
+    jobSubmit(pipeline->jobs, cullChunk, &pipeline->chunks[c], &packet->done);
+  }
+}
+
+static void updateChunk(void *data, unsigned int thread) {
+  FrameChunk *chunk = data;
+  FramePacket *packet = chunk->packet;
+  FramePipeline *pipeline = chunk->pipeline;
+
+  transformUpdateRange(pipeline->transforms, chunk->begin, chunk->end);
+
+  if (atomic_fetch_sub(&packet->chunksLeft, 1) == 1) {
+    startCulling(pipeline, packet);
+  }
+}
+
+static int packetInit(FramePacket *packet, unsigned int threads, size_t capacity) {
+  memset(packet, 0, sizeof(*packet));
+  packet->drawList = malloc(capacity * sizeof(unsigned int));
+  packet->instances = malloc(capacity * sizeof(mat4));
+  packet->threadLists = calloc(threads, sizeof(unsigned int *));
+  packet->threadCounts = calloc(threads, sizeof(size_t));
+  if (!packet->drawList || !packet->instances || !packet->threadLists || !packet->threadCounts) {
+    return 0;
+  }
+  // any thread might end up culling every chunk, so each list gets room for all
+  for (unsigned int t = 0; t < threads; ++t) {
+    packet->threadLists[t] = malloc(capacity * sizeof(unsigned int));
+    if (!packet->threadLists[t]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void packetFree(FramePacket *packet, unsigned int threads) {
+  if (packet->threadLists) {
+    for (unsigned int t = 0; t < threads; ++t) {
+      free(packet->threadLists[t]);
+    }
+  }
+  free(packet->threadLists);
+  free(packet->threadCounts);
+  free(packet->drawList);
+  free(packet->instances);
+}
+
+int framePipelineInit(FramePipeline *pipeline, JobSystem *jobs, TransformStore *transforms, SphereSet *bounds,
+                      const Bvh *bvh, const OccluderMesh *occluder, const MeshLod *lods, unsigned int lodCount) {
+  memset(pipeline, 0, sizeof(*pipeline));
+  pipeline->jobs = jobs;
+  pipeline->transforms = transforms;
+  pipeline->bounds = bounds;
+  pipeline->bvh = bvh;
+  pipeline->occluder = occluder;
+  if (occluder) {
+    size_t triangles = occluder->indexCount / 3 ? occluder->indexCount / 3 : 1;
+    size_t fit = FRAME_OCCLUDER_TRIANGLES / triangles;
+    pipeline->maxOccluders = fit < FRAME_MAX_OCCLUDERS ? (unsigned int)fit : FRAME_MAX_OCCLUDERS;
+  }
+  pipeline->frustumCulling = 1;
+  pipeline->lods = lods;
+  pipeline->lodCount = lodCount;
+  pipeline->threads = jobThreadCount(jobs);
+  size_t capacity = bounds->capacity;
+  pipeline->chunkCount = (capacity + FRAME_CHUNK - 1) / FRAME_CHUNK;
+  if (bvh && bvh->taskCapacity > pipeline->chunkCount) {
+    pipeline->chunkCount = bvh->taskCapacity;
+  }
+  pipeline->chunks = calloc(pipeline->chunkCount, sizeof(FrameChunk));
+  pipeline->levels = calloc(capacity ? capacity : 1, 1);
+  pipeline->sizes = calloc(capacity ? capacity : 1, sizeof(float));
+  if (!pipeline->chunks || !pipeline->levels || !pipeline->sizes || (occluder && !occlusionInit(&pipeline->occlusion)) ||
+      !packetInit(&pipeline->packets[0], pipeline->threads, capacity) ||
+      !packetInit(&pipeline->packets[1], pipeline->threads, capacity)) {
+    framePipelineFree(pipeline);
+    return 0;
+  }
+  return 1;
+}
+
+void framePipelineFree(FramePipeline *pipeline) {
+  packetFree(&pipeline->packets[0], pipeline->threads);
+  packetFree(&pipeline->packets[1], pipeline->threads);
+  free(pipeline->chunks);
+  free(pipeline->levels);
+  free(pipeline->sizes);
+  occlusionFree(&pipeline->occlusion);
+  memset(pipeline, 0, sizeof(*pipeline));
+}
+
+FramePacket *framePrepare(FramePipeline *pipeline, mat4 view, mat4 projection, float lodScale) {
+  FramePacket *packet = &pipeline->packets[pipeline->next];
+  pipeline->next ^= 1;
+  pipeline->lodScale = lodScale;
+
+  glm_mat4_copy(view, packet->view);
+  glm_mat4_copy(projection, packet->projection);
+  glm_mat4_mul(projection, view, packet->viewProjection);
+  frustumFromMatrix(packet->viewProjection, &packet->frustum);
+
+  // Transforms are brought up to date a chunk at a time first, so that the
+  // occluders can be drawn where they are now; then the BVH's subtrees (or,
+  // without it, the same chunks) are culled.
+  size_t count = pipeline->bounds->count;
+  size_t updates = (count + FRAME_CHUNK - 1) / FRAME_CHUNK;
+  size_t chunks = updates;
+  if (pipeline->bvh && atomic_load(&pipeline->bvh->taskCount) > chunks) {
+    chunks = atomic_load(&pipeline->bvh->taskCount);
+  }
+  memset(packet->threadCounts, 0, pipeline->threads * sizeof(size_t));
+  packet->drawCount = 0;
+  memset(packet->levelCounts, 0, sizeof(packet->levelCounts));
+  atomic_store(&packet->occluded, 0);
+  packet->updateCount = updates;
+  for (size_t c = 0; c < chunks; ++c) {
+    FrameChunk *chunk = &pipeline->chunks[c];
+    chunk->packet = packet;
+    chunk->pipeline = pipeline;
+    chunk->begin = c * FRAME_CHUNK;
+    chunk->end = chunk->begin + FRAME_CHUNK < count ? chunk->begin + FRAME_CHUNK : count;
+    // chunks past the objects only cull
+    if (chunk->begin >= count) {
+      chunk->begin = chunk->end = 0;
+    }
+    chunk->task = c;
+  }
+  if (updates == 0) {
+    startCulling(pipeline, packet);
+    return packet;
+  }
+  atomic_store(&packet->chunksLeft, updates);
+  for (size_t c = 0; c < updates; ++c) {
+    jobSubmit(pipeline->jobs, updateChunk, &pipeline->chunks[c], &packet->done);
+  }
+  return packet;
+}
+
+void frameWait(FramePipeline *pipeline, FramePacket *packet) {
+  jobWait(pipeline->jobs, &packet->done);
+}
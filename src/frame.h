@@ -0,0 +1,102 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <cglm/cglm.h>
+
+#include "jobs.h"
+#include "bvh.h"
+#include "frustum.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "transform.h"
+
+// The occluders of a frame are the objects whose bounding spheres covered
+// the most pixels in the one before, up to FRAME_MAX_OCCLUDERS of them and
+// no smaller than FRAME_MIN_OCCLUDER_PIXELS in radius. They are drawn one
+// after another by a single job, so there are no more of them than fit in
+// FRAME_OCCLUDER_TRIANGLES a frame, about a millisecond's worth; a mesh
+// larger than that on its own is never an occluder.
+#define FRAME_MAX_OCCLUDERS 32
+#define FRAME_MIN_OCCLUDER_PIXELS 24.0f
+#define FRAME_OCCLUDER_TRIANGLES 16384
+
+// Everything the GL thread needs to submit one frame. Worker threads fill it
+// in: chunk jobs refresh dirty transforms a range at a time, and the last
+// of them draws the occluders into the occlusion buffer (occlusion.h).
+// Then each chunk job culls one subtree of the BVH (or, without one, a
+// range of objects) against the frustum and the occluders, picks the level
+// of detail of the survivors and appends them to the list of the thread
+// that ran it. The last to finish concatenates those lists into drawList,
+// grouped by level, and gathers the matrices into instances, ready to be
+// uploaded in one go.
+typedef struct {
+  mat4 view;
+  mat4 projection;
+  mat4 viewProjection;
+  Frustum frustum;
+  // visible objects and their model matrices, both in draw order; the
+  // matrices are copied out of the transform store so the next frame can
+  // update it while this one is drawn
+  unsigned int *drawList;
+  mat4 *instances;
+  size_t drawCount;
+  // draws at each level: the first levelCounts[0] are at full detail, and
+  // so on
+  size_t levelCounts[MESH_MAX_LODS];
+  // objects in the frustum but hidden by the occluders, of which there were
+  // occluderCount
+  size_t occludedCount;
+  unsigned int occluderCount;
+  unsigned int **threadLists;
+  size_t *threadCounts;
+  JobCounter done;
+  size_t updateCount;
+  atomic_size_t chunksLeft; // of the current phase, updates or culling
+  atomic_size_t occluded;
+} FramePacket;
+
+typedef struct {
+  JobSystem *jobs;
+  TransformStore *transforms;
+  SphereSet *bounds;
+  const Bvh *bvh;
+  const OccluderMesh *occluder; // what every object draws as an occluder, or NULL
+  OcclusionBuffer occlusion;
+  unsigned int occluders[FRAME_MAX_OCCLUDERS];
+  unsigned int occluderCount;
+  unsigned int maxOccluders; // as many as the triangle budget allows
+  const MeshLod *lods;
+  unsigned int lodCount;
+  unsigned char *levels; // the level each object was last drawn at
+  float *sizes;          // and the pixels its radius covered then
+  float lodScale;
+  // 1 from framePipelineInit; 0 keeps every object, to check that culling
+  // leaves the frames alone
+  int frustumCulling;
+  unsigned int threads;
+  // two packets: one being prepared by workers, one being submitted
+  FramePacket packets[2];
+  unsigned int next;
+  struct FrameChunk *chunks;
+  size_t chunkCount;
+} FramePipeline;
+
+// Every object draws the same mesh, whose `lodCount` levels are `lods`.
+// `bvh`, if not NULL, must be built over `bounds` and is culled instead of
+// every sphere. `occluder`, if not NULL, turns on occlusion culling, with
+// each occluder drawn as that mesh.
+int framePipelineInit(FramePipeline *pipeline, JobSystem *jobs, TransformStore *transforms, SphereSet *bounds,
+                      const Bvh *bvh, const OccluderMesh *occluder, const MeshLod *lods, unsigned int lodCount);
+void framePipelineFree(FramePipeline *pipeline);
+
+// Start preparing the next packet for the given camera and return it without
+// waiting. Transforms must not be modified until frameWait returns for it.
+// `lodScale` is how many pixels one unit covers at a distance of one, i.e.
+// half the viewport height times projection[1][1] for the view drawn with.
+FramePacket *framePrepare(FramePipeline *pipeline, mat4 view, mat4 projection, float lodScale);
+
+void frameWait(FramePipeline *pipeline, FramePacket *packet);
+
+#endif
@@ -0,0 +1,167 @@
+#include "frustum.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_LANES 8
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_LANES 4
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRUSTUM_LANES 4
+#else
+#define FRUSTUM_LANES 1
+#endif
+
+#define SPHERE_SET_ALIGN 32
+
+static float *allocLane(size_t capacity) {
+  return aligned_alloc(SPHERE_SET_ALIGN, capacity * sizeof(float));
+}
+
+int sphereSetInit(SphereSet *set, size_t capacity) {
+  // round up so that every SIMD batch reads whole, aligned vectors
+  capacity = (capacity + 7) & ~(size_t)7;
+  if (capacity == 0) {
+    capacity = 8;
+  }
+  set->x = allocLane(capacity);
+  set->y = allocLane(capacity);
+  set->z = allocLane(capacity);
+  set->radius = allocLane(capacity);
+  set->count = 0;
+  set->capacity = capacity;
+  if (!set->x || !set->y || !set->z || !set->radius) {
+    sphereSetFree(set);
+    return 0;
+  }
+  for (size_t i = 0; i < capacity; ++i) {
+    set->x[i] = set->y[i] = set->z[i] = 0.0f;
+    set->radius[i] = -INFINITY;
+  }
+  return 1;
+}
+
+void sphereSetFree(SphereSet *set) {
+  free(set->x);
+  free(set->y);
+  free(set->z);
+  free(set->radius);
+  memset(set, 0, sizeof(*set));
+}
+
+void sphereSetAdd(SphereSet *set, vec3 center, float radius) {
+  if (set->count == set->capacity) {
+    return;
+  }
+  set->x[set->count] = center[0];
+  set->y[set->count] = center[1];
+  set->z[set->count] = center[2];
+  set->radius[set->count] = radius;
+  set->count++;
+}
+
+void frustumFromMatrix(mat4 m, Frustum *frustum) {
+  // Gribb/Hartmann: each plane is row 3 of the matrix plus or minus one of
+  // rows 0..2. cglm matrices are column major, so row r is m[0..3][r].
+  for (int i = 0; i < 6; ++i) {
+    int row = i / 2;
+    float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+    float a = m[0][3] + sign * m[0][row];
+    float b = m[1][3] + sign * m[1][row];
+    float c = m[2][3] + sign * m[2][row];
+    float d = m[3][3] + sign * m[3][row];
+    float len = sqrtf(a * a + b * b + c * c);
+    frustum->a[i] = a / len;
+    frustum->b[i] = b / len;
+    frustum->c[i] = c / len;
+    frustum->d[i] = d / len;
+  }
+}
+
+// append the set bits of `mask` (one per lane, starting at `base`) to `visible`
+static size_t emitVisible(unsigned int mask, size_t base, size_t end, unsigned int *visible, size_t n) {
+  while (mask) {
+    size_t index = base + __builtin_ctz(mask);
+    mask &= mask - 1;
+    if (index < end) {
+      visible[n++] = (unsigned int)index;
+    }
+  }
+  return n;
+}
+
+size_t frustumCullSpheres(const Frustum *frustum, const SphereSet *set, unsigned int *visible) {
+  return frustumCullSphereRange(frustum, set, 0, set->count, visible);
+}
+
+size_t frustumCullSphereRange(const Frustum *f, const SphereSet *set, size_t begin, size_t end, unsigned int *visible) {
+  size_t n = 0;
+  if (end > set->count) {
+    end = set->count;
+  }
+
+#if FRUSTUM_LANES == 8
+  for (size_t i = begin; i < end; i += 8) {
+    __m256 x = _mm256_load_ps(set->x + i);
+    __m256 y = _mm256_load_ps(set->y + i);
+    __m256 z = _mm256_load_ps(set->z + i);
+    __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_load_ps(set->radius + i));
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      __m256 dist = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(f->a[p])), _mm256_mul_ps(y, _mm256_set1_ps(f->b[p]))),
+          _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(f->c[p])), _mm256_set1_ps(f->d[p])));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, negRadius, _CMP_GE_OQ));
+    }
+    n = emitVisible((unsigned int)_mm256_movemask_ps(inside), i, end, visible, n);
+  }
+#elif FRUSTUM_LANES == 4 && !defined(__ARM_NEON)
+  for (size_t i = begin; i < end; i += 4) {
+    __m128 x = _mm_load_ps(set->x + i);
+    __m128 y = _mm_load_ps(set->y + i);
+    __m128 z = _mm_load_ps(set->z + i);
+    __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_load_ps(set->radius + i));
+    __m128 inside = _mm_cmpeq_ps(x, x); // all ones (positions are never NaN)
+    for (int p = 0; p < 6; ++p) {
+      __m128 dist = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(f->a[p])), _mm_mul_ps(y, _mm_set1_ps(f->b[p]))),
+          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(f->c[p])), _mm_set1_ps(f->d[p])));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negRadius));
+    }
+    n = emitVisible((unsigned int)_mm_movemask_ps(inside), i, end, visible, n);
+  }
+#elif FRUSTUM_LANES == 4
+  static const uint32_t laneBits[4] = {1, 2, 4, 8};
+  uint32x4_t bits = vld1q_u32(laneBits);
+  for (size_t i = begin; i < end; i += 4) {
+    float32x4_t x = vld1q_f32(set->x + i);
+    float32x4_t y = vld1q_f32(set->y + i);
+    float32x4_t z = vld1q_f32(set->z + i);
+    float32x4_t negRadius = vnegq_f32(vld1q_f32(set->radius + i));
+    uint32x4_t inside = vdupq_n_u32(0xffffffffu);
+    for (int p = 0; p < 6; ++p) {
+      float32x4_t dist = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(f->d[p]), x, f->a[p]), y, f->b[p]), z, f->c[p]);
+      inside = vandq_u32(inside, vcgeq_f32(dist, negRadius));
+    }
+    n = emitVisible(vaddvq_u32(vandq_u32(inside, bits)), i, end, visible, n);
+  }
+#else
+  for (size_t i = begin; i < end; ++i) {
+    int inside = 1;
+    for (int p = 0; p < 6 && inside; ++p) {
+      float dist = f->a[p] * set->x[i] + f->b[p] * set->y[i] + f->c[p] * set->z[i] + f->d[p];
+      inside = dist >= -set->radius[i];
+    }
+    if (inside) {
+      visible[n++] = (unsigned int)i;
+    }
+  }
+#endif
+
+  return n;
+}
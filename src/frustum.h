@@ -0,0 +1,43 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <stddef.h>
+#include <cglm/cglm.h>
+
+// The six clip planes (left, right, bottom, top, near, far) as
+// a*x + b*y + c*z + d >= 0, stored one array per coefficient so that a plane
+// can be broadcast across SIMD lanes.
+typedef struct {
+  float a[6];
+  float b[6];
+  float c[6];
+  float d[6];
+} Frustum;
+
+// Bounding spheres in structure-of-arrays layout. Storage is padded to a
+// multiple of 8 so the culling loop never needs a scalar tail; padding
+// entries have a negative radius and are always rejected.
+typedef struct {
+  float *x;
+  float *y;
+  float *z;
+  float *radius;
+  size_t count;
+  size_t capacity;
+} SphereSet;
+
+int sphereSetInit(SphereSet *set, size_t capacity);
+void sphereSetFree(SphereSet *set);
+void sphereSetAdd(SphereSet *set, vec3 center, float radius);
+
+// Extract normalized planes from a projection * view matrix.
+void frustumFromMatrix(mat4 viewProjection, Frustum *frustum);
+
+// Writes the indices of spheres that intersect the frustum to `visible`
+// (which must hold at least set->count entries) and returns how many there are.
+size_t frustumCullSpheres(const Frustum *frustum, const SphereSet *set, unsigned int *visible);
+
+// Same, restricted to spheres [begin, end). `begin` must be a multiple of 8.
+size_t frustumCullSphereRange(const Frustum *frustum, const SphereSet *set, size_t begin, size_t end, unsigned int *visible);
+
+#endif
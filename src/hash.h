@@ -0,0 +1,26 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// 64-bit FNV-1a, chained through `hash`; start with HASH_SEED. Used for
+// cache keys, not for anything that needs to resist collisions on purpose.
+#define HASH_SEED 0xcbf29ce484222325ull
+
+static inline uint64_t hashBytes(uint64_t hash, const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// Includes the terminator, so "ab" + "c" != "a" + "bc". NULL hashes like "".
+static inline uint64_t hashString(uint64_t hash, const char *string) {
+  return hashBytes(hash, string ? string : "", string ? strlen(string) + 1 : 1);
+}
+
+#endif
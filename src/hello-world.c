@@ -6,31 +6,52 @@
 #include <math.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <libgen.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <sys/param.h>
+#include <unistd.h>
 #include <cglm/cglm.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
-off_t fsize(const char *filename) {
-    struct stat st;
-
-    if (stat(filename, &st) == 0)
-        return st.st_size;
-
-    return -1;
-}
-
-const char *relative_path(char *dst, char *base, char *target) {
-  dirname_r(base, dst);
-  strlcat(dst, "/", MAXPATHLEN);
-  strlcat(dst, target, MAXPATHLEN);
+#include "assetpack.h"
+#include "bvh.h"
+#include "capture.h"
+#include "frustum.h"
+#include "transform.h"
+#include "jobs.h"
+#include "latency.h"
+#include "mesh.h"
+#include "frame.h"
+#include "indirect.h"
+#include "reflect.h"
+#include "ringbuffer.h"
+#include "shader.h"
+#include "shadercache.h"
+#include "shaderwatch.h"
+#include "texarray.h"
+#include "texmanager.h"
+#include "timestep.h"
+#include "vtex.h"
+
+// `target` next to the file `base`; dst holds MAXPATHLEN
+const char *relative_path(char *dst, const char *base, const char *target) {
+  const char *slash = strrchr(base, '/');
+  int length = slash ? (int)(slash - base) : 1;
+  snprintf(dst, MAXPATHLEN, "%.*s/%s", length, slash ? base : ".", target);
   return dst;
 }
 
+// uniform buffer binding points of the Camera and Object blocks
+#define CAMERA_BINDING 0
+#define OBJECT_BINDING 1
+
+// Per-draw data, laid out both for the std140 Object block and for the
+// instanced attributes of the indirect path
+typedef struct {
+  mat4 model;
+  GLint layers[4]; // texture array layers of the base and overlay images
+} ObjectData;
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
   glViewport(0, 0, width, height);
@@ -43,85 +64,404 @@ void processInput(GLFWwindow *window)
   }
 }
 
-// info log - for storing error messages, etc.
-char infoLog[512];
+// A fly camera: WASD moves it, dragging with the left button looks around.
+typedef struct {
+  vec3 position;
+  float yaw;   // radians, 0 looking down +x
+  float pitch;
+  double cursorX, cursorY;
+  int dragging;
+  double last;
+} FlyCamera;
 
-int makeShader(GLenum shaderType, const char *path, unsigned int *shader) {
-  off_t filesize = fsize(path);
-  char *source = malloc(filesize + 1);
-  FILE *file = fopen(path, "r");
-  if (file == NULL) {
-    perror("fopen");
-    return 0;
+#define CAMERA_SPEED 2.5f         // units a second
+#define CAMERA_SENSITIVITY 0.004f // radians a pixel
+
+void cameraInit(FlyCamera *camera, vec3 position, double now)
+{
+  memset(camera, 0, sizeof(*camera));
+  glm_vec3_copy(position, camera->position);
+  camera->yaw = -GLM_PI_2f;
+  camera->last = now;
+}
+
+void cameraFront(const FlyCamera *camera, vec3 front)
+{
+  front[0] = cosf(camera->yaw) * cosf(camera->pitch);
+  front[1] = sinf(camera->pitch);
+  front[2] = sinf(camera->yaw) * cosf(camera->pitch);
+}
+
+// Moves the camera by the keys and cursor as they are right now, for the
+// time since the last call. Cheap enough to call twice a frame.
+void cameraLatch(FlyCamera *camera, GLFWwindow *window, double now)
+{
+  float dt = (float)(now - camera->last);
+  camera->last = now;
+
+  double x, y;
+  glfwGetCursorPos(window, &x, &y);
+  int dragging = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+  if (dragging && camera->dragging) {
+    camera->yaw += (float)(x - camera->cursorX) * CAMERA_SENSITIVITY;
+    camera->pitch -= (float)(y - camera->cursorY) * CAMERA_SENSITIVITY;
+    camera->pitch = glm_clamp(camera->pitch, -1.5f, 1.5f);
   }
-  if (fread(source, sizeof(char), filesize, file) != filesize) {
-    perror("fread");
-    return 0;
+  camera->dragging = dragging;
+  camera->cursorX = x;
+  camera->cursorY = y;
+
+  vec3 front, right;
+  cameraFront(camera, front);
+  glm_vec3_crossn(front, (vec3){0.0f, 1.0f, 0.0f}, right);
+  float distance = CAMERA_SPEED * dt;
+  if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+    glm_vec3_muladds(front, distance, camera->position);
   }
-  source[filesize] = 0;
-  *shader = glCreateShader(shaderType);
-  glShaderSource(*shader, 1, &source, NULL);
-  glCompileShader(*shader);
-  free(source);
-  fclose(file);
-  int success;
-  glGetShaderiv(*shader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(*shader, sizeof(infoLog), NULL, infoLog);
-    return 0;
+  if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+    glm_vec3_muladds(front, -distance, camera->position);
+  }
+  if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+    glm_vec3_muladds(right, distance, camera->position);
+  }
+  if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+    glm_vec3_muladds(right, -distance, camera->position);
   }
-  return success;
 }
 
-int makeShaderProgram(unsigned int vertexShader, unsigned int fragmentShader, unsigned int *program) {
-  *program = glCreateProgram();
-  glAttachShader(*program, vertexShader);
-  glAttachShader(*program, fragmentShader);
-  glLinkProgram(*program);
-  int success;
-  glGetProgramiv(*program, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(*program, sizeof(infoLog), NULL, infoLog);
+void cameraView(FlyCamera *camera, mat4 view)
+{
+  vec3 front;
+  cameraFront(camera, front);
+  glm_look(camera->position, front, (vec3){0.0f, 1.0f, 0.0f}, view);
+}
+
+#define CULL_FOV 55.0f // degrees, against 45 for drawing
+
+// The view and projection culling, LOD selection and occlusion go by. The
+// camera is latched again just before drawing, after culling has used this
+// view, and may have turned and moved in between. The wider field of view
+// makes up for a turn of 5 degrees; for a move, the eye backs off until the
+// frustum holds the eye anywhere within `travel`, which takes travel over
+// the sine of the narrower half angle. Occlusion is not made up for: an
+// object hidden from here can peek past an occluder's edge from where the
+// camera ends up, and shows a frame late.
+void cameraCullView(const FlyCamera *camera, float travel, mat4 view, mat4 projection)
+{
+  vec3 front, eye;
+  cameraFront(camera, front);
+  float back = travel / sinf(glm_rad(CULL_FOV) * 0.5f);
+  glm_vec3_copy((float *)camera->position, eye);
+  glm_vec3_muladds(front, -back, eye);
+  glm_look(eye, front, (vec3){0.0f, 1.0f, 0.0f}, view);
+  glm_perspective(glm_rad(CULL_FOV), 800.0f / 600.0f, 0.1f, 100.0f + back, projection);
+}
+
+// Parameters of hello-world.vert and .frag, set through a UniformLayout
+typedef struct {
+  GLfloat positionScale[3];
+  GLfloat positionBias[3];
+  GLint textures;
+  // the VIRTUAL_TEXTURE permutation's, see vtex.glsl
+  GLint pageTable;
+  GLint pageCache;
+  GLint vtInfo[4];
+} Material;
+
+static const UniformField materialFields[] = {
+  {"positionScale", GL_FLOAT_VEC3, offsetof(Material, positionScale), 1},
+  {"positionBias", GL_FLOAT_VEC3, offsetof(Material, positionBias), 1},
+  {"textures", GL_SAMPLER_2D_ARRAY, offsetof(Material, textures), 1},
+  {"pageTable", GL_UNSIGNED_INT_SAMPLER_2D_ARRAY, offsetof(Material, pageTable), 1},
+  {"pageCache", GL_SAMPLER_2D, offsetof(Material, pageCache), 1},
+  {"vtInfo", GL_INT_VEC4, offsetof(Material, vtInfo), 1},
+};
+
+// Reflect a freshly linked program, bind its uniform blocks, lay out the
+// material for it and make it current. Only the per-draw permutation of the
+// vertex shader has the Object block.
+int useShaderProgram(unsigned int program, ProgramReflection *reflection, UniformLayout *materialLayout)
+{
+  glUseProgram(program);
+  reflectionFree(reflection);
+  uniformLayoutFree(materialLayout);
+  if (!reflectProgram(reflection, program)) {
     return 0;
   }
-  return success;
+  reflectionBindBlock(reflection, "Camera", CAMERA_BINDING);
+  reflectionBindBlock(reflection, "Object", OBJECT_BINDING);
+  return uniformLayoutInit(materialLayout, reflection, materialFields, sizeof(materialFields) / sizeof(materialFields[0]));
 }
 
-unsigned int loadTexture(const char *path, GLenum unit, unsigned int rgb, int flip) {
-  unsigned int texture;
-  glActiveTexture(unit);
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  // set the texture wrapping/filtering options (on the currently bound texture object)
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  stbi_set_flip_vertically_on_load(flip);
-  // load and generate the texture
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
-  if (data)
-    {
-      glTexImage2D(GL_TEXTURE_2D, 0, rgb, width, height, 0, rgb, GL_UNSIGNED_BYTE, data);
-      glGenerateMipmap(GL_TEXTURE_2D);
-    }
-  else
-    {
-      fprintf(stderr, "Failed to load texture\n");
+// Build the virtual texture feedback permutation, whose two extra defines
+// follow `defines`, and set its material, which never changes. Leaves it
+// current.
+unsigned int makeFeedbackProgram(ShaderCache *cache, const char *vertexPath, const char *fragmentPath,
+                                 const ShaderDefine *defines, size_t defineCount, const Material *material)
+{
+  unsigned int program = shaderCacheProgram(cache, vertexPath, fragmentPath, defines, defineCount + 2);
+  ProgramReflection reflection = {0};
+  UniformLayout layout = {0};
+  int ok = program != 0 && useShaderProgram(program, &reflection, &layout);
+  if (ok) {
+    uniformLayoutApply(&layout, material);
+  }
+  uniformLayoutFree(&layout);
+  reflectionFree(&reflection);
+  return ok ? program : 0;
+}
+
+// Draw the visible objects, whose ObjectData starts at `objectsOffset` in
+// `buffer`, with the bound mesh: the first levelCounts[0] at full detail,
+// the next levelCounts[1] at the next level, and so on. `indirect` is NULL
+// to draw them one at a time.
+void drawObjects(const Mesh *mesh, IndirectBatch *indirect, unsigned int buffer, size_t objectsOffset,
+                 size_t objectStride, const size_t *levelCounts)
+{
+  if (indirect) {
+    indirectBatchDraw(indirect, buffer, objectsOffset, levelCounts);
+    return;
+  }
+  size_t indexSize = mesh->indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+  size_t v = 0;
+  for (unsigned int level = 0; level < mesh->lodCount; ++level) {
+    const MeshLod *lod = &mesh->lods[level];
+    for (size_t n = 0; n < levelCounts[level]; ++n, ++v) {
+      glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BINDING, buffer, objectsOffset + v * objectStride, sizeof(ObjectData));
+      glDrawElements(GL_TRIANGLES, (GLsizei)lod->indexCount, mesh->indexType, (void*)(lod->firstIndex * indexSize));
     }
-  stbi_image_free(data);
-  return texture;
+  }
 }
 
-int main()
+// Pixels one unit covers at a distance of one, for picking levels of detail.
+float lodScale(GLFWwindow *window, mat4 projection)
 {
+  int width, height;
+  glfwGetFramebufferSize(window, &width, &height);
+  return projection[1][1] * (float)height * 0.5f;
+}
+
+// Print the cube under the cursor: the nearest bounding sphere along the
+// ray from the camera through it.
+void pickObject(GLFWwindow *window, mat4 view, mat4 projection, const Bvh *bvh, const SphereSet *bounds)
+{
+  double x, y;
+  int width, height;
+  glfwGetCursorPos(window, &x, &y);
+  glfwGetWindowSize(window, &width, &height);
+  if (width == 0 || height == 0) {
+    return;
+  }
+  // unproject the cursor on the near and far planes
+  mat4 viewProjection, inverse;
+  glm_mat4_mul(projection, view, viewProjection);
+  glm_mat4_inv(viewProjection, inverse);
+  float ndcX = (float)(2.0 * x / width - 1.0), ndcY = (float)(1.0 - 2.0 * y / height);
+  vec4 near, far;
+  glm_mat4_mulv(inverse, (vec4){ndcX, ndcY, -1.0f, 1.0f}, near);
+  glm_mat4_mulv(inverse, (vec4){ndcX, ndcY, 1.0f, 1.0f}, far);
+  vec3 origin, direction;
+  for (int a = 0; a < 3; ++a) {
+    origin[a] = near[a] / near[3];
+    direction[a] = far[a] / far[3] - origin[a];
+  }
+  glm_vec3_normalize(direction);
+
+  unsigned int object;
+  float distance;
+  size_t visited;
+  if (bvhRaycast(bvh, bounds, origin, direction, &object, &distance, &visited)) {
+    printf("pick: cube %u, %.2f units away, %zu nodes visited\n", object, distance, visited);
+  } else {
+    printf("pick: nothing, %zu nodes visited\n", visited);
+  }
+}
+
+// Build `count` distinct copies of a program, first one at a time and then as
+// a single batch, and print how long each took. Every copy gets a different
+// trailing comment so that driver shader caches cannot skip the work.
+void benchmarkShaderBuilds(const char *vertexSource, const char *fragmentSource, unsigned int count)
+{
+  ProgramBuild *builds = calloc(2 * count, sizeof(ProgramBuild));
+  char **sources = calloc(4 * count, sizeof(char *));
+  size_t vertexLength = strlen(vertexSource) + 32, fragmentLength = strlen(fragmentSource) + 32;
+  for (unsigned int i = 0; i < 2 * count; ++i) {
+    sources[2 * i] = malloc(vertexLength);
+    sources[2 * i + 1] = malloc(fragmentLength);
+    snprintf(sources[2 * i], vertexLength, "%s\n// variant %u\n", vertexSource, i);
+    snprintf(sources[2 * i + 1], fragmentLength, "%s\n// variant %u\n", fragmentSource, i);
+    builds[i].name = "benchmark";
+    builds[i].vertexSource = sources[2 * i];
+    builds[i].fragmentSource = sources[2 * i + 1];
+  }
+
+  double start = glfwGetTime();
+  for (unsigned int i = 0; i < count; ++i) {
+    buildShaderPrograms(&builds[i], 1);
+  }
+  double serial = glfwGetTime() - start;
+
+  start = glfwGetTime();
+  buildShaderPrograms(&builds[count], count);
+  double batched = glfwGetTime() - start;
+
+  printf("built %u programs: %.1f ms one at a time, %.1f ms batched\n", count, serial * 1000.0, batched * 1000.0);
+  for (unsigned int i = 0; i < 2 * count; ++i) {
+    glDeleteProgram(builds[i].program);
+    free(sources[2 * i]);
+    free(sources[2 * i + 1]);
+  }
+  free(sources);
+  free(builds);
+}
+
+#define DRIFT_RADIUS 2.0f // units
+#define DRIFT_RATE 0.5f   // radians a second
+
+// One simulation step, ending at `time`: every third of the original cubes
+// turns, as in the tutorial's exercise. With `drift` the scattered cubes
+// also circle where they started, and their bounding spheres go with them.
+void simulate(TransformStore *transforms, SphereSet *bounds, vec3 *positions, int drift, double time)
+{
+  for (unsigned int i = 0; i < 10; i += 3) {
+    float angle = glm_rad(20.0f * i) + (float)time * glm_rad(50.0f);
+    transformSetRotation(transforms, i, angle, (vec3){1.0f, 0.3f, 0.5f});
+  }
+  if (!drift) {
+    return;
+  }
+  for (size_t i = 10; i < transforms->count; ++i) {
+    float angle = (float)time * DRIFT_RATE + (float)i;
+    vec3 position = {positions[i][0] + DRIFT_RADIUS * cosf(angle), positions[i][1] + DRIFT_RADIUS * sinf(angle),
+                     positions[i][2]};
+    transformSetPosition(transforms, i, position);
+    bounds->x[i] = position[0];
+    bounds->y[i] = position[1];
+    bounds->z[i] = position[2];
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // -n <count>: total number of cubes; the extra ones are scattered around
+  // the original ten so that most of them end up off-screen
+  // -l: always draw one cube at a time, even if multi-draw indirect is available
+  // -w: watch the shader sources and hot-reload them
+  // -s <count>: time building that many programs serially and batched at startup
+  // -v: stream the images as virtual textures, made by `make textures`
+  // -b <KiB>: video memory budget for textures
+  // -B <frames>: draw that many frames as fast as possible in a hidden
+  // window, print the time they took and quit; `make pgo` trains on this
+  // -r <Hz>: simulation steps a second, whatever the frame rate
+  // -p <fps>: hold frames to that rate by sleeping, instead of waiting on vsync
+  // -L <file>: log when each frame's input was read, submitted, swapped and
+  // finished on the GPU, as CSV
+  // -C <pattern>: write every frame to a file named by the printf pattern,
+  // e.g. capture/%05lu.png; the simulation then takes one step a frame, so
+  // that the frames do not depend on timing
+  // -m <model.obj>: draw that model instead of the cube
+  // -o: cull by the frustum alone, leaving cubes hidden behind others to the
+  // depth test
+  // -u: draw every cube at full detail, without culling of any kind; the
+  // frames should not change, which `make test` checks
+  // -c <x,y,z,yaw,pitch>: start the camera there, looking that way in degrees
+  // -d: the scattered cubes drift, and the bounding volume hierarchy is
+  // refit to them every frame
+  unsigned int cubeCount = 10;
+  int perDrawLoop = 0;
+  int watchShaders = 0;
+  unsigned int shaderBenchmark = 0;
+  int virtualTexturing = 0;
+  size_t textureBudget = 256 * 1024 * 1024;
+  unsigned long benchmarkFrames = 0;
+  double simulationRate = 60.0;
+  double paceRate = 0.0;
+  const char *latencyLog = NULL;
+  const char *capturePattern = NULL;
+  const char *modelPath = "res/cube.obj";
+  int occlusionCulling = 1;
+  int culling = 1;
+  float cameraStart[5] = {0.0f, 0.0f, 3.0f, -90.0f, 0.0f};
+  int drift = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:lws:vb:B:r:p:L:C:m:ouc:d")) != -1) {
+    switch (opt) {
+    case 'n':
+      cubeCount = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      perDrawLoop = 1;
+      break;
+    case 'w':
+      watchShaders = 1;
+      break;
+    case 's':
+      shaderBenchmark = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    case 'v':
+      virtualTexturing = 1;
+      break;
+    case 'b':
+      textureBudget = (size_t)strtoull(optarg, NULL, 10) * 1024;
+      break;
+    case 'B':
+      benchmarkFrames = strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      simulationRate = strtod(optarg, NULL);
+      break;
+    case 'p':
+      paceRate = strtod(optarg, NULL);
+      break;
+    case 'L':
+      latencyLog = optarg;
+      break;
+    case 'C':
+      capturePattern = optarg;
+      break;
+    case 'm':
+      modelPath = optarg;
+      break;
+    case 'o':
+      occlusionCulling = 0;
+      break;
+    case 'u':
+      culling = 0;
+      occlusionCulling = 0;
+      break;
+    case 'd':
+      drift = 1;
+      break;
+    case 'c':
+      if (sscanf(optarg, "%f,%f,%f,%f,%f", &cameraStart[0], &cameraStart[1], &cameraStart[2], &cameraStart[3],
+                 &cameraStart[4]) == 5) {
+        break;
+      }
+      // fall through
+    default:
+      fprintf(stderr,
+              "usage: %s [-n cubes] [-l] [-w] [-s programs] [-v] [-b KiB] [-B frames] [-r Hz] [-p fps] [-L file] "
+              "[-C pattern] [-m model.obj] [-o] [-u] [-c x,y,z,yaw,pitch] [-d]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (simulationRate <= 0.0) {
+    simulationRate = 60.0;
+  }
+  if (cubeCount < 10) {
+    cubeCount = 10;
+  }
+
   // glfw initialization
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  if (benchmarkFrames > 0) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  }
 
   GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
   if (window == NULL)
@@ -132,6 +472,8 @@ int main()
     }
   glfwMakeContextCurrent(window);
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  // the benchmark is not held back by the display, and -p paces frames itself
+  glfwSwapInterval(benchmarkFrames > 0 || paceRate > 0.0 ? 0 : 1);
 
   // glad initialization
   if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -141,161 +483,162 @@ int main()
     }
   //glViewport(0, 0, 800, 600);
 
-  unsigned int texture1, texture2;
-  int width, height, nrChannels;
-  unsigned char *imgData;
-
-  // load texture 1
-  glActiveTexture(GL_TEXTURE0);
-  glGenTextures(1, &texture1);
-  glBindTexture(GL_TEXTURE_2D, texture1);
-  // set the texture wrapping/filtering options (on the currently bound texture object)
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  stbi_set_flip_vertically_on_load(0);
-  // load and generate the texture
-  imgData = stbi_load("res/container.jpg", &width, &height, &nrChannels, 0);
-  if (imgData)
-    {
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imgData);
-      glGenerateMipmap(GL_TEXTURE_2D);
-    }
-  else
-    {
-      fprintf(stderr, "Failed to load texture\n");
+  // Assets come from build/assets.lpak, made by `make assets`, when it is
+  // there: one mapping read ahead in large requests, instead of a few
+  // opens and reads per file. -w edits the loose files, so it skips the pack.
+  AssetPack *assets = watchShaders ? NULL : assetPackOpen("build/assets.lpak");
+  if (assets) {
+    assetMount(assets);
+    printf("assets: %zu from build/assets.lpak\n", assetPackCount(assets));
+  }
+
+  // Worker threads: they load the textures now, and later run culling,
+  // transform updates and draw list building one frame ahead of the GL
+  // thread, which only replays the finished lists.
+  JobSystem *jobs = jobSystemCreate(0);
+  if (jobs == NULL) {
+    fprintf(stderr, "Failed to start the worker threads\n");
+    return 1;
+  }
+
+  // Both images are packed into the layers of one texture array, bound once
+  // to unit 0; each draw picks its images by layer. `make textures` compresses
+  // them ahead of time, otherwise the originals are loaded and their mips
+  // built on the worker threads and kept in build/mip-cache.
+  TextureSource textureSources[] = {
+    {"res/container.jpg", 0, 1, "build/res/container.ltex"},
+    {"res/awesomeface.png", 1, 1, "build/res/awesomeface.ltex"},
+  };
+  TextureSlot textureSlots[2] = {{-1, 0}, {-1, 1}};
+
+  // -v: only the pages in view are kept, in a cache deliberately smaller
+  // than the two images, with the page tables on unit 1 and the cache on
+  // unit 2. Each layer is then an image of the set.
+  VirtualTextureSet *virtualTextures = NULL;
+  if (virtualTexturing) {
+    const char *paths[] = {"build/res/container.lvtx", "build/res/awesomeface.lvtx"};
+    virtualTextures = vtCreate(jobs, paths, 2, 6, GL_TEXTURE1, GL_TEXTURE2);
+    if (virtualTextures == NULL) {
+      fprintf(stderr, "Failed to open the virtual textures, run `make textures`\n");
+      return 1;
     }
-  stbi_image_free(imgData);
-
-  // load texture 2
-  glActiveTexture(GL_TEXTURE1);
-  glGenTextures(1, &texture2);
-  glBindTexture(GL_TEXTURE_2D, texture2);
-  // set the texture wrapping/filtering options (on the currently bound texture object)
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  stbi_set_flip_vertically_on_load(1);
-  // load and generate the texture
-  imgData = stbi_load("res/awesomeface.png", &width, &height, &nrChannels, 0);
-  if (imgData)
-    {
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imgData);
-      glGenerateMipmap(GL_TEXTURE_2D);
+  }
+
+  // Otherwise the images are one texture of the texture manager, which
+  // keeps it within -b by dropping its largest levels if it has to. It is
+  // used, and so rebound, every frame, since a reload replaces it.
+  TextureManager *textureManager = NULL;
+  int sceneTexture = -1;
+  if (!virtualTextures) {
+    textureManager = textureManagerCreate(jobs, "build/mip-cache", textureBudget);
+    sceneTexture = textureManager ? textureManagerAdd(textureManager, textureSources, 2) : -1;
+    glActiveTexture(GL_TEXTURE0);
+    const TexturePack *texturePack = sceneTexture != -1 ? textureManagerUse(textureManager, sceneTexture, textureSlots) : NULL;
+    if (texturePack == NULL) {
+      fprintf(stderr, "Failed to load textures\n");
+      return 1;
     }
-  else
-    {
-      fprintf(stderr, "Failed to load texture\n");
+    if (texturePack->count != 1 || textureSlots[0].array != textureSlots[1].array) {
+      fprintf(stderr, "The textures do not fit in one texture array\n");
     }
-  stbi_image_free(imgData);
+    printf("textures: %s, %zu KiB\n", texturePack->count > 0 && texturePack->arrays[0].internalFormat != GL_RGBA8 ? "S3TC" : "RGBA8",
+           texturePack->bytes / 1024);
+  }
 
-  char path_dst[MAXPATHLEN];
+  char vertexPath[MAXPATHLEN], fragmentPath[MAXPATHLEN];
+  relative_path(vertexPath, __FILE__, "hello-world.vert");
+  relative_path(fragmentPath, __FILE__, "hello-world.frag");
+
+  // the multi-draw indirect path reads the model matrix from an instanced
+  // attribute instead of a uniform, the INDIRECT permutation of the shader
+  int useIndirect = !perDrawLoop && indirectSupported();
+  printf("draw submission: %s\n", useIndirect ? "multi-draw indirect" : "one draw per cube");
+  // -v: the VIRTUAL_TEXTURE permutation, plus its VT_FEEDBACK variant for the
+  // feedback pass
+  char pageSize[16], pageBorder[16], feedbackScale[16];
+  snprintf(pageSize, sizeof(pageSize), "%d", VT_PAGE_SIZE);
+  snprintf(pageBorder, sizeof(pageBorder), "%d", VT_PAGE_BORDER);
+  snprintf(feedbackScale, sizeof(feedbackScale), "%d", VT_FEEDBACK_SCALE);
+  ShaderDefine defines[6];
+  size_t defineCount = 0;
+  defines[defineCount++] = (ShaderDefine){"MIX_FACTOR", "0.2"};
+  if (useIndirect) {
+    defines[defineCount++] = (ShaderDefine){"INDIRECT", NULL};
+  }
+  if (virtualTextures) {
+    defines[defineCount++] = (ShaderDefine){"VIRTUAL_TEXTURE", NULL};
+    defines[defineCount++] = (ShaderDefine){"VT_PAGE_SIZE", pageSize};
+    defines[defineCount++] = (ShaderDefine){"VT_PAGE_BORDER", pageBorder};
+  }
+  defines[defineCount] = (ShaderDefine){"VT_FEEDBACK", NULL};
+  defines[defineCount + 1] = (ShaderDefine){"VT_FEEDBACK_SCALE", feedbackScale};
 
-  unsigned int vertexShader;
-  if (!makeShader(GL_VERTEX_SHADER, relative_path(path_dst, __FILE__, "hello-world.vert"), &vertexShader)) {
-    printf("Vertex shader could not be made: %s\n", infoLog);
+  if (GLAD_GL_KHR_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsKHR(0xffffffffu);
+  }
+  // each permutation is compiled once, and its binary kept for the next run
+  ShaderCache *shaderCache = shaderCacheCreate("build/shader-cache");
+  if (shaderCache == NULL) {
     return 1;
   }
+  if (shaderBenchmark > 0) {
+    const char *vertexSource = shaderCacheSource(shaderCache, vertexPath, defines, defineCount);
+    const char *fragmentSource = shaderCacheSource(shaderCache, fragmentPath, defines, defineCount);
+    if (vertexSource && fragmentSource) {
+      benchmarkShaderBuilds(vertexSource, fragmentSource, shaderBenchmark);
+    }
+  }
 
-  unsigned int fragmentShader;
-  if (!makeShader(GL_FRAGMENT_SHADER, relative_path(path_dst, __FILE__, "hello-world.frag"), &fragmentShader)) {
-    printf("Fragment shader could not be made: %s\n", infoLog);
+  // owned by the cache, unless it gets replaced by a reloaded one
+  unsigned int cachedProgram = shaderCacheProgram(shaderCache, vertexPath, fragmentPath, defines, defineCount);
+  if (cachedProgram == 0) {
+    printf("Shader program could not be made\n");
     return 1;
   }
+  unsigned int shaderProgram = cachedProgram;
 
-  unsigned int shaderProgram;
-  if (!makeShaderProgram(vertexShader, fragmentShader, &shaderProgram)) {
-    printf("Shader program could not be made: %s\n", infoLog);
+  // -m: the model every object draws, parsed once and then loaded from
+  // build/mesh-cache; it leaves its VAO bound for the rest of the run
+  double meshStart = glfwGetTime();
+  Mesh mesh;
+  if (!meshLoad(&mesh, jobs, "build/mesh-cache", modelPath)) {
     return 1;
   }
+  printf("mesh: %s, %u vertices of %u bytes, %d indices, %s in %.1f ms\n", modelPath, mesh.vertexCount,
+         mesh.vertexStride, mesh.indexCount, mesh.cached ? "cached" : "parsed", (glfwGetTime() - meshStart) * 1000.0);
+
+  // activate the shader; per-frame data lives in uniform blocks sourced from
+  // the ring buffer, and the material only changes with the program
+  Material material = {{0.0f}, {0.0f}, 0, 1, 2, {0, 0, 0, 0}};
+  memcpy(material.positionScale, mesh.positionScale, sizeof(material.positionScale));
+  memcpy(material.positionBias, mesh.positionBias, sizeof(material.positionBias));
+  ProgramReflection reflection = {0};
+  UniformLayout materialLayout = {0};
+  unsigned int feedbackProgram = 0;
+  if (virtualTextures) {
+    vtShaderInfo(virtualTextures, material.vtInfo);
+    feedbackProgram = makeFeedbackProgram(shaderCache, vertexPath, fragmentPath, defines, defineCount, &material);
+    if (feedbackProgram == 0) {
+      printf("Feedback shader program could not be made\n");
+      return 1;
+    }
+  }
+  if (!useShaderProgram(shaderProgram, &reflection, &materialLayout)) {
+    return 1;
+  }
+  uniformLayoutApply(&materialLayout, &material);
+  printf("program: %zu uniforms, %zu uniform blocks, %zu material bindings\n",
+         reflection.uniformCount, reflection.blockCount, materialLayout.count);
+
+  // -w: rebuild the program in the background whenever a shader file is saved
+  ShaderWatch *shaderWatch = NULL;
+  if (watchShaders) {
+    shaderWatch = shaderWatchStart(window, vertexPath, fragmentPath, defines, defineCount);
+  }
 
-  // activate the shader
-  glUseProgram(shaderProgram);
-
-  unsigned int modelLoc = glGetUniformLocation(shaderProgram, "model");
-  unsigned int viewLoc = glGetUniformLocation(shaderProgram, "view");
-  unsigned int projectionLoc = glGetUniformLocation(shaderProgram, "projection");
-
-  glUniform1i(glGetUniformLocation(shaderProgram, "texture1"), 0);
-  glUniform1i(glGetUniformLocation(shaderProgram, "texture2"), 1);
-
-
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
 
   glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-  float vertices[] = {
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-    0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-  };
-
-  unsigned int VBO, VAO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-
-  // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-  glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-  // position attribute
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
-
-  // texture
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-
-  // note that this is allowed, the call to glVertexAttribPointer registered VBO as the vertex attribute's bound vertex buffer object so afterwards we can safely unbind
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  // You can unbind the VAO afterwards so other VAO calls won't accidentally modify this VAO, but this rarely happens. Modifying other
-  // VAOs requires a call to glBindVertexArray anyways so we generally don't unbind VAOs (nor VBOs) when it's not directly necessary.
-  // glBindVertexArray(0);
-
   vec3 cubePositions[] = {
     { 0.0f,  0.0f,  0.0f}, 
     { 2.0f,  5.0f, -15.0f}, 
@@ -309,50 +652,360 @@ int main()
     {-1.3f,  1.0f, -1.5f}  
   };
 
+  vec3 *positions = malloc(cubeCount * sizeof(vec3));
+  memcpy(positions, cubePositions, sizeof(cubePositions));
+  srand(1);
+  for (unsigned int i = 10; i < cubeCount; ++i) {
+    positions[i][0] = ((float)rand() / RAND_MAX - 0.5f) * 200.0f;
+    positions[i][1] = ((float)rand() / RAND_MAX - 0.5f) * 200.0f;
+    positions[i][2] = -(float)rand() / RAND_MAX * 100.0f;
+  }
+
+  // bounding spheres for frustum culling, in the same order as positions
+  SphereSet bounds;
+  if (!sphereSetInit(&bounds, cubeCount)) {
+    fprintf(stderr, "Failed to allocate bounding spheres\n");
+    return 1;
+  }
+  // a drifting cube is drawn somewhere between its last two steps, so its
+  // sphere grows by the distance it covers in one
+  float driftPadding = drift ? DRIFT_RADIUS * DRIFT_RATE / (float)simulationRate : 0.0f;
+  for (unsigned int i = 0; i < cubeCount; ++i) {
+    sphereSetAdd(&bounds, positions[i], i < 10 ? mesh.radius : mesh.radius + driftPadding);
+  }
+  // the tree keeps its shape as cubes drift, since none goes far from where
+  // it started; bvhRefit only grows and shrinks its boxes
+  Bvh bvh;
+  double bvhStart = glfwGetTime();
+  if (!bvhInit(&bvh, cubeCount) || !bvhBuild(&bvh, jobs, &bounds)) {
+    fprintf(stderr, "Failed to build the bounding volume hierarchy\n");
+    return 1;
+  }
+  printf("bvh: %u nodes, %u culling tasks, built in %.3f ms\n", atomic_load(&bvh.nodeCount),
+         atomic_load(&bvh.taskCount), (glfwGetTime() - bvhStart) * 1000.0);
+
+  // the cubes never move, so their model matrices are built once by the
+  // first transformUpdate and only rebuilt when a transform is changed
+  TransformStore transforms;
+  if (!transformStoreInit(&transforms, cubeCount)) {
+    fprintf(stderr, "Failed to allocate transforms\n");
+    return 1;
+  }
+  for (unsigned int i = 0; i < cubeCount; ++i) {
+    float angle = 20.0f * i;
+    transformAdd(&transforms, positions[i], glm_rad(angle), (vec3){1.0f, 0.3f, 0.5f}, (vec3){1.0f, 1.0f, 1.0f});
+  }
+  // every cube shows the crate with the face on top; with -v the slots keep
+  // their defaults, the images' indices in the virtual texture set
+  GLint (*objectLayers)[2] = malloc(cubeCount * sizeof(*objectLayers));
+  for (unsigned int i = 0; i < cubeCount; ++i) {
+    objectLayers[i][0] = textureSlots[0].layer;
+    objectLayers[i][1] = textureSlots[1].layer;
+  }
+  double lastReport = glfwGetTime();
+
+
+  // one range of commands per level of detail
+  IndirectRange lodRanges[MESH_MAX_LODS];
+  for (unsigned int level = 0; level < mesh.lodCount; ++level) {
+    lodRanges[level] = (IndirectRange){mesh.lods[level].firstIndex, mesh.lods[level].indexCount};
+  }
+  IndirectBatch indirect;
+  if (useIndirect && !indirectBatchInit(&indirect, cubeCount, mesh.indexType, lodRanges, mesh.lodCount, 2, 6,
+                                        sizeof(ObjectData))) {
+    fprintf(stderr, "Failed to allocate indirect draw commands\n");
+    return 1;
+  }
+  // Camera and per-draw data are streamed through a persistently mapped ring
+  // buffer; in the per-draw path each object sits at its own uniform offset.
+  GLint uboAlignment;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+  size_t objectStride = useIndirect ? sizeof(ObjectData) : (sizeof(ObjectData) + uboAlignment - 1) / uboAlignment * uboAlignment;
+  RingBuffer ring;
+  if (!ringBufferInit(&ring, 2 * sizeof(mat4) + cubeCount * objectStride + 2 * uboAlignment)) {
+    fprintf(stderr, "Failed to create the streaming buffer\n");
+    return 1;
+  }
+
+  double submitTime = 0.0;
+  unsigned int submitFrames = 0;
+  double refitTime = 0.0;
+  unsigned int refitFrames = 0;
+
+  FramePipeline pipeline;
+  if (!framePipelineInit(&pipeline, jobs, &transforms, &bounds, culling ? &bvh : NULL,
+                         occlusionCulling ? &mesh.occluder : NULL, mesh.lods, culling ? mesh.lodCount : 1)) {
+    fprintf(stderr, "Failed to start the frame pipeline\n");
+    return 1;
+  }
+  pipeline.frustumCulling = culling;
+  if (occlusionCulling && pipeline.maxOccluders == 0) {
+    printf("occlusion: %u triangles are too many for an occluder, so nothing is culled that way\n",
+           mesh.occluder.indexCount / 3);
+  }
 
   glEnable(GL_DEPTH_TEST);
 
+  FlyCamera flyCamera;
+  cameraInit(&flyCamera, cameraStart, timeNow());
+  flyCamera.yaw = glm_rad(cameraStart[3]);
+  flyCamera.pitch = glm_clamp(glm_rad(cameraStart[4]), -1.5f, 1.5f);
+  mat4 view;
+  cameraView(&flyCamera, view);
+
+  mat4 projection;
+  glm_perspective(glm_rad(45.0f), 800.0f / 600.0f, 0.1f, 100.0f, projection);
+  mat4 cullView, cullProjection;
+  vec3 lastPosition;
+  glm_vec3_copy(flyCamera.position, lastPosition);
+  cameraCullView(&flyCamera, 0.0f, cullView, cullProjection);
+
+  LatencyTracker latency;
+  if (!latencyInit(&latency, latencyLog)) {
+    return 1;
+  }
+  FrameCapture *capture = NULL;
+  if (capturePattern && (capture = captureCreate(jobs, capturePattern)) == NULL) {
+    return 1;
+  }
+
+  FramePacket *frame = framePrepare(&pipeline, cullView, cullProjection, lodScale(window, projection));
+
+  unsigned long frameCount = 0;
+  double benchmarkStart = glfwGetTime();
+
+  FixedTimestep timestep;
+  timestepInit(&timestep, simulationRate, timeNow());
+  FramePacer pacer;
+  framePacerInit(&pacer, paceRate > 0.0 ? paceRate : 60.0, timeNow());
+  unsigned long long reportSteps = 0;
+  int wasPicking = 0;
+
   // The event loop
   while(!glfwWindowShouldClose(window))
     {
-      // input
+      if (paceRate > 0.0 && benchmarkFrames == 0) {
+        framePacerWait(&pacer);
+      }
+
+      // input, as late as possible before it is used: events now, for the
+      // simulation and culling, and the camera once more right before drawing
+      glfwPollEvents();
       processInput(window);
+      cameraLatch(&flyCamera, window, timeNow());
+      cameraView(&flyCamera, view);
+      // culling's view has to last until the late latch of the next frame:
+      // the last frame's travel, doubled for an uneven frame. A camera at
+      // rest culls exactly, and one that starts moving can show something
+      // at the edge a frame late.
+      cameraCullView(&flyCamera, 2.0f * glm_vec3_distance(flyCamera.position, lastPosition), cullView, cullProjection);
+      glm_vec3_copy(flyCamera.position, lastPosition);
+      int picking = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+      if (picking && !wasPicking) {
+        pickObject(window, view, projection, &bvh, &bounds);
+      }
+      wasPicking = picking;
+
+      unsigned int reloaded = shaderWatch ? shaderWatchPoll(shaderWatch) : 0;
+      if (reloaded) {
+        if (shaderProgram != cachedProgram) {
+          glDeleteProgram(shaderProgram);
+        }
+        shaderProgram = reloaded;
+        // the feedback pass must see the same edit; it is rebuilt here from
+        // the fresh sources, and keeps the old one if that fails
+        if (feedbackProgram) {
+          shaderCacheForgetSources(shaderCache);
+          unsigned int feedback = makeFeedbackProgram(shaderCache, vertexPath, fragmentPath, defines, defineCount, &material);
+          feedbackProgram = feedback ? feedback : feedbackProgram;
+        }
+        if (useShaderProgram(shaderProgram, &reflection, &materialLayout)) {
+          uniformLayoutApply(&materialLayout, &material);
+        }
+      }
+
+      frameWait(&pipeline, frame);
+
+      // Nothing reads the transforms or bounds between frameWait and
+      // framePrepare, so this is the place to move cubes: as many fixed steps
+      // as the time since the last frame makes up, then the frame is drawn
+      // part of the way from the next to last step to the last.
+      unsigned int steps = capture ? timestepTick(&timestep) : timestepAdvance(&timestep, timeNow());
+      for (unsigned int step = 0; step < steps; ++step) {
+        transformBeginStep(&transforms);
+        simulate(&transforms, &bounds, positions, drift, (double)(timestep.steps - steps + step + 1) * timestep.step);
+      }
+      if (drift && steps > 0) {
+        double refitStart = glfwGetTime();
+        bvhRefit(&bvh, &bounds);
+        refitTime += glfwGetTime() - refitStart;
+        refitFrames++;
+      }
+      transformSetAlpha(&transforms, timestepAlpha(&timestep));
+
+      // start on the next frame while this one is submitted
+      FramePacket *nextFrame = framePrepare(&pipeline, cullView, cullProjection, lodScale(window, projection));
+
+      // pages asked for by earlier feedback passes arrive as they load
+      if (virtualTextures) {
+        vtUpdate(virtualTextures);
+      }
+      if (textureManager) {
+        glActiveTexture(GL_TEXTURE0);
+        textureManagerFrame(textureManager);
+        const TexturePack *texturePack = textureManagerUse(textureManager, sceneTexture, NULL);
+        if (texturePack && texturePack->count > 0) {
+          glBindTexture(GL_TEXTURE_2D_ARRAY, texturePack->arrays[0].texture);
+        }
+      }
 
       // rendering
       glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-      mat4 view;
-      glm_mat4_identity(view);
-      glm_translate(view, (vec3){0.0f, 0.0f, -3.0f});
-      glUniformMatrix4fv(viewLoc, 1, GL_FALSE, (float *)view);
-
-      mat4 projection;
-      glm_perspective(glm_rad(45.0f), 800.0f / 600.0f, 0.1f, 100.0f, projection);
-      glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (float *)projection);
-
       //glBindVertexArray(VAO);
-      for (unsigned int i = 0; i < sizeof(cubePositions)/sizeof(cubePositions[0]); ++i) {
-        
-        // matrix operations
-        mat4 model;
-        glm_mat4_identity(model);
-        glm_translate(model, cubePositions[i]);
-        float angle = 20.0f * i; 
-        glm_rotate(model, glm_rad(angle), (vec3){1.0f, 0.3f, 0.5f});
-        //glm_rotate(model, (float)glfwGetTime(), (vec3){1.0f, 0.3f, 0.5f});
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, (float *)model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+      // late latch: the newest input goes straight into the camera block
+      glfwPollEvents();
+      double inputTime = timeNow();
+      cameraLatch(&flyCamera, window, inputTime);
+      cameraView(&flyCamera, view);
+      latencyInput(&latency, frameCount, inputTime);
+      double submitStart = glfwGetTime();
+      ringBufferBegin(&ring);
+      size_t cameraOffset, objectsOffset;
+      mat4 *camera = ringBufferAlloc(&ring, 2 * sizeof(mat4), uboAlignment, &cameraOffset);
+      unsigned char *objects = ringBufferAlloc(&ring, frame->drawCount * objectStride, uboAlignment, &objectsOffset);
+      if (camera && objects) {
+        glm_mat4_copy(view, camera[0]);
+        glm_mat4_copy(projection, camera[1]);
+        for (size_t v = 0; v < frame->drawCount; ++v) {
+          ObjectData *object = (ObjectData *)(objects + v * objectStride);
+          const GLint *layers = objectLayers[frame->drawList[v]];
+          memcpy(object->model, frame->instances[v], sizeof(mat4));
+          object->layers[0] = layers[0];
+          object->layers[1] = layers[1];
+          object->layers[2] = object->layers[3] = 0;
+        }
+      }
+      ringBufferCommit(&ring);
+
+      if (camera && objects) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, ring.buffer, cameraOffset, 2 * sizeof(mat4));
+        drawObjects(&mesh, useIndirect ? &indirect : NULL, ring.buffer, objectsOffset, objectStride, frame->levelCounts);
+
+        // the same draws again, small, to find out which pages they needed
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        if (virtualTextures && vtFeedbackBegin(virtualTextures, width, height)) {
+          glUseProgram(feedbackProgram);
+          drawObjects(&mesh, useIndirect ? &indirect : NULL, ring.buffer, objectsOffset, objectStride, frame->levelCounts);
+          glUseProgram(shaderProgram);
+          vtFeedbackEnd(virtualTextures, width, height);
+        }
+      }
+      latencySubmitted(&latency, timeNow());
+      submitTime += glfwGetTime() - submitStart;
+      submitFrames++;
+
+      if (glfwGetTime() - lastReport >= 1.0) {
+        printf("cubes: %zu drawn, %zu culled, submit %.3f ms/frame, %u frames, %llu steps\n", frame->drawCount,
+               bounds.count - frame->drawCount, submitTime * 1000.0 / submitFrames, submitFrames,
+               timestep.steps - reportSteps);
+        reportSteps = timestep.steps;
+        if (occlusionCulling) {
+          printf("occlusion: %zu cubes hidden behind %u occluders\n", frame->occludedCount, frame->occluderCount);
+        }
+        if (mesh.lodCount > 1) {
+          char levels[MESH_MAX_LODS * 12] = "";
+          size_t triangles = 0;
+          for (unsigned int level = 0; level < mesh.lodCount; ++level) {
+            triangles += frame->levelCounts[level] * mesh.lods[level].indexCount / 3;
+            snprintf(levels + strlen(levels), sizeof(levels) - strlen(levels), " %zu", frame->levelCounts[level]);
+          }
+          printf("lod: %zu triangles drawn, draws by level:%s\n", triangles, levels);
+        }
+        if (refitFrames > 0) {
+          printf("bvh: refit in %.3f ms/frame\n", refitTime * 1000.0 / refitFrames);
+          refitTime = 0.0;
+          refitFrames = 0;
+        }
+        if (textureManager) {
+          TextureManagerStats stats;
+          textureManagerStats(textureManager, &stats);
+          printf("textures: %zu/%zu KiB, %zu resident, %zu levels dropped, %zu loads, %zu reloads, %zu evictions\n",
+                 stats.used / 1024, stats.budget / 1024, stats.resident, stats.droppedLevels, stats.loads, stats.reloads,
+                 stats.evictions);
+        }
+        if (virtualTextures) {
+          VirtualTextureStats stats;
+          vtStats(virtualTextures, &stats);
+          printf("virtual textures: %zu/%zu pages resident, %zu loads, %zu evictions, %zu KiB on the GPU for %zu KiB of pages\n",
+                 stats.resident, stats.slots, stats.loads, stats.evictions, stats.cacheBytes / 1024, stats.virtualBytes / 1024);
+        }
+        if (capture) {
+          FrameCaptureStats stats;
+          captureStats(capture, &stats);
+          printf("capture: %zu frames read back, %zu written, %zu failed, %zu KiB, %zu stalls\n", stats.captured,
+                 stats.written, stats.failed, stats.bytes / 1024, stats.stalls);
+        }
+        LatencyStats lag;
+        latencyStats(&latency, &lag);
+        if (lag.frames > 0) {
+          printf("latency: input to GPU done %.2f ms on average, %.2f ms at worst\n", lag.average * 1000.0,
+                 lag.worst * 1000.0);
+        }
+        submitTime = 0.0;
+        submitFrames = 0;
+        lastReport = glfwGetTime();
       }
       
+      if (capture) {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        captureFrame(capture, frameCount, width, height);
+      }
+
       // swap buffers
       glfwSwapBuffers(window);
+      latencySwapped(&latency, timeNow());
 
-      // call events
-      glfwPollEvents();
+      frame = nextFrame;
+
+      if (++frameCount == benchmarkFrames) {
+        glFinish();
+        double elapsed = glfwGetTime() - benchmarkStart;
+        printf("benchmark: %lu frames in %.3f s, %.3f ms/frame\n", frameCount, elapsed, elapsed * 1000.0 / frameCount);
+        glfwSetWindowShouldClose(window, 1);
+      }
     }
 
   // Finish
+  shaderWatchStop(shaderWatch);
+  frameWait(&pipeline, frame);
+  framePipelineFree(&pipeline);
+  captureDestroy(capture);
+  latencyFree(&latency);
+  vtDestroy(virtualTextures);
+  jobSystemDestroy(jobs);
+  if (useIndirect) {
+    indirectBatchFree(&indirect);
+  }
+  ringBufferFree(&ring);
+  meshFree(&mesh);
+  free(positions);
+  free(objectLayers);
+  textureManagerDestroy(textureManager);
+  bvhFree(&bvh);
+  sphereSetFree(&bounds);
+  transformStoreFree(&transforms);
+  uniformLayoutFree(&materialLayout);
+  reflectionFree(&reflection);
+  if (shaderProgram != cachedProgram) {
+    glDeleteProgram(shaderProgram);
+  }
+  shaderCacheDestroy(shaderCache);
+  assetMount(NULL);
+  assetPackClose(assets);
   glfwTerminate();
 
   return 0;
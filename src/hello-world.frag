@@ -1,15 +1,48 @@
 #version 330 core
 
+#ifdef VT_FEEDBACK
+out uvec4 Feedback;
+#else
 out vec4 FragColor;
+#endif
 
 in vec2 TexCoord;
+flat in ivec2 Layers;
 
-uniform sampler2D texture1;
-uniform sampler2D texture2;
+#ifdef VIRTUAL_TEXTURE
+// Layers are images of the virtual texture set
+#include "vtex.glsl"
+#else
+// every image of the scene, one per layer
+uniform sampler2DArray textures;
+#endif
+
+// a constant lets the compiler fold the blend weights
+#ifndef MIX_FACTOR
+#define MIX_FACTOR 0.2
+#endif
 
 
 void main()
 {
-    FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
-    //FragColor = mix(texture(texture1, TexCoord), texture(texture2, vec2(1.0 - TexCoord.x, TexCoord.y)), 0.2);
+#ifdef MIRROR_FACE
+    vec2 overlay = vec2(1.0 - TexCoord.x, TexCoord.y);
+#else
+    vec2 overlay = TexCoord;
+#endif
+#if defined(VT_FEEDBACK)
+    // the images share a size, so one level serves both; each pixel reports
+    // one of them, alternating in a checkerboard
+    int level = vtLevel(TexCoord);
+    if (((int(gl_FragCoord.x) + int(gl_FragCoord.y)) & 1) == 0) {
+        Feedback = vtFeedback(TexCoord, Layers.x, level);
+    } else {
+        Feedback = vtFeedback(overlay, Layers.y, level);
+    }
+#elif defined(VIRTUAL_TEXTURE)
+    int level = vtLevel(TexCoord);
+    FragColor = mix(vtSample(TexCoord, Layers.x, level), vtSample(overlay, Layers.y, level), MIX_FACTOR);
+#else
+    FragColor = mix(texture(textures, vec3(TexCoord, Layers.x)), texture(textures, vec3(overlay, Layers.y)), MIX_FACTOR);
+#endif
 }
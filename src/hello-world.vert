@@ -1,17 +1,37 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
+#ifdef INDIRECT
+// per-draw model matrix and texture layers, picked by the draw's base instance
+layout (location = 2) in mat4 aModel;
+layout (location = 6) in ivec4 aLayers;
+#endif
 
 
 out vec2 TexCoord;
+// texture array layers of the base and overlay images
+flat out ivec2 Layers;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifndef INDIRECT
+layout (std140) uniform Object
+{
+    mat4 model;
+    ivec4 layers;
+};
+#endif
+#include "camera.glsl"
+// undo the mesh's position quantization, see mesh.h
+uniform vec3 positionScale;
+uniform vec3 positionBias;
 
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef INDIRECT
+    mat4 model = aModel;
+    ivec4 layers = aLayers;
+#endif
+    gl_Position = projection * view * model * vec4(aPos * positionScale + positionBias, 1.0);
     TexCoord = aTexCoord;
+    Layers = layers.xy;
 }
@@ -0,0 +1,44 @@
+#include "imagediff.h"
+
+#include <stdlib.h>
+
+int imageCompare(const unsigned char *expected, const unsigned char *actual, int width, int height, int channels,
+                 const ImageTolerance *tolerance, ImageDifference *difference, unsigned char *diff) {
+  size_t pixels = (size_t)width * height;
+  size_t differing = 0;
+  int maxDelta = 0;
+  double totalDelta = 0.0;
+  for (size_t i = 0; i < pixels; ++i) {
+    const unsigned char *e = expected + i * channels, *a = actual + i * channels;
+    int delta = 0;
+    for (int c = 0; c < channels; ++c) {
+      int d = abs(e[c] - a[c]);
+      delta = d > delta ? d : delta;
+    }
+    totalDelta += delta;
+    maxDelta = delta > maxDelta ? delta : maxDelta;
+    int over = delta > tolerance->threshold;
+    differing += over;
+    if (diff) {
+      unsigned char *out = diff + i * 3;
+      int grey = channels >= 3 ? (e[0] * 77 + e[1] * 150 + e[2] * 29) >> 8 : e[0];
+      grey /= 3;
+      if (over) {
+        out[0] = (unsigned char)(128 + delta / 2);
+        out[1] = out[2] = 0;
+      } else if (delta > 0) {
+        out[0] = out[1] = (unsigned char)(96 + delta * 159 / 255);
+        out[2] = 0;
+      } else {
+        out[0] = out[1] = out[2] = (unsigned char)grey;
+      }
+    }
+  }
+  if (difference) {
+    difference->pixels = pixels;
+    difference->differing = differing;
+    difference->maxDelta = maxDelta;
+    difference->meanDelta = pixels ? totalDelta / pixels : 0.0;
+  }
+  return (double)differing <= tolerance->maxDiffering * (double)pixels;
+}
@@ -0,0 +1,29 @@
+#ifndef IMAGEDIFF_H
+#define IMAGEDIFF_H
+
+#include <stddef.h>
+
+// Compares a rendered image with a reference, tolerating what differs from
+// one GL implementation or driver version to the next: a pixel only counts
+// as different when a channel is off by more than `threshold`, and images
+// only differ when more than `maxDiffering` of their pixels do.
+typedef struct {
+  int threshold;       // 0 to 255
+  double maxDiffering; // fraction of the pixels, 0 to 1
+} ImageTolerance;
+
+typedef struct {
+  size_t pixels;
+  size_t differing; // pixels over the threshold
+  int maxDelta;     // largest channel difference anywhere
+  double meanDelta; // of the largest channel difference of each pixel
+} ImageDifference;
+
+// Compares two width x height images of `channels` bytes a pixel, packed.
+// Returns 1 if they match within `tolerance`. `diff` may be NULL, or take
+// width x height RGB pixels: the reference dimmed to grey, with pixels
+// that differ in yellow, and those over the threshold in red.
+int imageCompare(const unsigned char *expected, const unsigned char *actual, int width, int height, int channels,
+                 const ImageTolerance *tolerance, ImageDifference *difference, unsigned char *diff);
+
+#endif
@@ -0,0 +1,104 @@
+#include "indirect.h"
+
+#include <stdlib.h>
+
+int indirectSupported(void) {
+  return GLAD_GL_ARB_draw_indirect && GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance;
+}
+
+static size_t commandSize(const IndirectBatch *batch) {
+  return batch->indexType ? sizeof(DrawElementsIndirectCommand) : sizeof(DrawArraysIndirectCommand);
+}
+
+int indirectBatchInit(IndirectBatch *batch, size_t capacity, GLenum indexType, const IndirectRange *ranges,
+                      size_t rangeCount, GLuint modelAttrib, GLint dataAttrib, GLsizei stride) {
+  if (rangeCount == 0 || rangeCount > INDIRECT_MAX_RANGES) {
+    return 0;
+  }
+  batch->capacity = capacity;
+  batch->stride = stride;
+  batch->indexType = indexType;
+  batch->rangeCount = rangeCount;
+
+  // Every frame draws slices of the same commands: draw i is always one
+  // instance with base instance i, and range r has a command for every i,
+  // from r * capacity on. Only the counts and the instance data change, so
+  // the commands are written once.
+  size_t size = commandSize(batch);
+  void *commands = malloc(rangeCount * capacity * size);
+  if (commands == NULL) {
+    return 0;
+  }
+  for (size_t r = 0; r < rangeCount; ++r) {
+    for (size_t i = 0; i < capacity; ++i) {
+      size_t c = r * capacity + i;
+      if (indexType) {
+        ((DrawElementsIndirectCommand *)commands)[c] =
+          (DrawElementsIndirectCommand){ranges[r].count, 1, ranges[r].first, 0, (GLuint)i};
+      } else {
+        ((DrawArraysIndirectCommand *)commands)[c] =
+          (DrawArraysIndirectCommand){ranges[r].count, 1, ranges[r].first, (GLuint)i};
+      }
+    }
+  }
+  glGenBuffers(1, &batch->commandBuffer);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch->commandBuffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, rangeCount * capacity * size, commands, GL_STATIC_DRAW);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  free(commands);
+
+  // a mat4 attribute takes four consecutive locations, one per column; the
+  // pointers are set by indirectBatchDraw since the data moves every frame
+  batch->modelAttrib = modelAttrib;
+  for (GLuint column = 0; column < 4; ++column) {
+    glEnableVertexAttribArray(modelAttrib + column);
+    glVertexAttribDivisor(modelAttrib + column, 1);
+  }
+  batch->dataAttrib = dataAttrib;
+  if (dataAttrib != -1) {
+    glEnableVertexAttribArray(dataAttrib);
+    glVertexAttribDivisor(dataAttrib, 1);
+  }
+  return 1;
+}
+
+void indirectBatchFree(IndirectBatch *batch) {
+  glDeleteBuffers(1, &batch->commandBuffer);
+  batch->commandBuffer = 0;
+}
+
+void indirectBatchDraw(IndirectBatch *batch, unsigned int buffer, size_t offset, const size_t *counts) {
+  size_t total = 0;
+  for (size_t r = 0; r < batch->rangeCount; ++r) {
+    total += counts[r];
+  }
+  if (total == 0) {
+    return;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  for (GLuint column = 0; column < 4; ++column) {
+    glVertexAttribPointer(batch->modelAttrib + column, 4, GL_FLOAT, GL_FALSE, batch->stride, (void*)(offset + column * sizeof(vec4)));
+  }
+  if (batch->dataAttrib != -1) {
+    // the I variant keeps the ints as ints
+    glVertexAttribIPointer(batch->dataAttrib, 4, GL_INT, batch->stride, (void*)(offset + sizeof(mat4)));
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, batch->commandBuffer);
+  size_t first = 0;
+  for (size_t r = 0; r < batch->rangeCount && first < batch->capacity; ++r) {
+    // past the capacity there are no commands; the last draws are dropped
+    size_t count = counts[r] < batch->capacity - first ? counts[r] : batch->capacity - first;
+    if (count > 0) {
+      void *commands = (void*)((r * batch->capacity + first) * commandSize(batch));
+      if (batch->indexType) {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, batch->indexType, commands, (GLsizei)count, 0);
+      } else {
+        glMultiDrawArraysIndirect(GL_TRIANGLES, commands, (GLsizei)count, 0);
+      }
+    }
+    first += count;
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
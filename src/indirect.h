@@ -0,0 +1,68 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+#include <cglm/cglm.h>
+
+// Command layouts read by glMultiDrawArraysIndirect / glMultiDrawElementsIndirect.
+typedef struct {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint first;
+  GLuint baseInstance;
+} DrawArraysIndirectCommand;
+
+typedef struct {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+} DrawElementsIndirectCommand;
+
+// A range of vertices, or of indices, that a draw can use.
+typedef struct {
+  GLuint first;
+  GLuint count;
+} IndirectRange;
+
+#define INDIRECT_MAX_RANGES 8
+
+// Draws up to `capacity` objects, each with one of a few vertex or index
+// ranges (say, levels of detail of one mesh), with one
+// glMultiDrawArraysIndirect or glMultiDrawElementsIndirect call per range.
+// Draw i uses base instance i, so instanced attributes hand each draw its
+// own model matrix and, optionally, four ints of per-draw data such as
+// texture layers.
+typedef struct {
+  unsigned int commandBuffer;
+  GLuint modelAttrib;
+  GLint dataAttrib;
+  GLsizei stride;
+  size_t capacity;
+  GLenum indexType; // 0 to draw arrays
+  size_t rangeCount;
+} IndirectBatch;
+
+// True when the driver can source multi-draws from a GL_DRAW_INDIRECT_BUFFER
+// and honours baseInstance; otherwise draw one object at a time.
+int indirectSupported(void);
+
+// Writes the command buffer and, on the currently bound VAO, turns
+// attributes modelAttrib .. modelAttrib + 3 into a per-instance mat4. With
+// an `indexType`, the ranges are of the VAO's element buffer; with 0, of
+// its vertices. There can be up to INDIRECT_MAX_RANGES.
+// Each instance takes `stride` bytes: the matrix, followed by an ivec4 read
+// by attribute `dataAttrib` unless that is -1.
+int indirectBatchInit(IndirectBatch *batch, size_t capacity, GLenum indexType, const IndirectRange *ranges,
+                      size_t rangeCount, GLuint modelAttrib, GLint dataAttrib, GLsizei stride);
+void indirectBatchFree(IndirectBatch *batch);
+
+// Draw objects whose instance data is packed at `offset` in `buffer`,
+// grouped by range: the first counts[0] use range 0, the next counts[1]
+// range 1, and so on for every range. Draws past the capacity are left out,
+// from the last range back. The VAO that was bound at init must be bound.
+void indirectBatchDraw(IndirectBatch *batch, unsigned int buffer, size_t offset, const size_t *counts);
+
+#endif
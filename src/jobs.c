@@ -0,0 +1,225 @@
+#include "jobs.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+  JobFunc fn;
+  void *data;
+  JobCounter *counter;
+} Job;
+
+// Ring buffer deque; the owner works at the tail, thieves take from the head.
+typedef struct {
+  pthread_mutex_t lock;
+  Job *jobs;
+  size_t head;
+  size_t count;
+  size_t capacity;
+} JobQueue;
+
+struct JobSystem {
+  unsigned int workerCount;
+  pthread_t *threads;
+  // workerCount + 1 queues, the last one belongs to the creating thread
+  JobQueue *queues;
+  pthread_mutex_t sleepLock;
+  pthread_cond_t wake;
+  atomic_int queued;
+  atomic_int quit;
+};
+
+typedef struct {
+  JobSystem *jobs;
+  unsigned int index;
+} WorkerArgs;
+
+// queue index of the current thread; threads outside the pool push to the
+// creating thread's queue
+static _Thread_local int threadSlot = -1;
+
+static int queuePush(JobQueue *q, Job job) {
+  pthread_mutex_lock(&q->lock);
+  if (q->count == q->capacity) {
+    size_t capacity = q->capacity ? q->capacity * 2 : 64;
+    Job *jobs = malloc(capacity * sizeof(Job));
+    if (jobs == NULL) {
+      pthread_mutex_unlock(&q->lock);
+      return 0;
+    }
+    for (size_t i = 0; i < q->count; ++i) {
+      jobs[i] = q->jobs[(q->head + i) % q->capacity];
+    }
+    free(q->jobs);
+    q->jobs = jobs;
+    q->head = 0;
+    q->capacity = capacity;
+  }
+  q->jobs[(q->head + q->count) % q->capacity] = job;
+  q->count++;
+  pthread_mutex_unlock(&q->lock);
+  return 1;
+}
+
+static int queuePop(JobQueue *q, Job *job, int steal) {
+  int found = 0;
+  pthread_mutex_lock(&q->lock);
+  if (q->count > 0) {
+    if (steal) {
+      *job = q->jobs[q->head];
+      q->head = (q->head + 1) % q->capacity;
+    } else {
+      *job = q->jobs[(q->head + q->count - 1) % q->capacity];
+    }
+    q->count--;
+    found = 1;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return found;
+}
+
+// Pop from our own queue, otherwise steal from the others, starting with our
+// neighbour so that thieves spread out.
+static int findJob(JobSystem *jobs, unsigned int slot, Job *job) {
+  unsigned int n = jobs->workerCount + 1;
+  if (queuePop(&jobs->queues[slot], job, 0)) {
+    return 1;
+  }
+  for (unsigned int i = 1; i < n; ++i) {
+    if (queuePop(&jobs->queues[(slot + i) % n], job, 1)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void runJob(JobSystem *jobs, Job *job, unsigned int slot) {
+  atomic_fetch_sub(&jobs->queued, 1);
+  job->fn(job->data, slot);
+  if (job->counter) {
+    atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+  }
+}
+
+static void *workerMain(void *arg) {
+  WorkerArgs args = *(WorkerArgs *)arg;
+  free(arg);
+  JobSystem *jobs = args.jobs;
+  threadSlot = (int)args.index;
+  while (!atomic_load(&jobs->quit)) {
+    Job job;
+    if (findJob(jobs, args.index, &job)) {
+      runJob(jobs, &job, args.index);
+      continue;
+    }
+    pthread_mutex_lock(&jobs->sleepLock);
+    while (atomic_load(&jobs->queued) == 0 && !atomic_load(&jobs->quit)) {
+      pthread_cond_wait(&jobs->wake, &jobs->sleepLock);
+    }
+    pthread_mutex_unlock(&jobs->sleepLock);
+  }
+  return NULL;
+}
+
+// Stops and joins the first `started` workers and frees everything.
+static void shutDown(JobSystem *jobs, unsigned int started) {
+  pthread_mutex_lock(&jobs->sleepLock);
+  atomic_store(&jobs->quit, 1);
+  pthread_cond_broadcast(&jobs->wake);
+  pthread_mutex_unlock(&jobs->sleepLock);
+  for (unsigned int i = 0; i < started; ++i) {
+    pthread_join(jobs->threads[i], NULL);
+  }
+  for (unsigned int i = 0; i <= jobs->workerCount; ++i) {
+    pthread_mutex_destroy(&jobs->queues[i].lock);
+    free(jobs->queues[i].jobs);
+  }
+  pthread_mutex_destroy(&jobs->sleepLock);
+  pthread_cond_destroy(&jobs->wake);
+  free(jobs->threads);
+  free(jobs->queues);
+  free(jobs);
+}
+
+JobSystem *jobSystemCreate(unsigned int workers) {
+  if (workers == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cores > 1 ? (unsigned int)cores - 1 : 1;
+  }
+  JobSystem *jobs = calloc(1, sizeof(JobSystem));
+  if (jobs == NULL) {
+    return NULL;
+  }
+  jobs->workerCount = workers;
+  jobs->threads = calloc(workers, sizeof(pthread_t));
+  jobs->queues = calloc(workers + 1, sizeof(JobQueue));
+  if (jobs->threads == NULL || jobs->queues == NULL) {
+    free(jobs->threads);
+    free(jobs->queues);
+    free(jobs);
+    return NULL;
+  }
+  for (unsigned int i = 0; i <= workers; ++i) {
+    pthread_mutex_init(&jobs->queues[i].lock, NULL);
+  }
+  pthread_mutex_init(&jobs->sleepLock, NULL);
+  pthread_cond_init(&jobs->wake, NULL);
+  threadSlot = (int)workers;
+  for (unsigned int i = 0; i < workers; ++i) {
+    WorkerArgs *args = malloc(sizeof(WorkerArgs));
+    if (args) {
+      args->jobs = jobs;
+      args->index = i;
+    }
+    // a worker short, jobWait would wait for jobs queued to nobody
+    if (args == NULL || pthread_create(&jobs->threads[i], NULL, workerMain, args) != 0) {
+      free(args);
+      threadSlot = -1;
+      shutDown(jobs, i);
+      return NULL;
+    }
+  }
+  return jobs;
+}
+
+void jobSystemDestroy(JobSystem *jobs) {
+  if (jobs == NULL) {
+    return;
+  }
+  shutDown(jobs, jobs->workerCount);
+}
+
+unsigned int jobThreadCount(const JobSystem *jobs) {
+  return jobs->workerCount + 1;
+}
+
+void jobSubmit(JobSystem *jobs, JobFunc fn, void *data, JobCounter *counter) {
+  unsigned int slot = threadSlot >= 0 ? (unsigned int)threadSlot : jobs->workerCount;
+  Job job = {fn, data, counter};
+  if (counter) {
+    atomic_fetch_add(&counter->pending, 1);
+  }
+  atomic_fetch_add(&jobs->queued, 1);
+  if (!queuePush(&jobs->queues[slot], job)) {
+    // out of memory: run it right here rather than losing it
+    runJob(jobs, &job, slot);
+    return;
+  }
+  pthread_mutex_lock(&jobs->sleepLock);
+  pthread_cond_signal(&jobs->wake);
+  pthread_mutex_unlock(&jobs->sleepLock);
+}
+
+void jobWait(JobSystem *jobs, JobCounter *counter) {
+  unsigned int slot = threadSlot >= 0 ? (unsigned int)threadSlot : jobs->workerCount;
+  while (atomic_load_explicit(&counter->pending, memory_order_acquire) > 0) {
+    Job job;
+    if (findJob(jobs, slot, &job)) {
+      runJob(jobs, &job, slot);
+    } else {
+      sched_yield();
+    }
+  }
+}
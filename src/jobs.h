@@ -0,0 +1,36 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// A fixed pool of worker threads, each with its own job deque. Workers pop
+// their own newest job first and steal the oldest job from another deque when
+// theirs runs dry. The thread that creates the system gets a deque too, and
+// helps execute jobs while it waits on a counter.
+
+// `thread` is the index of the executing thread, in [0, jobThreadCount()), and
+// is meant for indexing per-thread scratch buffers.
+typedef void (*JobFunc)(void *data, unsigned int thread);
+
+// Incremented on submit and decremented when the job finishes.
+typedef struct {
+  atomic_int pending;
+} JobCounter;
+
+typedef struct JobSystem JobSystem;
+
+// workers == 0 uses one worker per core except the calling thread's.
+// Returns NULL if memory runs out or a worker cannot be started.
+JobSystem *jobSystemCreate(unsigned int workers);
+void jobSystemDestroy(JobSystem *jobs);
+
+// Number of threads that may execute jobs, including the creating thread.
+unsigned int jobThreadCount(const JobSystem *jobs);
+
+void jobSubmit(JobSystem *jobs, JobFunc fn, void *data, JobCounter *counter);
+
+// Returns once counter->pending drops to zero, running jobs in the meantime.
+void jobWait(JobSystem *jobs, JobCounter *counter);
+
+#endif
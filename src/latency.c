@@ -0,0 +1,99 @@
+#include "latency.h"
+
+#include <string.h>
+
+#include "timestep.h"
+
+static void calibrate(LatencyTracker *tracker) {
+  GLint64 gpu = 0;
+  glGetInteger64v(GL_TIMESTAMP, &gpu);
+  tracker->gpuOffset = timeNow() - (double)gpu * 1e-9;
+}
+
+int latencyInit(LatencyTracker *tracker, const char *logPath) {
+  memset(tracker, 0, sizeof(*tracker));
+  if (logPath) {
+    tracker->log = fopen(logPath, "w");
+    if (tracker->log == NULL) {
+      perror(logPath);
+      return 0;
+    }
+    fprintf(tracker->log, "frame,input,submitted,swapped,finished,input_to_submit_ms,input_to_swap_ms,input_to_gpu_ms\n");
+  }
+  glGenQueries(LATENCY_FRAMES, tracker->queries);
+  tracker->start = timeNow();
+  calibrate(tracker);
+  return 1;
+}
+
+void latencyFree(LatencyTracker *tracker) {
+  glDeleteQueries(LATENCY_FRAMES, tracker->queries);
+  if (tracker->log) {
+    fclose(tracker->log);
+  }
+  memset(tracker, 0, sizeof(*tracker));
+}
+
+void latencyInput(LatencyTracker *tracker, unsigned long frame, double now) {
+  LatencySample *sample = &tracker->samples[tracker->head];
+  memset(sample, 0, sizeof(*sample));
+  sample->frame = frame;
+  sample->input = now;
+}
+
+void latencySubmitted(LatencyTracker *tracker, double now) {
+  tracker->samples[tracker->head].submitted = now;
+  glQueryCounter(tracker->queries[tracker->head], GL_TIMESTAMP);
+}
+
+// Finishes the oldest pending frame; `wait` blocks for its result.
+static int collect(LatencyTracker *tracker, int wait) {
+  unsigned int oldest = (tracker->head + LATENCY_FRAMES - tracker->pending) % LATENCY_FRAMES;
+  GLuint query = tracker->queries[oldest];
+  GLint available = 0;
+  glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available && !wait) {
+    return 0;
+  }
+  GLuint64 gpu = 0;
+  glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpu);
+  tracker->pending--;
+
+  LatencySample *sample = &tracker->samples[oldest];
+  sample->finished = (double)gpu * 1e-9 + tracker->gpuOffset;
+  double latency = sample->finished - sample->input;
+  tracker->count++;
+  tracker->total += latency;
+  if (latency > tracker->worst) {
+    tracker->worst = latency;
+  }
+  if (tracker->log) {
+    fprintf(tracker->log, "%lu,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f,%.3f\n", sample->frame, sample->input - tracker->start,
+            sample->submitted - tracker->start, sample->swapped - tracker->start, sample->finished - tracker->start,
+            (sample->submitted - sample->input) * 1000.0, (sample->swapped - sample->input) * 1000.0, latency * 1000.0);
+  }
+  return 1;
+}
+
+void latencySwapped(LatencyTracker *tracker, double now) {
+  tracker->samples[tracker->head].swapped = now;
+  tracker->head = (tracker->head + 1) % LATENCY_FRAMES;
+  tracker->pending++;
+  // the next frame reuses the oldest query, so that one has to be done
+  if (tracker->pending == LATENCY_FRAMES) {
+    collect(tracker, 1);
+  }
+  while (tracker->pending > 0 && collect(tracker, 0)) {
+  }
+}
+
+void latencyStats(LatencyTracker *tracker, LatencyStats *stats) {
+  stats->frames = tracker->count;
+  stats->average = tracker->count ? tracker->total / tracker->count : 0.0;
+  stats->worst = tracker->worst;
+  tracker->count = 0;
+  tracker->total = 0.0;
+  tracker->worst = 0.0;
+  // the clocks drift apart slowly; take them together again now and then
+  calibrate(tracker);
+}
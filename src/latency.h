@@ -0,0 +1,57 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <glad/glad.h>
+
+// frames whose GPU timestamps may be outstanding at once
+#define LATENCY_FRAMES 4
+
+// Follows each frame from the moment its input was read to the moment the
+// GPU finished drawing it, which a timestamp query placed just before the
+// swap tells without stalling: results are collected frames later, once
+// available. GPU time is mapped onto timeNow (timestep.h) by sampling both
+// clocks together. With vsync, scanout adds up to a refresh on top.
+typedef struct {
+  unsigned long frame;
+  double input;     // input read for the camera
+  double submitted; // last draw issued
+  double swapped;   // glfwSwapBuffers returned
+  double finished;  // GPU done
+} LatencySample;
+
+typedef struct {
+  unsigned int frames;
+  double average; // input to GPU done, seconds
+  double worst;
+} LatencyStats;
+
+typedef struct {
+  GLuint queries[LATENCY_FRAMES];
+  LatencySample samples[LATENCY_FRAMES];
+  unsigned int head;
+  unsigned int pending;
+  double gpuOffset; // add to GPU seconds for timeNow
+  double start;
+  FILE *log;
+  // finished frames since the last latencyStats
+  unsigned int count;
+  double total;
+  double worst;
+} LatencyTracker;
+
+// With `logPath`, every frame is written there as a line of CSV.
+int latencyInit(LatencyTracker *tracker, const char *logPath);
+void latencyFree(LatencyTracker *tracker);
+
+// The three points of a frame, in order, each with the time it happened.
+void latencyInput(LatencyTracker *tracker, unsigned long frame, double now);
+// Also places the timestamp query; call after the frame's last draw.
+void latencySubmitted(LatencyTracker *tracker, double now);
+// Also collects the frames the GPU has finished since.
+void latencySwapped(LatencyTracker *tracker, double now);
+
+// Frames finished since the last call.
+void latencyStats(LatencyTracker *tracker, LatencyStats *stats);
+
+#endif
@@ -0,0 +1,49 @@
+#include "lod.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "simplify.h"
+
+int lodBuildChain(MeshData *mesh) {
+  // each level carries on from the one before; the simplifier keeps the
+  // planes of the full mesh, so errors are measured against it throughout
+  Simplifier *simplifier = simplifierCreate(mesh->vertices, mesh->vertexCount, mesh->indices, mesh->lods[0].indexCount);
+  if (simplifier == NULL) {
+    return 0;
+  }
+  float maxError = mesh->radius * LOD_MAX_ERROR;
+  int ok = 1;
+  while (ok && mesh->lodCount < MESH_MAX_LODS) {
+    const MeshLod *previous = &mesh->lods[mesh->lodCount - 1];
+    if (previous->indexCount / 3 < 2 * LOD_MIN_TRIANGLES) {
+      break;
+    }
+    float error;
+    size_t count = simplifierRun(simplifier, previous->indexCount / 6 * 3, maxError, &error);
+    // stuck on locked vertices or the error limit: not worth a level
+    if (count > previous->indexCount - previous->indexCount / 4) {
+      break;
+    }
+    uint32_t *indices = realloc(mesh->indices, ((size_t)mesh->indexCount + count) * sizeof(uint32_t));
+    ok = indices != NULL;
+    if (ok) {
+      memcpy(indices + mesh->indexCount, simplifierIndices(simplifier), count * sizeof(uint32_t));
+      mesh->indices = indices;
+      mesh->lods[mesh->lodCount++] = (MeshLod){mesh->indexCount, (uint32_t)count, error};
+      mesh->indexCount += (uint32_t)count;
+    }
+  }
+  simplifierDestroy(simplifier);
+  return ok;
+}
+
+unsigned int lodSelect(const MeshLod *lods, unsigned int lodCount, float pixelsPerUnit, unsigned int current) {
+  for (unsigned int level = lodCount; level-- > 1;) {
+    float margin = level > current ? 1.0f - LOD_HYSTERESIS : 1.0f + LOD_HYSTERESIS;
+    if (lods[level].error * pixelsPerUnit <= LOD_PIXEL_ERROR * margin) {
+      return level;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "meshfile.h"
+
+// Levels of detail: a mesh carries a chain of ever coarser simplifications
+// of itself (simplify.h), each with half the triangles of the one before,
+// and each object draws the coarsest level whose error would cover no more
+// than LOD_PIXEL_ERROR pixels on screen.
+#define LOD_PIXEL_ERROR 1.0f
+// a level must beat the threshold by this fraction before an object drops
+// to it, and miss it by as much before the object leaves it, so that one
+// sitting on a boundary does not flicker between two
+#define LOD_HYSTERESIS 0.25f
+// levels stop before this many triangles, or before erring by this fraction
+// of the mesh's radius
+#define LOD_MIN_TRIANGLES 64
+#define LOD_MAX_ERROR 0.05f
+
+// Appends the coarser levels to the indices of `mesh`, which holds just the
+// full level and has its bounds set. Returns 0 if memory ran out.
+int lodBuildChain(MeshData *mesh);
+
+// The level to draw an object at, where one model unit at its distance
+// covers `pixelsPerUnit` pixels, given that it was drawn at `current`.
+unsigned int lodSelect(const MeshLod *lods, unsigned int lodCount, float pixelsPerUnit, unsigned int current);
+
+#endif
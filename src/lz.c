@@ -0,0 +1,159 @@
+#include "lz.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_MATCH 4
+#define HASH_BITS 16
+#define MAX_OFFSET 65535
+// the format wants the last 5 bytes to be literals, and no match to start
+// in the last 12
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+
+static uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+size_t lzCompressBound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+// Lengths of 15 and over continue in bytes of 255, ended by one below 255.
+static unsigned char *writeLength(unsigned char *op, size_t length) {
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+  *op++ = (unsigned char)length;
+  return op;
+}
+
+// Appends one sequence: `literals` bytes from `anchor`, then a match of
+// `matchLength` bytes at `offset`, if matchLength is not 0.
+static unsigned char *writeSequence(unsigned char *op, unsigned char *opEnd, const unsigned char *anchor,
+                                    size_t literals, size_t offset, size_t matchLength) {
+  if ((size_t)(opEnd - op) < 1 + literals / 255 + 1 + literals + 2 + matchLength / 255 + 1) {
+    return NULL;
+  }
+  unsigned char *token = op++;
+  *token = (unsigned char)((literals >= 15 ? 15 : literals) << 4);
+  if (literals >= 15) {
+    op = writeLength(op, literals - 15);
+  }
+  memcpy(op, anchor, literals);
+  op += literals;
+  if (matchLength == 0) {
+    return op;
+  }
+  *op++ = (unsigned char)(offset & 255);
+  *op++ = (unsigned char)(offset >> 8);
+  size_t length = matchLength - MIN_MATCH;
+  *token |= (unsigned char)(length >= 15 ? 15 : length);
+  if (length >= 15) {
+    op = writeLength(op, length - 15);
+  }
+  return op;
+}
+
+size_t lzCompress(const void *src, size_t size, void *dst, size_t capacity) {
+  const unsigned char *base = src, *ip = src, *anchor = src, *end = base + size;
+  unsigned char *op = dst, *opEnd = op + capacity;
+  // positions of the last 4 bytes seen with each hash
+  uint32_t *table = calloc((size_t)1 << HASH_BITS, sizeof(uint32_t));
+  if (table == NULL) {
+    return 0;
+  }
+
+  if (size > MATCH_LIMIT) {
+    const unsigned char *matchLimit = end - MATCH_LIMIT;
+    while (ip < matchLimit) {
+      uint32_t h = hash4(read32(ip));
+      const unsigned char *match = base + table[h];
+      table[h] = (uint32_t)(ip - base);
+      if (match >= ip || ip - match > MAX_OFFSET || read32(match) != read32(ip)) {
+        // skip faster through data that does not compress
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      const unsigned char *matchEnd = ip + MIN_MATCH, *m = match + MIN_MATCH;
+      while (matchEnd < end - LAST_LITERALS && *matchEnd == *m) {
+        matchEnd++;
+        m++;
+      }
+      op = writeSequence(op, opEnd, anchor, (size_t)(ip - anchor), (size_t)(ip - match), (size_t)(matchEnd - ip));
+      if (op == NULL) {
+        free(table);
+        return 0;
+      }
+      ip = anchor = matchEnd;
+    }
+  }
+  free(table);
+
+  op = writeSequence(op, opEnd, anchor, (size_t)(end - anchor), 0, 0);
+  return op ? (size_t)(op - (unsigned char *)dst) : 0;
+}
+
+// Reads the extra bytes of a length that filled its nibble.
+static int readLength(const unsigned char **ip, const unsigned char *end, size_t *length) {
+  unsigned char byte;
+  do {
+    if (*ip >= end) {
+      return 0;
+    }
+    byte = *(*ip)++;
+    *length += byte;
+  } while (byte == 255);
+  return 1;
+}
+
+int lzDecompress(const void *src, size_t srcSize, void *dst, size_t size) {
+  const unsigned char *ip = src, *end = ip + srcSize;
+  unsigned char *op = dst, *opEnd = op + size;
+  while (ip < end) {
+    unsigned token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !readLength(&ip, end, &literals)) {
+      return 0;
+    }
+    if (literals > (size_t)(end - ip) || literals > (size_t)(opEnd - op)) {
+      return 0;
+    }
+    memcpy(op, ip, literals);
+    op += literals;
+    ip += literals;
+    if (ip == end) {
+      // the last sequence has no match
+      break;
+    }
+
+    if (end - ip < 2) {
+      return 0;
+    }
+    size_t offset = ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    size_t length = token & 15;
+    if (length == 15 && !readLength(&ip, end, &length)) {
+      return 0;
+    }
+    length += MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - (unsigned char *)dst) || length > (size_t)(opEnd - op)) {
+      return 0;
+    }
+    // byte by byte, since a match may overlap what it writes
+    const unsigned char *match = op - offset;
+    for (size_t i = 0; i < length; ++i) {
+      op[i] = match[i];
+    }
+    op += length;
+  }
+  return op == opEnd;
+}
@@ -0,0 +1,24 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+
+// The LZ4 block format, without the frame format around it. Decoding is a
+// loop of literal runs and back references, so it runs close to memcpy
+// speed, which is what matters for data packed once and loaded many times.
+
+// Largest compressed size of `size` bytes, for sizing the output.
+size_t lzCompressBound(size_t size);
+
+// Greedy, single probe matching. Returns the compressed size, or 0 if it
+// would not fit in `capacity`.
+size_t lzCompress(const void *src, size_t size, void *dst, size_t capacity);
+
+// No LZ4 block expands to more than this many times its size: a run of
+// 255 length bytes adds 255 bytes of output for each one read.
+#define LZ_MAX_RATIO 255
+
+// Returns 1 if `src` decodes to exactly `size` bytes, 0 if it is malformed.
+int lzDecompress(const void *src, size_t srcSize, void *dst, size_t size);
+
+#endif
@@ -0,0 +1,181 @@
+#include "mesh.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include "assetpack.h"
+#include "hash.h"
+#include "lod.h"
+#include "meshfile.h"
+#include "obj.h"
+
+// Where the parsed mesh is kept: keyed by everything that changes it.
+static int cachePath(const char *cacheDir, const char *path, char *cached) {
+  struct stat st;
+  if (cacheDir == NULL || stat(path, &st) != 0) {
+    return 0;
+  }
+  uint64_t key = hashString(HASH_SEED, path);
+  int64_t stamp[3] = {(int64_t)st.st_size, (int64_t)st.st_mtime, MESH_FILE_VERSION};
+  key = hashBytes(key, stamp, sizeof(stamp));
+  snprintf(cached, MAXPATHLEN, "%s/%016llx.lmsh", cacheDir, (unsigned long long)key);
+  return 1;
+}
+
+// Unpacks the full level to float positions, keeping only the vertices it
+// uses, for the CPU occlusion buffer. A coarser level would be cheaper to
+// draw, but simplification moves vertices to where the error is least,
+// which can be outside the surface, and an occluder that sticks out hides
+// objects that are in view.
+static int buildOccluder(OccluderMesh *occluder, const MeshFileHeader *header, const void *vertices,
+                         const void *indices, uint32_t indexSize, uint32_t stride) {
+  const MeshLod *lod = &header->lods[0];
+  uint32_t *remap = malloc((header->vertexCount ? header->vertexCount : 1) * sizeof(uint32_t));
+  occluder->indices = malloc((lod->indexCount ? lod->indexCount : 1) * sizeof(uint32_t));
+  // no more vertices than indices
+  occluder->positions = malloc((lod->indexCount ? lod->indexCount : 1) * sizeof(*occluder->positions));
+  if (!remap || !occluder->indices || !occluder->positions) {
+    free(remap);
+    occluderMeshFree(occluder);
+    return 0;
+  }
+  memset(remap, 0xff, header->vertexCount * sizeof(uint32_t));
+  for (uint32_t i = 0; i < lod->indexCount; ++i) {
+    uint32_t index = indexSize == 2 ? ((const uint16_t *)indices)[lod->firstIndex + i]
+                                    : ((const uint32_t *)indices)[lod->firstIndex + i];
+    if (remap[index] == UINT32_MAX) {
+      const unsigned char *vertex = (const unsigned char *)vertices + (size_t)index * stride;
+      float *position = occluder->positions[occluder->vertexCount];
+      if (header->vertexFormat & MESH_POSITION_SHORT) {
+        int16_t q[3];
+        memcpy(q, vertex, sizeof(q));
+        for (int c = 0; c < 3; ++c) {
+          position[c] = q[c] * header->positionScale[c] + header->positionBias[c];
+        }
+      } else {
+        memcpy(position, vertex, 3 * sizeof(float));
+      }
+      remap[index] = occluder->vertexCount++;
+    }
+    occluder->indices[i] = remap[index];
+  }
+  occluder->indexCount = lod->indexCount;
+  free(remap);
+  return 1;
+}
+
+// Uploads vertices packed as `header` says, and sets up the VAO to unpack
+// them: positions as plain integers, which the vertex shader scales, so
+// that they do not depend on how the driver normalizes signed values.
+// Returns 0 if there is no memory for the occluder.
+static int upload(Mesh *mesh, const MeshFileHeader *header, const void *vertices, const void *indices,
+                   uint32_t indexSize) {
+  MeshVertexLayout layout;
+  meshVertexLayout(header->vertexFormat, &layout);
+  mesh->vertexCount = header->vertexCount;
+  mesh->vertexStride = layout.stride;
+  mesh->indexCount = (GLsizei)header->indexCount;
+  memcpy(mesh->boundsMin, header->boundsMin, sizeof(mesh->boundsMin));
+  memcpy(mesh->boundsMax, header->boundsMax, sizeof(mesh->boundsMax));
+  mesh->radius = header->radius;
+  mesh->lodCount = header->lodCount;
+  memcpy(mesh->lods, header->lods, sizeof(mesh->lods));
+  memcpy(mesh->positionScale, header->positionScale, sizeof(mesh->positionScale));
+  memcpy(mesh->positionBias, header->positionBias, sizeof(mesh->positionBias));
+
+  glGenVertexArrays(1, &mesh->vao);
+  glGenBuffers(1, &mesh->vertexBuffer);
+  glGenBuffers(1, &mesh->indexBuffer);
+  glBindVertexArray(mesh->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)mesh->vertexCount * layout.stride, vertices, GL_STATIC_DRAW);
+  // the element buffer binding belongs to the VAO
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)mesh->indexCount * indexSize, indices, GL_STATIC_DRAW);
+  mesh->indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+  GLsizei stride = (GLsizei)layout.stride;
+  GLenum positionType = header->vertexFormat & MESH_POSITION_SHORT ? GL_SHORT : GL_FLOAT;
+  glVertexAttribPointer(MESH_POSITION, 3, positionType, GL_FALSE, stride, (void *)0);
+  glEnableVertexAttribArray(MESH_POSITION);
+  if (header->vertexFormat & MESH_TEXCOORD_UNORM16) {
+    glVertexAttribPointer(MESH_TEXCOORD, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)(size_t)layout.texcoordOffset);
+  } else {
+    GLenum texcoordType = header->vertexFormat & MESH_TEXCOORD_HALF ? GL_HALF_FLOAT : GL_FLOAT;
+    glVertexAttribPointer(MESH_TEXCOORD, 2, texcoordType, GL_FALSE, stride, (void *)(size_t)layout.texcoordOffset);
+  }
+  glEnableVertexAttribArray(MESH_TEXCOORD);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return buildOccluder(&mesh->occluder, header, vertices, indices, indexSize, layout.stride);
+}
+
+static int loadCached(Mesh *mesh, const char *cached) {
+  MeshFile file;
+  if (!meshFileOpen(&file, cached)) {
+    return 0;
+  }
+  int ok = upload(mesh, &file.header, file.vertices, file.indices, file.header.indexSize);
+  meshFileClose(&file);
+  if (!ok) {
+    meshFree(mesh);
+  }
+  return ok;
+}
+
+int meshLoad(Mesh *mesh, JobSystem *jobs, const char *cacheDir, const char *path) {
+  memset(mesh, 0, sizeof(*mesh));
+  if (cacheDir && mkdir(cacheDir, 0755) != 0 && errno != EEXIST) {
+    perror("mkdir");
+    cacheDir = NULL;
+  }
+  char cached[MAXPATHLEN];
+  int cache = cachePath(cacheDir, path, cached);
+  if (cache && loadCached(mesh, cached)) {
+    mesh->cached = 1;
+    return 1;
+  }
+
+  Asset text;
+  if (!assetRead(path, &text)) {
+    fprintf(stderr, "Failed to load mesh %s\n", path);
+    return 0;
+  }
+  MeshData data;
+  int ok = objParse(jobs, path, (const char *)text.data, text.size, &data);
+  assetRelease(&text);
+  if (ok && !lodBuildChain(&data)) {
+    meshDataFree(&data);
+    ok = 0;
+  }
+  if (!ok) {
+    return 0;
+  }
+  // uploaded from the cache just written, so that the first run gets the
+  // same buffers, narrowed indices included, as the ones after it
+  if (!cache || !meshFileWrite(cached, &data) || !loadCached(mesh, cached)) {
+    MeshFileHeader header = {{0}, 0, data.vertexCount, data.indexCount};
+    memcpy(header.boundsMin, data.boundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, data.boundsMax, sizeof(header.boundsMax));
+    header.radius = data.radius;
+    header.lodCount = data.lodCount;
+    memcpy(header.lods, data.lods, sizeof(header.lods));
+    void *vertices = meshPackVertices(&data, &header);
+    ok = vertices != NULL && upload(mesh, &header, vertices, data.indices, 4);
+    free(vertices);
+  }
+  meshDataFree(&data);
+  return ok;
+}
+
+void meshFree(Mesh *mesh) {
+  glDeleteVertexArrays(1, &mesh->vao);
+  glDeleteBuffers(1, &mesh->vertexBuffer);
+  glDeleteBuffers(1, &mesh->indexBuffer);
+  occluderMeshFree(&mesh->occluder);
+  memset(mesh, 0, sizeof(*mesh));
+}
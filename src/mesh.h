@@ -0,0 +1,48 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <stdint.h>
+#include <glad/glad.h>
+
+#include "jobs.h"
+#include "meshfile.h"
+#include "occlusion.h"
+
+// attribute locations of the MeshVertex fields; 2 to 6 are the instanced
+// attributes of the indirect path
+#define MESH_POSITION 0
+#define MESH_TEXCOORD 1
+
+// A mesh on the GPU: a VAO with an interleaved vertex buffer, in the
+// format picked when it was packed (see meshfile.h), and an index buffer.
+// Positions come out of the VAO quantized; the vertex shader turns them
+// back with `position * positionScale + positionBias`.
+typedef struct {
+  GLuint vao;
+  GLuint vertexBuffer;
+  GLuint indexBuffer;
+  GLsizei indexCount;
+  GLenum indexType;
+  uint32_t vertexCount;
+  uint32_t vertexStride;
+  float positionScale[3];
+  float positionBias[3];
+  float boundsMin[3];
+  float boundsMax[3];
+  float radius; // around the origin
+  unsigned int lodCount;
+  MeshLod lods[MESH_MAX_LODS]; // ranges of the index buffer, full detail first
+  // the full level, on the CPU
+  OccluderMesh occluder;
+  int cached;   // 1 if it came from the cache, without parsing
+} Mesh;
+
+// Loads an OBJ model and builds its levels of detail (lod.h). With
+// `cacheDir`, the result is kept there as a mesh file (meshfile.h), keyed
+// by the path, size and modification time of the source, and later loads
+// map that and upload it without parsing or simplifying.
+// Parsing runs on `jobs`. Leaves the mesh's VAO bound.
+int meshLoad(Mesh *mesh, JobSystem *jobs, const char *cacheDir, const char *path);
+void meshFree(Mesh *mesh);
+
+#endif
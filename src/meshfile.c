@@ -0,0 +1,287 @@
+#include "meshfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "atomicfile.h"
+
+void meshDataFree(MeshData *mesh) {
+  free(mesh->vertices);
+  free(mesh->indices);
+  memset(mesh, 0, sizeof(*mesh));
+}
+
+void meshDataBounds(MeshData *mesh) {
+  float radius2 = 0.0f;
+  for (int c = 0; c < 3; ++c) {
+    mesh->boundsMin[c] = mesh->vertexCount ? INFINITY : 0.0f;
+    mesh->boundsMax[c] = mesh->vertexCount ? -INFINITY : 0.0f;
+  }
+  for (uint32_t i = 0; i < mesh->vertexCount; ++i) {
+    const float *p = mesh->vertices[i].position;
+    for (int c = 0; c < 3; ++c) {
+      mesh->boundsMin[c] = p[c] < mesh->boundsMin[c] ? p[c] : mesh->boundsMin[c];
+      mesh->boundsMax[c] = p[c] > mesh->boundsMax[c] ? p[c] : mesh->boundsMax[c];
+    }
+    float d2 = p[0] * p[0] + p[1] * p[1] + p[2] * p[2];
+    radius2 = d2 > radius2 ? d2 : radius2;
+  }
+  mesh->radius = sqrtf(radius2);
+}
+
+void meshVertexLayout(uint32_t format, MeshVertexLayout *layout) {
+  layout->texcoordOffset = format & MESH_POSITION_SHORT ? 8 : 12;
+  layout->stride = layout->texcoordOffset + (format & (MESH_TEXCOORD_UNORM16 | MESH_TEXCOORD_HALF) ? 4 : 8);
+}
+
+static uint16_t floatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (exponent >= 31) {
+    return (uint16_t)(sign | 0x7c00);
+  }
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return (uint16_t)sign;
+    }
+    // subnormal: shift the implicit one in and round to nearest
+    mantissa |= 0x800000;
+    uint32_t shift = (uint32_t)(14 - exponent);
+    return (uint16_t)(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+  }
+  // rounding may carry into the exponent, which is still the right value
+  return (uint16_t)(sign | ((((uint32_t)exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1)));
+}
+
+static int32_t quantize(float value, float scale, int32_t limit) {
+  float q = roundf(value * scale);
+  return (int32_t)(q < -limit ? -limit : q > limit ? limit : q);
+}
+
+static void quantizePosition(const MeshFileHeader *header, const float *p, int16_t *q) {
+  for (int c = 0; c < 3; ++c) {
+    q[c] = (int16_t)quantize(p[c] - header->positionBias[c], 1.0f / header->positionScale[c], 32767);
+  }
+}
+
+// Whether 16 bits across the bounds merge two corners of a triangle that
+// were apart, which would turn it into a sliver or a line.
+static int positionsCollapse(const MeshData *mesh, const MeshFileHeader *header) {
+  for (uint32_t i = 0; i + 2 < mesh->indexCount; i += 3) {
+    int16_t q[3][3];
+    for (int k = 0; k < 3; ++k) {
+      quantizePosition(header, mesh->vertices[mesh->indices[i + k]].position, q[k]);
+    }
+    for (int k = 0; k < 3; ++k) {
+      const float *a = mesh->vertices[mesh->indices[i + k]].position;
+      const float *b = mesh->vertices[mesh->indices[i + (k + 1) % 3]].position;
+      if (memcmp(q[k], q[(k + 1) % 3], sizeof(q[k])) == 0 && (a[0] != b[0] || a[1] != b[1] || a[2] != b[2])) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+void *meshPackVertices(const MeshData *mesh, MeshFileHeader *header) {
+  // half the extent maps onto 32767 steps either side of the centre
+  for (int c = 0; c < 3; ++c) {
+    float half = (mesh->boundsMax[c] - mesh->boundsMin[c]) * 0.5f;
+    header->positionBias[c] = mesh->boundsMin[c] + half;
+    header->positionScale[c] = half > 0.0f ? half / 32767.0f : 1.0f;
+  }
+  uint32_t format = 0;
+  if (!positionsCollapse(mesh, header)) {
+    format |= MESH_POSITION_SHORT;
+  } else {
+    for (int c = 0; c < 3; ++c) {
+      header->positionScale[c] = 1.0f;
+      header->positionBias[c] = 0.0f;
+    }
+  }
+  float low = 0.0f, high = 0.0f;
+  for (uint32_t i = 0; i < mesh->vertexCount; ++i) {
+    for (int c = 0; c < 2; ++c) {
+      float t = mesh->vertices[i].texcoord[c];
+      low = t < low ? t : low;
+      high = t > high ? t : high;
+    }
+  }
+  if (low >= 0.0f && high <= 1.0f) {
+    format |= MESH_TEXCOORD_UNORM16;
+  } else if (low > -MESH_HALF_TEXCOORD_LIMIT && high < MESH_HALF_TEXCOORD_LIMIT) {
+    format |= MESH_TEXCOORD_HALF;
+  }
+
+  MeshVertexLayout layout;
+  meshVertexLayout(format, &layout);
+  header->vertexFormat = format;
+  header->vertexStride = layout.stride;
+  unsigned char *packed = calloc(mesh->vertexCount ? mesh->vertexCount : 1, layout.stride);
+  if (packed == NULL) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < mesh->vertexCount; ++i) {
+    const MeshVertex *v = &mesh->vertices[i];
+    unsigned char *out = packed + (size_t)i * layout.stride;
+    if (format & MESH_POSITION_SHORT) {
+      quantizePosition(header, v->position, (int16_t *)out);
+    } else {
+      memcpy(out, v->position, sizeof(v->position));
+    }
+    unsigned char *texcoord = out + layout.texcoordOffset;
+    if (format & MESH_TEXCOORD_UNORM16) {
+      for (int c = 0; c < 2; ++c) {
+        ((uint16_t *)texcoord)[c] = (uint16_t)quantize(v->texcoord[c], 65535.0f, 65535);
+      }
+    } else if (format & MESH_TEXCOORD_HALF) {
+      for (int c = 0; c < 2; ++c) {
+        ((uint16_t *)texcoord)[c] = floatToHalf(v->texcoord[c]);
+      }
+    } else {
+      memcpy(texcoord, v->texcoord, sizeof(v->texcoord));
+    }
+  }
+  return packed;
+}
+
+static uint64_t alignUp(uint64_t offset) {
+  return (offset + MESH_ALIGNMENT - 1) & ~(uint64_t)(MESH_ALIGNMENT - 1);
+}
+
+// Whether every index names one of the vertices; a truncated or corrupt
+// file would otherwise send the loader and the GL past the vertex buffer.
+static int indicesInRange(const void *indices, uint32_t count, uint32_t size, uint32_t vertexCount) {
+  uint32_t largest = 0;
+  if (size == 2) {
+    const uint16_t *narrow = indices;
+    for (uint32_t i = 0; i < count; ++i) {
+      largest = narrow[i] > largest ? narrow[i] : largest;
+    }
+  } else {
+    const uint32_t *wide = indices;
+    for (uint32_t i = 0; i < count; ++i) {
+      largest = wide[i] > largest ? wide[i] : largest;
+    }
+  }
+  return count == 0 || largest < vertexCount;
+}
+
+int meshFileOpen(MeshFile *file, const char *path) {
+  memset(file, 0, sizeof(*file));
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    if (errno != ENOENT) {
+      perror(path);
+    }
+    return 0;
+  }
+  struct stat st;
+  void *mapped = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(MeshFileHeader)) {
+    mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    fprintf(stderr, "%s: not a mesh file\n", path);
+    return 0;
+  }
+  file->mapped = mapped;
+  file->length = (size_t)st.st_size;
+
+  MeshFileHeader *header = &file->header;
+  memcpy(header, mapped, sizeof(*header));
+  MeshVertexLayout layout;
+  meshVertexLayout(header->vertexFormat, &layout);
+  uint64_t vertexBytes = (uint64_t)header->vertexCount * layout.stride;
+  uint64_t indexBytes = (uint64_t)header->indexCount * header->indexSize;
+  if (memcmp(header->magic, MESH_FILE_MAGIC, 4) != 0 || header->version != MESH_FILE_VERSION ||
+      header->vertexStride != layout.stride || (header->indexSize != 2 && header->indexSize != 4) ||
+      header->vertexOffset > file->length || vertexBytes > file->length - header->vertexOffset ||
+      header->indexOffset > file->length || indexBytes > file->length - header->indexOffset ||
+      header->vertexOffset % MESH_ALIGNMENT != 0 || header->indexOffset % MESH_ALIGNMENT != 0 ||
+      header->lodCount == 0 || header->lodCount > MESH_MAX_LODS) {
+    fprintf(stderr, "%s: not a mesh file\n", path);
+    meshFileClose(file);
+    return 0;
+  }
+  for (uint32_t i = 0; i < header->lodCount; ++i) {
+    const MeshLod *lod = &header->lods[i];
+    if (lod->firstIndex > header->indexCount || lod->indexCount > header->indexCount - lod->firstIndex) {
+      fprintf(stderr, "%s: not a mesh file\n", path);
+      meshFileClose(file);
+      return 0;
+    }
+  }
+  file->vertices = (const unsigned char *)mapped + header->vertexOffset;
+  file->indices = (const unsigned char *)mapped + header->indexOffset;
+  if (!indicesInRange(file->indices, header->indexCount, header->indexSize, header->vertexCount)) {
+    fprintf(stderr, "%s: not a mesh file\n", path);
+    meshFileClose(file);
+    return 0;
+  }
+  return 1;
+}
+
+void meshFileClose(MeshFile *file) {
+  if (file->mapped) {
+    munmap(file->mapped, file->length);
+  }
+  memset(file, 0, sizeof(*file));
+}
+
+int meshFileWrite(const char *path, const MeshData *mesh) {
+  MeshFileHeader header = {{'L', 'M', 'S', 'H'}, MESH_FILE_VERSION, mesh->vertexCount, mesh->indexCount};
+  header.indexSize = mesh->vertexCount <= 65536 ? 2 : 4;
+  memcpy(header.boundsMin, mesh->boundsMin, sizeof(header.boundsMin));
+  memcpy(header.boundsMax, mesh->boundsMax, sizeof(header.boundsMax));
+  header.radius = mesh->radius;
+  header.lodCount = mesh->lodCount;
+  memcpy(header.lods, mesh->lods, sizeof(header.lods));
+  void *vertices = meshPackVertices(mesh, &header);
+  if (vertices == NULL) {
+    return 0;
+  }
+  uint64_t vertexBytes = (uint64_t)mesh->vertexCount * header.vertexStride;
+  header.vertexOffset = alignUp(sizeof(header));
+  header.indexOffset = alignUp(header.vertexOffset + vertexBytes);
+
+  void *indices = mesh->indices;
+  uint16_t *narrow = NULL;
+  if (header.indexSize == 2) {
+    narrow = malloc((mesh->indexCount ? mesh->indexCount : 1) * sizeof(uint16_t));
+    if (narrow == NULL) {
+      free(vertices);
+      return 0;
+    }
+    for (uint32_t i = 0; i < mesh->indexCount; ++i) {
+      narrow[i] = (uint16_t)mesh->indices[i];
+    }
+    indices = narrow;
+  }
+
+  AtomicFile f;
+  atomicFileOpen(&f, path);
+  atomicFileWrite(&f, &header, sizeof(header));
+  atomicFilePadTo(&f, header.vertexOffset);
+  atomicFileWrite(&f, vertices, vertexBytes);
+  atomicFilePadTo(&f, header.indexOffset);
+  atomicFileWrite(&f, indices, (size_t)mesh->indexCount * header.indexSize);
+  int ok = atomicFileClose(&f, 1);
+  if (!ok) {
+    fprintf(stderr, "%s: could not be written\n", path);
+  }
+  free(vertices);
+  free(narrow);
+  return ok;
+}
@@ -0,0 +1,128 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A mesh stored exactly as it is uploaded, so loading it is a mapping and
+// two buffer uploads straight from it:
+//
+//   MeshFileHeader
+//   vertices         from vertexOffset, vertexCount of vertexStride bytes,
+//                    interleaved in the layout of vertexFormat
+//   indices          from indexOffset, indexCount of indexSize bytes
+//
+// All fields are little endian; both blobs start on MESH_ALIGNMENT. Indices
+// are 16-bit when every vertex fits, 32-bit otherwise. `radius` bounds the
+// mesh around its origin, whichever way it is turned.
+//
+// The indices hold lodCount levels of detail one after the other, the full
+// mesh first, each a simplification of it (lod.h) over the same vertices.
+#define MESH_FILE_MAGIC "LMSH"
+#define MESH_FILE_VERSION 3
+#define MESH_ALIGNMENT 64
+#define MESH_MAX_LODS 8
+
+// How each attribute is stored, picked per mesh by meshPackVertices. In
+// order, a vertex holds:
+//
+//   position   MESH_POSITION_SHORT: 3 int16 and 2 bytes of padding, to be
+//              multiplied by positionScale and added to positionBias;
+//              otherwise 3 floats
+//   texcoord   MESH_TEXCOORD_UNORM16: 2 uint16 over [0, 1];
+//              MESH_TEXCOORD_HALF: 2 half floats; otherwise 2 floats
+//
+// Normals are not stored, since no shader lights the mesh.
+enum {
+  MESH_POSITION_SHORT = 1 << 0,
+  MESH_TEXCOORD_UNORM16 = 1 << 1,
+  MESH_TEXCOORD_HALF = 1 << 2,
+};
+
+typedef struct {
+  float position[3];
+  float texcoord[2];
+} MeshVertex;
+
+// A level of detail: a range of the indices, and how far its surface
+// strays from the full mesh, in model units.
+typedef struct {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+} MeshLod;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t vertexFormat; // MESH_POSITION_SHORT | ...
+  uint32_t vertexStride;
+  uint32_t indexSize; // 2 or 4
+  uint32_t lodCount;
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  float boundsMin[3];
+  float boundsMax[3];
+  float radius;
+  float positionScale[3];
+  float positionBias[3];
+  MeshLod lods[MESH_MAX_LODS];
+} MeshFileHeader;
+
+// Where the attributes of a vertexFormat sit in a vertex; the position is
+// always first.
+typedef struct {
+  uint32_t stride;
+  uint32_t texcoordOffset;
+} MeshVertexLayout;
+
+void meshVertexLayout(uint32_t format, MeshVertexLayout *layout);
+
+// A mesh in memory, as made by the OBJ parser (obj.h).
+typedef struct {
+  MeshVertex *vertices;
+  uint32_t vertexCount;
+  uint32_t *indices; // triangles, of every level
+  uint32_t indexCount;
+  uint32_t lodCount;
+  MeshLod lods[MESH_MAX_LODS];
+  float boundsMin[3];
+  float boundsMax[3];
+  float radius;
+} MeshData;
+
+void meshDataFree(MeshData *mesh);
+
+// Sets the bounds of `mesh` from its vertices.
+void meshDataBounds(MeshData *mesh);
+
+// below 4, a half float is off by at most 1/1024 of a repeat of the texture
+#define MESH_HALF_TEXCOORD_LIMIT 4.0f
+
+// Packs the vertices of `mesh`, whose bounds are set, into the smallest
+// format that keeps them apart: positions are quantized to 16 bits across
+// the bounds unless that collapses an edge of some triangle, texture
+// coordinates take 16 bits when they stay in [0, 1] and half floats when
+// they stay within MESH_HALF_TEXCOORD_LIMIT. Fills in the vertex fields of
+// `header` and returns the vertices, to be freed, or NULL.
+void *meshPackVertices(const MeshData *mesh, MeshFileHeader *header);
+
+// An open mesh file: the header and pointers into the mapping.
+typedef struct {
+  MeshFileHeader header;
+  const void *vertices;
+  const void *indices;
+  void *mapped;
+  size_t length;
+} MeshFile;
+
+// Maps the file. Returns 0, quietly if it does not exist, if it cannot be
+// used.
+int meshFileOpen(MeshFile *file, const char *path);
+void meshFileClose(MeshFile *file);
+
+int meshFileWrite(const char *path, const MeshData *mesh);
+
+#endif
@@ -0,0 +1,159 @@
+#include "mipmap.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIP_SSE2
+#endif
+
+int mipLevelCount(int width, int height) {
+  int levels = 1;
+  while (width > 1 || height > 1) {
+    width = mipLevelSize(width, 1);
+    height = mipLevelSize(height, 1);
+    levels++;
+  }
+  return levels;
+}
+
+int mipLevelSize(int size, int level) {
+  size >>= level;
+  return size > 0 ? size : 1;
+}
+
+#if defined(MIP_SSE2) || defined(MIP_AVX2)
+// Two source rows of 8 texels in, 4 texels out. The rows are summed in 16
+// bits, then the even and odd texels are separated and summed too.
+static inline __m128i average4(__m128i a0, __m128i a1, __m128i b0, __m128i b1) {
+  const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+  __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+  __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+  __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+  __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+  __m128i h0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+  __m128i h1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+  h0 = _mm_srli_epi16(_mm_add_epi16(h0, two), 2);
+  h1 = _mm_srli_epi16(_mm_add_epi16(h1, two), 2);
+  return _mm_packus_epi16(h0, h1);
+}
+#endif
+
+// Returns the first destination texel left for the scalar loop.
+static int downsampleRowSimd(const unsigned char *row0, const unsigned char *row1, int dstWidth, unsigned char *dst) {
+  int x = 0;
+#ifdef MIP_AVX2
+  const __m256i zero = _mm256_setzero_si256(), two = _mm256_set1_epi16(2);
+  for (; x + 8 <= dstWidth; x += 8) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)(row0 + 8 * x));
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)(row0 + 8 * x + 32));
+    __m256i b0 = _mm256_loadu_si256((const __m256i *)(row1 + 8 * x));
+    __m256i b1 = _mm256_loadu_si256((const __m256i *)(row1 + 8 * x + 32));
+    // the unpacks work within 128-bit lanes, hence the final reordering
+    __m256i s0 = _mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(b0, zero));
+    __m256i s1 = _mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(b0, zero));
+    __m256i s2 = _mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(b1, zero));
+    __m256i s3 = _mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(b1, zero));
+    __m256i h0 = _mm256_add_epi16(_mm256_unpacklo_epi64(s0, s1), _mm256_unpackhi_epi64(s0, s1));
+    __m256i h1 = _mm256_add_epi16(_mm256_unpacklo_epi64(s2, s3), _mm256_unpackhi_epi64(s2, s3));
+    h0 = _mm256_srli_epi16(_mm256_add_epi16(h0, two), 2);
+    h1 = _mm256_srli_epi16(_mm256_add_epi16(h1, two), 2);
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(h0, h1), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256((__m256i *)(dst + 4 * x), packed);
+  }
+#endif
+#if defined(MIP_SSE2) || defined(MIP_AVX2)
+  for (; x + 4 <= dstWidth; x += 4) {
+    __m128i a0 = _mm_loadu_si128((const __m128i *)(row0 + 8 * x));
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(row0 + 8 * x + 16));
+    __m128i b0 = _mm_loadu_si128((const __m128i *)(row1 + 8 * x));
+    __m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + 8 * x + 16));
+    _mm_storeu_si128((__m128i *)(dst + 4 * x), average4(a0, a1, b0, b1));
+  }
+#endif
+  return x;
+}
+
+void mipDownsample(const unsigned char *src, int width, int height, unsigned char *dst) {
+  int dstWidth = mipLevelSize(width, 1), dstHeight = mipLevelSize(height, 1);
+  for (int y = 0; y < dstHeight; ++y) {
+    const unsigned char *row0 = src + (size_t)(2 * y) * width * 4;
+    const unsigned char *row1 = 2 * y + 1 < height ? row0 + (size_t)width * 4 : row0;
+    unsigned char *out = dst + (size_t)y * dstWidth * 4;
+    // the vector loop needs every pair of source texels, so not a 1 wide image
+    int x = width > 1 ? downsampleRowSimd(row0, row1, dstWidth, out) : 0;
+    for (; x < dstWidth; ++x) {
+      int x0 = 2 * x, x1 = 2 * x + 1 < width ? 2 * x + 1 : 2 * x;
+      for (int k = 0; k < 4; ++k) {
+        int sum = row0[4 * x0 + k] + row0[4 * x1 + k] + row1[4 * x0 + k] + row1[4 * x1 + k];
+        out[4 * x + k] = (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+// sRGB bytes to 16-bit linear light, and back
+static uint16_t srgbToLinear[256];
+static unsigned char linearToSrgb[65536];
+static pthread_once_t srgbTablesOnce = PTHREAD_ONCE_INIT;
+
+static void initSrgbTables(void) {
+  for (int i = 0; i < 256; ++i) {
+    float c = i / 255.0f;
+    float l = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    srgbToLinear[i] = (uint16_t)(l * 65535.0f + 0.5f);
+  }
+  for (int i = 0; i < 65536; ++i) {
+    float l = i / 65535.0f;
+    float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+    linearToSrgb[i] = (unsigned char)(c * 255.0f + 0.5f);
+  }
+}
+
+void mipDownsampleSrgb(const unsigned char *src, int width, int height, unsigned char *dst) {
+  pthread_once(&srgbTablesOnce, initSrgbTables);
+  int dstWidth = mipLevelSize(width, 1), dstHeight = mipLevelSize(height, 1);
+  for (int y = 0; y < dstHeight; ++y) {
+    const unsigned char *row0 = src + (size_t)(2 * y) * width * 4;
+    const unsigned char *row1 = 2 * y + 1 < height ? row0 + (size_t)width * 4 : row0;
+    unsigned char *out = dst + (size_t)y * dstWidth * 4;
+    for (int x = 0; x < dstWidth; ++x) {
+      int x0 = 2 * x, x1 = 2 * x + 1 < width ? 2 * x + 1 : 2 * x;
+      for (int k = 0; k < 3; ++k) {
+        uint32_t sum = srgbToLinear[row0[4 * x0 + k]] + srgbToLinear[row0[4 * x1 + k]] +
+                       srgbToLinear[row1[4 * x0 + k]] + srgbToLinear[row1[4 * x1 + k]];
+        out[4 * x + k] = linearToSrgb[(sum + 2) / 4];
+      }
+      int alpha = row0[4 * x0 + 3] + row0[4 * x1 + 3] + row1[4 * x0 + 3] + row1[4 * x1 + 3];
+      out[4 * x + 3] = (unsigned char)((alpha + 2) / 4);
+    }
+  }
+}
+
+int mipBuildChain(unsigned char **levels, int width, int height, int srgb) {
+  int count = mipLevelCount(width, height);
+  for (int level = 1; level < count; ++level) {
+    int w = mipLevelSize(width, level - 1), h = mipLevelSize(height, level - 1);
+    levels[level] = malloc((size_t)mipLevelSize(w, 1) * mipLevelSize(h, 1) * 4);
+    if (levels[level] == NULL) {
+      while (--level > 0) {
+        free(levels[level]);
+        levels[level] = NULL;
+      }
+      return 0;
+    }
+    if (srgb) {
+      mipDownsampleSrgb(levels[level - 1], w, h, levels[level]);
+    } else {
+      mipDownsample(levels[level - 1], w, h, levels[level]);
+    }
+  }
+  return 1;
+}
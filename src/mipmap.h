@@ -0,0 +1,24 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+// Levels in a full mip chain of a width x height image, down to 1x1.
+int mipLevelCount(int width, int height);
+
+// Size of `level` of a chain whose level 0 is width x height.
+int mipLevelSize(int size, int level);
+
+// Halves an RGBA8 image with a 2x2 box filter into `dst`, which is
+// mipLevelSize(width, 1) x mipLevelSize(height, 1). An odd last row or
+// column is dropped, and a side of 1 is averaged with itself. Uses AVX2 or
+// SSE2 where the compiler targets them.
+void mipDownsample(const unsigned char *src, int width, int height, unsigned char *dst);
+
+// The same for sRGB encoded colour: RGB is averaged in linear light and
+// encoded again, which keeps the far mips from darkening. Alpha is linear.
+void mipDownsampleSrgb(const unsigned char *src, int width, int height, unsigned char *dst);
+
+// Fills levels[1 .. mipLevelCount - 1] with newly allocated levels made from
+// levels[0]. Returns 0, with nothing allocated, if memory runs out.
+int mipBuildChain(unsigned char **levels, int width, int height, int srgb);
+
+#endif
@@ -0,0 +1,371 @@
+#include "obj.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// smallest chunk handed to a job, so small files are not cut up for nothing
+#define MIN_CHUNK (64 * 1024)
+
+typedef struct {
+  int32_t position;
+  int32_t texcoord; // -1 for none
+} Corner;
+
+typedef struct {
+  float *positions; // 3 each
+  float *texcoords; // 2 each
+  Corner *corners;  // 3 a triangle
+} Elements;
+
+typedef struct {
+  const char *begin;
+  const char *end;
+  const Elements *elements;
+  // counted by the first pass; the second writes from the bases on
+  size_t positions, texcoords, corners;
+  size_t positionBase, texcoordBase, cornerBase;
+  int failed;
+} Chunk;
+
+static int isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skipSpace(const char *p, const char *end) {
+  while (p < end && isSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *lineEnd(const char *p, const char *end) {
+  const char *newline = memchr(p, '\n', (size_t)(end - p));
+  return newline ? newline : end;
+}
+
+static const double powersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static double powerOfTen(int exponent) {
+  if (exponent >= 0 && exponent <= 22) {
+    return powersOfTen[exponent];
+  }
+  if (exponent < 0 && exponent >= -22) {
+    return 1.0 / powersOfTen[-exponent];
+  }
+  return pow(10.0, exponent);
+}
+
+// Decimal digits into an integer and an exponent, converted once at the
+// end: no locale, no strtod. Exact for the up to 19 digits meshes have.
+static const char *parseFloat(const char *p, const char *end, float *value) {
+  int negative = 0;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int exponent = 0, digits = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+    if (mantissa < 1000000000000000000ull) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+      if (mantissa < 1000000000000000000ull) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (digits == 0) {
+    return NULL;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    int negativeExponent = 0;
+    if (q < end && (*q == '-' || *q == '+')) {
+      negativeExponent = *q == '-';
+      q++;
+    }
+    if (q < end && *q >= '0' && *q <= '9') {
+      int e = 0;
+      for (; q < end && *q >= '0' && *q <= '9'; ++q) {
+        e = e < 10000 ? e * 10 + (*q - '0') : e;
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+  double v = (double)mantissa * powerOfTen(exponent);
+  *value = (float)(negative ? -v : v);
+  return p;
+}
+
+static const char *parseInt(const char *p, const char *end, long *value) {
+  int negative = 0;
+  if (p < end && *p == '-') {
+    negative = 1;
+    p++;
+  }
+  if (p == end || *p < '0' || *p > '9') {
+    return NULL;
+  }
+  long v = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+    v = v * 10 + (*p - '0');
+  }
+  *value = negative ? -v : v;
+  return p;
+}
+
+// Up to `count` floats; the rest of the line is ignored, so that the
+// optional w of positions and texture coordinates can be left off.
+static int parseFloats(const char *p, const char *end, float *out, int count) {
+  for (int i = 0; i < count; ++i) {
+    p = skipSpace(p, end);
+    if ((p = parseFloat(p, end, &out[i])) == NULL) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// 1-based, or negative for counting back from the last one defined so
+// far, into 0-based; -1 if out of range.
+static int32_t resolveIndex(long index, size_t defined) {
+  if (index > 0 && (size_t)index <= defined) {
+    return (int32_t)(index - 1);
+  }
+  if (index < 0 && (size_t)-index <= defined) {
+    return (int32_t)((long)defined + index);
+  }
+  return -1;
+}
+
+// One face corner, "p", "p/t", "p//n" or "p/t/n". Nothing shades with
+// normals, so n is only checked to be a number.
+static const char *parseCorner(const char *p, const char *end, const Chunk *chunk, Corner *corner) {
+  long position, texcoord = 0, normal;
+  if ((p = parseInt(p, end, &position)) == NULL) {
+    return NULL;
+  }
+  if (p < end && *p == '/') {
+    p++;
+    if (p < end && *p != '/' && (p = parseInt(p, end, &texcoord)) == NULL) {
+      return NULL;
+    }
+    if (p < end && *p == '/' && (p = parseInt(p + 1, end, &normal)) == NULL) {
+      return NULL;
+    }
+  }
+  corner->position = resolveIndex(position, chunk->positionBase + chunk->positions);
+  corner->texcoord = texcoord ? resolveIndex(texcoord, chunk->texcoordBase + chunk->texcoords) : -1;
+  if (corner->position < 0 || (texcoord && corner->texcoord < 0)) {
+    return NULL;
+  }
+  return p;
+}
+
+// Both passes: without `elements` only counts, with them also stores.
+static void parseChunk(Chunk *chunk, const Elements *elements) {
+  chunk->positions = chunk->texcoords = chunk->corners = 0;
+  for (const char *p = chunk->begin; p < chunk->end && !chunk->failed;) {
+    const char *end = lineEnd(p, chunk->end);
+    p = skipSpace(p, end);
+    if (end - p >= 2 && p[0] == 'v' && isSpace(p[1])) {
+      if (elements && !parseFloats(p + 2, end, elements->positions + 3 * (chunk->positionBase + chunk->positions), 3)) {
+        chunk->failed = 1;
+      }
+      chunk->positions++;
+    } else if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+      if (elements && !parseFloats(p + 3, end, elements->texcoords + 2 * (chunk->texcoordBase + chunk->texcoords), 2)) {
+        chunk->failed = 1;
+      }
+      chunk->texcoords++;
+    } else if (end - p >= 2 && p[0] == 'f' && isSpace(p[1])) {
+      Corner first, previous, corner;
+      int count = 0;
+      for (const char *q = skipSpace(p + 2, end); q < end; q = skipSpace(q, end), ++count) {
+        if (!elements) {
+          // counting only needs the number of corners
+          while (q < end && !isSpace(*q)) {
+            q++;
+          }
+          continue;
+        }
+        if ((q = parseCorner(q, end, chunk, &corner)) == NULL) {
+          chunk->failed = 1;
+          break;
+        }
+        if (count >= 2) {
+          Corner *triangle = elements->corners + chunk->cornerBase + chunk->corners + 3 * (count - 2);
+          triangle[0] = first;
+          triangle[1] = previous;
+          triangle[2] = corner;
+        }
+        first = count == 0 ? corner : first;
+        previous = corner;
+      }
+      if (count < 3) {
+        chunk->failed = 1;
+      }
+      chunk->corners += count >= 3 ? 3 * (size_t)(count - 2) : 0;
+    }
+    p = end + 1;
+  }
+}
+
+static void countJob(void *data, unsigned int thread) {
+  Chunk *chunk = data;
+  parseChunk(chunk, NULL);
+}
+
+static void parseJob(void *data, unsigned int thread) {
+  Chunk *chunk = data;
+  parseChunk(chunk, chunk->elements);
+}
+
+static uint32_t hashCorner(const Corner *corner) {
+  uint64_t h = (uint64_t)(uint32_t)corner->position * 0x9e3779b97f4a7c15ull;
+  h ^= (uint64_t)(uint32_t)corner->texcoord * 0xc2b2ae3d27d4eb4full;
+  return (uint32_t)(h >> 32);
+}
+
+// Gives each distinct corner a vertex, in the order they first appear.
+static int buildVertices(const Elements *elements, size_t cornerCount, MeshData *mesh) {
+  size_t tableSize = 16;
+  while (tableSize < cornerCount * 2) {
+    tableSize *= 2;
+  }
+  uint32_t *table = malloc(tableSize * sizeof(uint32_t)); // vertex + 1, 0 for empty
+  const Corner **vertexCorners = malloc((cornerCount ? cornerCount : 1) * sizeof(Corner *));
+  mesh->indices = malloc((cornerCount ? cornerCount : 1) * sizeof(uint32_t));
+  if (table == NULL || vertexCorners == NULL || mesh->indices == NULL) {
+    free(table);
+    free(vertexCorners);
+    return 0;
+  }
+  memset(table, 0, tableSize * sizeof(uint32_t));
+  uint32_t vertexCount = 0;
+  for (size_t i = 0; i < cornerCount; ++i) {
+    const Corner *corner = &elements->corners[i];
+    size_t slot = hashCorner(corner) & (tableSize - 1);
+    while (table[slot] != 0) {
+      const Corner *other = vertexCorners[table[slot] - 1];
+      if (other->position == corner->position && other->texcoord == corner->texcoord) {
+        break;
+      }
+      slot = (slot + 1) & (tableSize - 1);
+    }
+    if (table[slot] == 0) {
+      vertexCorners[vertexCount] = corner;
+      table[slot] = ++vertexCount;
+    }
+    mesh->indices[i] = table[slot] - 1;
+  }
+  free(table);
+
+  mesh->vertices = calloc(vertexCount ? vertexCount : 1, sizeof(MeshVertex));
+  if (mesh->vertices == NULL) {
+    free(vertexCorners);
+    return 0;
+  }
+  for (uint32_t v = 0; v < vertexCount; ++v) {
+    const Corner *corner = vertexCorners[v];
+    MeshVertex *vertex = &mesh->vertices[v];
+    memcpy(vertex->position, elements->positions + 3 * corner->position, 3 * sizeof(float));
+    if (corner->texcoord >= 0) {
+      memcpy(vertex->texcoord, elements->texcoords + 2 * corner->texcoord, 2 * sizeof(float));
+    }
+  }
+  free(vertexCorners);
+  mesh->vertexCount = vertexCount;
+  mesh->indexCount = (uint32_t)cornerCount;
+  mesh->lodCount = 1;
+  mesh->lods[0] = (MeshLod){0, (uint32_t)cornerCount, 0.0f};
+  return 1;
+}
+
+int objParse(JobSystem *jobs, const char *name, const char *text, size_t size, MeshData *mesh) {
+  memset(mesh, 0, sizeof(*mesh));
+  size_t chunkCount = 4 * (size_t)jobThreadCount(jobs);
+  if (size / chunkCount < MIN_CHUNK) {
+    chunkCount = size / MIN_CHUNK + 1;
+  }
+  Chunk *chunks = calloc(chunkCount, sizeof(Chunk));
+  if (chunks == NULL) {
+    return 0;
+  }
+  // cut after a line end, so that every line is in one chunk
+  const char *end = text + size, *p = text;
+  for (size_t c = 0; c < chunkCount; ++c) {
+    chunks[c].begin = p;
+    const char *cut = c + 1 == chunkCount ? end : text + size * (c + 1) / chunkCount;
+    if (cut < p) {
+      cut = p;
+    }
+    const char *newline = cut < end ? memchr(cut, '\n', (size_t)(end - cut)) : NULL;
+    p = newline ? newline + 1 : end;
+    chunks[c].end = p;
+  }
+
+  JobCounter counted = {0};
+  for (size_t c = 0; c < chunkCount; ++c) {
+    jobSubmit(jobs, countJob, &chunks[c], &counted);
+  }
+  jobWait(jobs, &counted);
+
+  size_t positions = 0, texcoords = 0, corners = 0;
+  int failed = 0;
+  for (size_t c = 0; c < chunkCount; ++c) {
+    chunks[c].positionBase = positions;
+    chunks[c].texcoordBase = texcoords;
+    chunks[c].cornerBase = corners;
+    positions += chunks[c].positions;
+    texcoords += chunks[c].texcoords;
+    corners += chunks[c].corners;
+    failed |= chunks[c].failed;
+  }
+
+  Elements elements = {
+    malloc((positions ? positions : 1) * 3 * sizeof(float)),
+    malloc((texcoords ? texcoords : 1) * 2 * sizeof(float)),
+    malloc((corners ? corners : 1) * sizeof(Corner)),
+  };
+  int ok = !failed && elements.positions && elements.texcoords && elements.corners &&
+           corners <= UINT32_MAX;
+  if (ok) {
+    JobCounter parsed = {0};
+    for (size_t c = 0; c < chunkCount; ++c) {
+      chunks[c].elements = &elements;
+      jobSubmit(jobs, parseJob, &chunks[c], &parsed);
+    }
+    jobWait(jobs, &parsed);
+    for (size_t c = 0; c < chunkCount; ++c) {
+      ok = ok && !chunks[c].failed;
+    }
+    if (!ok) {
+      fprintf(stderr, "%s: malformed OBJ\n", name);
+    }
+  } else if (failed) {
+    fprintf(stderr, "%s: malformed OBJ\n", name);
+  }
+  ok = ok && buildVertices(&elements, corners, mesh);
+  if (ok) {
+    meshDataBounds(mesh);
+  } else {
+    meshDataFree(mesh);
+  }
+  free(elements.positions);
+  free(elements.texcoords);
+  free(elements.corners);
+  free(chunks);
+  return ok;
+}
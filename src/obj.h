@@ -0,0 +1,23 @@
+#ifndef OBJ_H
+#define OBJ_H
+
+#include <stddef.h>
+
+#include "jobs.h"
+#include "meshfile.h"
+
+// Parses Wavefront OBJ text into an indexed triangle mesh. Positions,
+// texture coordinates and faces are read; polygons are turned into fans of
+// triangles, and everything else (normals, groups, materials, smoothing) is
+// skipped, since no shader here lights the mesh.
+//
+// The text is cut into chunks at line ends, parsed by jobs in two passes:
+// one counting what each chunk holds, so that every chunk knows where its
+// elements go and what relative indices refer to, and one parsing them into
+// place. Face corners that name the same position and texture coordinate
+// then become one vertex, found through a hash table.
+//
+// Returns 0 with a message naming `name` if the text is malformed.
+int objParse(JobSystem *jobs, const char *name, const char *text, size_t size, MeshData *mesh);
+
+#endif
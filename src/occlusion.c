@@ -0,0 +1,220 @@
+#include "occlusion.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int levelWidth(int level) {
+  int width = OCCLUSION_WIDTH >> level;
+  return width > 0 ? width : 1;
+}
+
+static int levelHeight(int level) {
+  int height = OCCLUSION_HEIGHT >> level;
+  return height > 0 ? height : 1;
+}
+
+int occlusionInit(OcclusionBuffer *buffer) {
+  memset(buffer, 0, sizeof(*buffer));
+  size_t total = 0;
+  for (int level = 0; level < OCCLUSION_LEVELS; ++level) {
+    total += (size_t)levelWidth(level) * levelHeight(level);
+  }
+  float *storage = malloc(total * sizeof(float));
+  if (!storage) {
+    return 0;
+  }
+  for (int level = 0; level < OCCLUSION_LEVELS; ++level) {
+    buffer->depth[level] = storage;
+    storage += (size_t)levelWidth(level) * levelHeight(level);
+  }
+  occlusionClear(buffer);
+  occlusionBuildPyramid(buffer);
+  return 1;
+}
+
+void occlusionFree(OcclusionBuffer *buffer) {
+  free(buffer->depth[0]);
+  memset(buffer, 0, sizeof(*buffer));
+}
+
+void occlusionClear(OcclusionBuffer *buffer) {
+  for (size_t i = 0; i < (size_t)OCCLUSION_WIDTH * OCCLUSION_HEIGHT; ++i) {
+    buffer->depth[0][i] = 1.0f;
+  }
+}
+
+// comparisons rather than fminf and fmaxf, which are calls
+static float minf(float a, float b) {
+  return a < b ? a : b;
+}
+
+static float maxf(float a, float b) {
+  return a > b ? a : b;
+}
+
+static float min3(float a, float b, float c) {
+  return minf(minf(a, b), c);
+}
+
+static float max3(float a, float b, float c) {
+  return maxf(maxf(a, b), c);
+}
+
+void occlusionRasterize(OcclusionBuffer *buffer, mat4 mvp, const OccluderMesh *mesh) {
+  float *depth = buffer->depth[0];
+  for (uint32_t t = 0; t + 2 < mesh->indexCount; t += 3) {
+    float clip[3][4];
+    int behind = 0;
+    for (int k = 0; k < 3; ++k) {
+      const float *p = mesh->positions[mesh->indices[t + k]];
+      for (int r = 0; r < 4; ++r) {
+        clip[k][r] = mvp[0][r] * p[0] + mvp[1][r] * p[1] + mvp[2][r] * p[2] + mvp[3][r];
+      }
+      behind |= clip[k][3] <= OCCLUSION_MIN_W;
+    }
+    if (behind) {
+      continue;
+    }
+    float x[3], y[3], z[3];
+    for (int k = 0; k < 3; ++k) {
+      x[k] = (clip[k][0] / clip[k][3] * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+      y[k] = (clip[k][1] / clip[k][3] * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+      z[k] = clip[k][2] / clip[k][3];
+    }
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0.0f) {
+      continue;
+    }
+    // texels whose centers lie within the triangle's bounds
+    float minX = maxf(ceilf(min3(x[0], x[1], x[2]) - 0.5f), 0.0f);
+    float maxX = minf(floorf(max3(x[0], x[1], x[2]) - 0.5f), OCCLUSION_WIDTH - 1);
+    float minY = maxf(ceilf(min3(y[0], y[1], y[2]) - 0.5f), 0.0f);
+    float maxY = minf(floorf(max3(y[0], y[1], y[2]) - 0.5f), OCCLUSION_HEIGHT - 1);
+    if (minX > maxX || minY > maxY) {
+      continue;
+    }
+
+    // Edge k is the one facing vertex k; its function is that vertex's
+    // barycentric weight times the area. Both faces are drawn, so the
+    // weights are flipped for clockwise triangles to keep the inside
+    // positive. A texel is only written if the triangle covers all of it:
+    // each edge function, evaluated at the center, has to clear what it
+    // changes by over half a texel each way.
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    float stepX[3], stepY[3], row[3], inset[3];
+    for (int k = 0; k < 3; ++k) {
+      int i = (k + 1) % 3, j = (k + 2) % 3;
+      stepX[k] = -(y[j] - y[i]) * sign;
+      stepY[k] = (x[j] - x[i]) * sign;
+      row[k] = ((x[j] - x[i]) * (minY + 0.5f - y[i]) - (y[j] - y[i]) * (minX + 0.5f - x[i])) * sign;
+      inset[k] = 0.5f * (fabsf(stepX[k]) + fabsf(stepY[k]));
+    }
+    float invArea = sign / area;
+    // and the depth written is the farthest the triangle's plane gets over
+    // the texel, which cannot be past its farthest vertex
+    float depthX = (stepX[0] * z[0] + stepX[1] * z[1] + stepX[2] * z[2]) * invArea;
+    float depthY = (stepY[0] * z[0] + stepY[1] * z[1] + stepY[2] * z[2]) * invArea;
+    float depthInset = 0.5f * (fabsf(depthX) + fabsf(depthY));
+    float farthest = max3(z[0], z[1], z[2]);
+    for (int py = (int)minY; py <= (int)maxY; ++py) {
+      float e[3] = {row[0], row[1], row[2]};
+      float *line = depth + (size_t)py * OCCLUSION_WIDTH;
+      for (int px = (int)minX; px <= (int)maxX; ++px) {
+        if (e[0] >= inset[0] && e[1] >= inset[1] && e[2] >= inset[2]) {
+          float d = minf((e[0] * z[0] + e[1] * z[1] + e[2] * z[2]) * invArea + depthInset, farthest);
+          if (d < line[px]) {
+            line[px] = d;
+          }
+        }
+        for (int k = 0; k < 3; ++k) {
+          e[k] += stepX[k];
+        }
+      }
+      for (int k = 0; k < 3; ++k) {
+        row[k] += stepY[k];
+      }
+    }
+  }
+}
+
+void occlusionBuildPyramid(OcclusionBuffer *buffer) {
+  for (int level = 1; level < OCCLUSION_LEVELS; ++level) {
+    const float *src = buffer->depth[level - 1];
+    float *dst = buffer->depth[level];
+    int srcWidth = levelWidth(level - 1), srcHeight = levelHeight(level - 1);
+    int width = levelWidth(level), height = levelHeight(level);
+    for (int y = 0; y < height; ++y) {
+      // a side already down to 1 is not halved again
+      int y0 = srcHeight > 1 ? 2 * y : y, y1 = srcHeight > 1 ? 2 * y + 1 : y;
+      for (int x = 0; x < width; ++x) {
+        int x0 = srcWidth > 1 ? 2 * x : x, x1 = srcWidth > 1 ? 2 * x + 1 : x;
+        float far = maxf(maxf(src[y0 * srcWidth + x0], src[y0 * srcWidth + x1]),
+                         maxf(src[y1 * srcWidth + x0], src[y1 * srcWidth + x1]));
+        dst[y * width + x] = far;
+      }
+    }
+  }
+}
+
+// The texel of level 0 under NDC coordinate `v`, clamped to the buffer.
+static int texel(float v, int size) {
+  int i = (int)floorf((v * 0.5f + 0.5f) * size);
+  return i < 0 ? 0 : i >= size ? size - 1 : i;
+}
+
+int occlusionTestSphere(const OcclusionBuffer *buffer, mat4 vp, const float center[3], float radius) {
+  // the corners of the sphere's box are the center plus or minus each of
+  // the matrix's first three columns times the radius
+  float c[4], ax[4], ay[4], az[4];
+  for (int r = 0; r < 4; ++r) {
+    c[r] = vp[0][r] * center[0] + vp[1][r] * center[1] + vp[2][r] * center[2] + vp[3][r];
+    ax[r] = vp[0][r] * radius;
+    ay[r] = vp[1][r] * radius;
+    az[r] = vp[2][r] * radius;
+  }
+  float minX = INFINITY, maxX = -INFINITY, minY = INFINITY, maxY = -INFINITY, nearest = INFINITY;
+  for (int k = 0; k < 8; ++k) {
+    float p[4];
+    for (int r = 0; r < 4; ++r) {
+      p[r] = c[r] + (k & 1 ? ax[r] : -ax[r]) + (k & 2 ? ay[r] : -ay[r]) + (k & 4 ? az[r] : -az[r]);
+    }
+    if (p[3] <= OCCLUSION_MIN_W) {
+      return 1;
+    }
+    float inverseW = 1.0f / p[3];
+    float x = p[0] * inverseW, y = p[1] * inverseW, z = p[2] * inverseW;
+    minX = minf(minX, x);
+    maxX = maxf(maxX, x);
+    minY = minf(minY, y);
+    maxY = maxf(maxY, y);
+    nearest = minf(nearest, z);
+  }
+  if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f) {
+    return 1;
+  }
+
+  // the covered texels of level 0, then the level where they are at most 4x4
+  int x0 = texel(minX, OCCLUSION_WIDTH), x1 = texel(maxX, OCCLUSION_WIDTH);
+  int y0 = texel(minY, OCCLUSION_HEIGHT), y1 = texel(maxY, OCCLUSION_HEIGHT);
+  int level = 0;
+  while (level < OCCLUSION_LEVELS - 1 && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3)) {
+    level++;
+  }
+  int width = levelWidth(level);
+  const float *depth = buffer->depth[level];
+  for (int y = y0 >> level; y <= y1 >> level; ++y) {
+    for (int x = x0 >> level; x <= x1 >> level; ++x) {
+      if (depth[y * width + x] >= nearest) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+void occluderMeshFree(OccluderMesh *mesh) {
+  free(mesh->positions);
+  free(mesh->indices);
+  memset(mesh, 0, sizeof(*mesh));
+}
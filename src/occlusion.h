@@ -0,0 +1,61 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cglm/cglm.h>
+
+// Occlusion culling on the CPU: a few large occluders are rasterized into a
+// small depth buffer, which is reduced into a pyramid where each texel holds
+// the farthest depth of the four below it. An object is hidden if the
+// nearest point of its bounds is behind the farthest occluder depth over
+// the texels its screen rectangle covers; the pyramid level is picked so
+// that those are at most 4x4, which makes the test a handful of reads.
+//
+// The buffer covers the whole viewport whatever its aspect ratio. Depth is
+// NDC z, cleared to the far plane. Occluders are drawn conservatively: a
+// triangle only writes the texels it covers whole, at the farthest depth it
+// reaches over each, so a texel never claims to hide more than it does.
+// Small triangles cover few whole texels, and hide less for it.
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_LEVELS 9 // down to 1x1 from OCCLUSION_WIDTH
+// clip w below which a point counts as behind the camera
+#define OCCLUSION_MIN_W 1e-5f
+
+// Triangles in model space, drawn into the buffer as an occluder. They
+// have to lie inside what they stand for.
+typedef struct {
+  float (*positions)[3];
+  uint32_t vertexCount;
+  uint32_t *indices;
+  uint32_t indexCount;
+} OccluderMesh;
+
+typedef struct {
+  // level 0 is the rasterized depth, OCCLUSION_WIDTH x OCCLUSION_HEIGHT;
+  // each further level halves both sides, down to 1
+  float *depth[OCCLUSION_LEVELS];
+} OcclusionBuffer;
+
+int occlusionInit(OcclusionBuffer *buffer);
+void occlusionFree(OcclusionBuffer *buffer);
+
+void occlusionClear(OcclusionBuffer *buffer);
+
+// Draws the occluder's triangles into level 0, keeping the nearest depth.
+// Triangles reaching behind the camera are skipped rather than clipped,
+// which only ever hides less.
+void occlusionRasterize(OcclusionBuffer *buffer, mat4 modelViewProjection, const OccluderMesh *mesh);
+
+// Rebuilds the coarser levels from level 0.
+void occlusionBuildPyramid(OcclusionBuffer *buffer);
+
+// 0 if the sphere is certainly behind the occluders, 1 if it might be
+// visible. Spheres reaching behind the camera or off the buffer count as
+// visible, since frustum culling is the judge of those.
+int occlusionTestSphere(const OcclusionBuffer *buffer, mat4 viewProjection, const float center[3], float radius);
+
+void occluderMeshFree(OccluderMesh *mesh);
+
+#endif
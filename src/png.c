@@ -0,0 +1,305 @@
+#include "png.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomicfile.h"
+
+#define WINDOW_SIZE 32768
+#define HASH_BITS 15
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+// hash chain links followed per position; more finds longer matches, slower
+#define MAX_CHAIN 32
+
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  size_t capacity;
+  uint32_t bits; // pending, lowest first
+  int bitCount;
+  int failed;
+} Output;
+
+static void reserve(Output *out, size_t more) {
+  if (out->failed || out->size + more <= out->capacity) {
+    return;
+  }
+  size_t capacity = out->capacity ? out->capacity : 4096;
+  while (capacity < out->size + more) {
+    capacity *= 2;
+  }
+  unsigned char *data = realloc(out->data, capacity);
+  if (data == NULL) {
+    out->failed = 1;
+    return;
+  }
+  out->data = data;
+  out->capacity = capacity;
+}
+
+static void putBytes(Output *out, const void *bytes, size_t count) {
+  reserve(out, count);
+  if (!out->failed && count > 0) {
+    memcpy(out->data + out->size, bytes, count);
+    out->size += count;
+  }
+}
+
+static void put32(Output *out, uint32_t v) {
+  unsigned char bytes[4] = {v >> 24, v >> 16, v >> 8, v};
+  putBytes(out, bytes, 4);
+}
+
+// Deflate packs bits from the lowest up.
+static void putBits(Output *out, uint32_t value, int count) {
+  out->bits |= value << out->bitCount;
+  out->bitCount += count;
+  while (out->bitCount >= 8) {
+    unsigned char byte = (unsigned char)out->bits;
+    putBytes(out, &byte, 1);
+    out->bits >>= 8;
+    out->bitCount -= 8;
+  }
+}
+
+static void flushBits(Output *out) {
+  if (out->bitCount > 0) {
+    putBits(out, 0, 8 - out->bitCount);
+  }
+}
+
+// Huffman codes go out from their highest bit, so they are reversed first.
+static void putCode(Output *out, uint32_t code, int length) {
+  uint32_t reversed = 0;
+  for (int i = 0; i < length; ++i) {
+    reversed = (reversed << 1) | ((code >> i) & 1);
+  }
+  putBits(out, reversed, length);
+}
+
+// the fixed literal/length code of RFC 1951, 3.2.6
+static void putSymbol(Output *out, int symbol) {
+  if (symbol < 144) {
+    putCode(out, 0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    putCode(out, 0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    putCode(out, symbol - 256, 7);
+  } else {
+    putCode(out, 0xc0 + symbol - 280, 8);
+  }
+}
+
+static const uint16_t lengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[30] = {1,   2,   3,   4,    5,    7,    9,    13,   17,    25,    33,    49,    65,    97,    129,
+                                          193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                          6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static void putMatch(Output *out, int length, int distance) {
+  int l = 28;
+  while (lengthBase[l] > length) {
+    l--;
+  }
+  putSymbol(out, 257 + l);
+  putBits(out, length - lengthBase[l], lengthExtra[l]);
+  int d = 29;
+  while (distanceBase[d] > distance) {
+    d--;
+  }
+  putCode(out, d, 5);
+  putBits(out, distance - distanceBase[d], distanceExtra[d]);
+}
+
+static uint32_t hash3(const unsigned char *p) {
+  return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// A zlib stream of one fixed Huffman block.
+static void deflate(Output *out, const unsigned char *data, size_t size) {
+  int32_t *head = malloc(sizeof(int32_t) << HASH_BITS);
+  int32_t *prev = malloc(sizeof(int32_t) * WINDOW_SIZE);
+  if (head == NULL || prev == NULL) {
+    out->failed = 1;
+    free(head);
+    free(prev);
+    return;
+  }
+  memset(head, 0xff, sizeof(int32_t) << HASH_BITS);
+
+  putBytes(out, "\x78\x01", 2);
+  putBits(out, 1, 1); // last block
+  putBits(out, 1, 2); // fixed codes
+  size_t i = 0;
+  while (i < size) {
+    int bestLength = 0, bestDistance = 0;
+    if (i + MIN_MATCH <= size) {
+      uint32_t h = hash3(data + i);
+      int32_t candidate = head[h];
+      size_t limit = size - i < MAX_MATCH ? size - i : MAX_MATCH;
+      for (int chain = 0; candidate >= 0 && i - (size_t)candidate <= WINDOW_SIZE && chain < MAX_CHAIN; ++chain) {
+        const unsigned char *a = data + candidate, *b = data + i;
+        if (a[bestLength] == b[bestLength]) {
+          int length = 0;
+          while ((size_t)length < limit && a[length] == b[length]) {
+            length++;
+          }
+          if (length > bestLength) {
+            bestLength = length;
+            bestDistance = (int)(i - (size_t)candidate);
+            if ((size_t)length == limit) {
+              break;
+            }
+          }
+        }
+        candidate = prev[candidate % WINDOW_SIZE];
+      }
+    }
+    size_t advance = bestLength >= MIN_MATCH ? (size_t)bestLength : 1;
+    if (bestLength >= MIN_MATCH) {
+      putMatch(out, bestLength, bestDistance);
+    } else {
+      putSymbol(out, data[i]);
+    }
+    // every position passed over goes into the chains
+    for (size_t end = i + advance; i < end; ++i) {
+      if (i + MIN_MATCH <= size) {
+        uint32_t h = hash3(data + i);
+        prev[i % WINDOW_SIZE] = head[h];
+        head[h] = (int32_t)i;
+      }
+    }
+  }
+  putSymbol(out, 256);
+  flushBits(out);
+
+  uint32_t a = 1, b = 0;
+  for (size_t j = 0; j < size; ++j) {
+    a = (a + data[j]) % 65521;
+    b = (b + a) % 65521;
+  }
+  put32(out, b << 16 | a);
+  free(head);
+  free(prev);
+}
+
+// filled once, since several frames can be encoded at a time
+static uint32_t crcTable[256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+
+static void initCrcTable(void) {
+  for (uint32_t n = 0; n < 256; ++n) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; ++k) {
+      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    }
+    crcTable[n] = c;
+  }
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char *data, size_t size) {
+  pthread_once(&crcTableOnce, initCrcTable);
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void putChunk(Output *out, const char *type, const unsigned char *data, size_t size) {
+  put32(out, (uint32_t)size);
+  size_t start = out->size;
+  putBytes(out, type, 4);
+  putBytes(out, data, size);
+  put32(out, out->failed ? 0 : crc32(0, out->data + start, size + 4));
+}
+
+static int paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// Filters `row` against `above` (NULL for the first row) with `filter`.
+static void filterRow(int filter, const unsigned char *row, const unsigned char *above, int bpp, size_t length,
+                      unsigned char *dst) {
+  for (size_t x = 0; x < length; ++x) {
+    int a = x >= (size_t)bpp ? row[x - bpp] : 0;
+    int b = above ? above[x] : 0;
+    int c = above && x >= (size_t)bpp ? above[x - bpp] : 0;
+    int predicted = filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : filter == 4 ? paeth(a, b, c) : 0;
+    dst[x] = (unsigned char)(row[x] - predicted);
+  }
+}
+
+unsigned char *pngEncode(const unsigned char *pixels, int width, int height, int channels, size_t stride,
+                         size_t *size) {
+  size_t length = (size_t)width * channels;
+  unsigned char *filtered = malloc((length + 1) * height);
+  unsigned char *trial = malloc(length);
+  if (filtered == NULL || trial == NULL) {
+    free(filtered);
+    free(trial);
+    return NULL;
+  }
+  for (int y = 0; y < height; ++y) {
+    const unsigned char *row = pixels + y * stride;
+    const unsigned char *above = y > 0 ? row - stride : NULL;
+    unsigned char *dst = filtered + y * (length + 1);
+    unsigned long bestCost = ~0ul;
+    for (int filter = 0; filter < 5; ++filter) {
+      filterRow(filter, row, above, channels, length, trial);
+      unsigned long cost = 0;
+      for (size_t x = 0; x < length; ++x) {
+        cost += (unsigned long)abs((signed char)trial[x]);
+      }
+      if (cost < bestCost) {
+        bestCost = cost;
+        dst[0] = (unsigned char)filter;
+        memcpy(dst + 1, trial, length);
+      }
+    }
+  }
+  free(trial);
+
+  Output image = {0}, compressed = {0};
+  deflate(&compressed, filtered, (length + 1) * height);
+  free(filtered);
+
+  unsigned char header[13] = {width >> 24, width >> 16, width >> 8, width, height >> 24, height >> 16, height >> 8, height,
+                              8, channels == 4 ? 6 : 2, 0, 0, 0};
+  putBytes(&image, "\x89PNG\r\n\x1a\n", 8);
+  putChunk(&image, "IHDR", header, sizeof(header));
+  putChunk(&image, "IDAT", compressed.data, compressed.size);
+  putChunk(&image, "IEND", NULL, 0);
+  free(compressed.data);
+  if (image.failed || compressed.failed) {
+    free(image.data);
+    return NULL;
+  }
+  *size = image.size;
+  return image.data;
+}
+
+int pngWrite(const char *path, const unsigned char *pixels, int width, int height, int channels, size_t stride) {
+  size_t size;
+  unsigned char *png = pngEncode(pixels, width, height, channels, stride, &size);
+  AtomicFile f;
+  atomicFileOpen(&f, path);
+  if (png) {
+    atomicFileWrite(&f, png, size);
+  }
+  int ok = atomicFileClose(&f, png != NULL);
+  if (!ok) {
+    fprintf(stderr, "%s: could not be written\n", path);
+  }
+  free(png);
+  return ok;
+}
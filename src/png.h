@@ -0,0 +1,20 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <stddef.h>
+
+// A PNG encoder for 8-bit RGB and RGBA images, for frame captures. Each row
+// gets the filter with the smallest sum of absolute differences, and the
+// result is deflated with the fixed Huffman codes and greedy hash chain
+// matching: far from the smallest files, but fast, and with no dependency.
+
+// Encodes `height` rows of `width` pixels of `channels` (3 or 4) bytes,
+// `stride` bytes apart, top row first. Returns the file's bytes, to be
+// freed, and their count through *size, or NULL if memory ran out.
+unsigned char *pngEncode(const unsigned char *pixels, int width, int height, int channels, size_t stride,
+                         size_t *size);
+
+// Encodes and writes to `path`.
+int pngWrite(const char *path, const unsigned char *pixels, int width, int height, int channels, size_t stride);
+
+#endif
@@ -0,0 +1,156 @@
+#include "reflect.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int reflectProgram(ProgramReflection *reflection, unsigned int program) {
+  memset(reflection, 0, sizeof(*reflection));
+  reflection->program = program;
+
+  GLint uniformCount = 0, blockCount = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+  reflection->uniforms = calloc(uniformCount ? uniformCount : 1, sizeof(UniformInfo));
+  reflection->blocks = calloc(blockCount ? blockCount : 1, sizeof(UniformBlockInfo));
+  if (reflection->uniforms == NULL || reflection->blocks == NULL) {
+    reflectionFree(reflection);
+    return 0;
+  }
+
+  for (GLint i = 0; i < uniformCount; ++i) {
+    UniformInfo *info = &reflection->uniforms[i];
+    GLuint index = (GLuint)i;
+    glGetActiveUniform(program, index, sizeof(info->name), NULL, &info->size, &info->type, info->name);
+    glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &info->blockIndex);
+    glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &info->offset);
+    // block members have no location, only an offset
+    info->location = info->blockIndex == -1 ? glGetUniformLocation(program, info->name) : -1;
+    char *bracket = strchr(info->name, '[');
+    if (bracket) {
+      *bracket = 0;
+    }
+  }
+  reflection->uniformCount = (size_t)uniformCount;
+
+  for (GLint i = 0; i < blockCount; ++i) {
+    UniformBlockInfo *block = &reflection->blocks[i];
+    block->index = (GLuint)i;
+    glGetActiveUniformBlockName(program, block->index, sizeof(block->name), NULL, block->name);
+    glGetActiveUniformBlockiv(program, block->index, GL_UNIFORM_BLOCK_DATA_SIZE, &block->dataSize);
+  }
+  reflection->blockCount = (size_t)blockCount;
+  return 1;
+}
+
+void reflectionFree(ProgramReflection *reflection) {
+  free(reflection->uniforms);
+  free(reflection->blocks);
+  memset(reflection, 0, sizeof(*reflection));
+}
+
+const UniformInfo *reflectionUniform(const ProgramReflection *reflection, const char *name) {
+  for (size_t i = 0; i < reflection->uniformCount; ++i) {
+    if (strcmp(reflection->uniforms[i].name, name) == 0) {
+      return &reflection->uniforms[i];
+    }
+  }
+  return NULL;
+}
+
+const UniformBlockInfo *reflectionBlock(const ProgramReflection *reflection, const char *name) {
+  for (size_t i = 0; i < reflection->blockCount; ++i) {
+    if (strcmp(reflection->blocks[i].name, name) == 0) {
+      return &reflection->blocks[i];
+    }
+  }
+  return NULL;
+}
+
+int reflectionBindBlock(const ProgramReflection *reflection, const char *name, GLuint binding) {
+  const UniformBlockInfo *block = reflectionBlock(reflection, name);
+  if (block == NULL) {
+    return 0;
+  }
+  glUniformBlockBinding(reflection->program, block->index, binding);
+  return 1;
+}
+
+static void setFloat(GLint location, GLsizei count, const void *data) { glUniform1fv(location, count, data); }
+static void setVec2(GLint location, GLsizei count, const void *data) { glUniform2fv(location, count, data); }
+static void setVec3(GLint location, GLsizei count, const void *data) { glUniform3fv(location, count, data); }
+static void setVec4(GLint location, GLsizei count, const void *data) { glUniform4fv(location, count, data); }
+static void setInt(GLint location, GLsizei count, const void *data) { glUniform1iv(location, count, data); }
+static void setIvec2(GLint location, GLsizei count, const void *data) { glUniform2iv(location, count, data); }
+static void setIvec3(GLint location, GLsizei count, const void *data) { glUniform3iv(location, count, data); }
+static void setIvec4(GLint location, GLsizei count, const void *data) { glUniform4iv(location, count, data); }
+static void setUint(GLint location, GLsizei count, const void *data) { glUniform1uiv(location, count, data); }
+static void setMat3(GLint location, GLsizei count, const void *data) { glUniformMatrix3fv(location, count, GL_FALSE, data); }
+static void setMat4(GLint location, GLsizei count, const void *data) { glUniformMatrix4fv(location, count, GL_FALSE, data); }
+
+static UniformSetter setterFor(GLenum type) {
+  switch (type) {
+  case GL_FLOAT: return setFloat;
+  case GL_FLOAT_VEC2: return setVec2;
+  case GL_FLOAT_VEC3: return setVec3;
+  case GL_FLOAT_VEC4: return setVec4;
+  // booleans and samplers are set as ints
+  case GL_INT:
+  case GL_BOOL:
+  case GL_SAMPLER_2D:
+  case GL_SAMPLER_3D:
+  case GL_SAMPLER_CUBE:
+  case GL_SAMPLER_2D_ARRAY:
+  case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+    return setInt;
+  case GL_INT_VEC2: return setIvec2;
+  case GL_INT_VEC3: return setIvec3;
+  case GL_INT_VEC4: return setIvec4;
+  case GL_UNSIGNED_INT: return setUint;
+  case GL_FLOAT_MAT3: return setMat3;
+  case GL_FLOAT_MAT4: return setMat4;
+  default: return NULL;
+  }
+}
+
+int uniformLayoutInit(UniformLayout *layout, const ProgramReflection *reflection,
+                      const UniformField *fields, size_t fieldCount) {
+  layout->count = 0;
+  layout->bindings = calloc(fieldCount ? fieldCount : 1, sizeof(UniformBinding));
+  if (layout->bindings == NULL) {
+    return 0;
+  }
+  for (size_t i = 0; i < fieldCount; ++i) {
+    const UniformInfo *info = reflectionUniform(reflection, fields[i].name);
+    if (info == NULL || info->location == -1) {
+      // optimized out, or not used by this permutation
+      continue;
+    }
+    UniformSetter set = setterFor(info->type);
+    if (info->type != fields[i].type || set == NULL) {
+      fprintf(stderr, "uniform %s: type 0x%x does not match the field's 0x%x\n", fields[i].name, info->type, fields[i].type);
+      uniformLayoutFree(layout);
+      return 0;
+    }
+    UniformBinding *binding = &layout->bindings[layout->count++];
+    binding->location = info->location;
+    binding->count = fields[i].count < info->size ? fields[i].count : info->size;
+    binding->offset = fields[i].offset;
+    binding->set = set;
+  }
+  return 1;
+}
+
+void uniformLayoutFree(UniformLayout *layout) {
+  free(layout->bindings);
+  layout->bindings = NULL;
+  layout->count = 0;
+}
+
+void uniformLayoutApply(const UniformLayout *layout, const void *params) {
+  const unsigned char *base = params;
+  for (size_t i = 0; i < layout->count; ++i) {
+    const UniformBinding *binding = &layout->bindings[i];
+    binding->set(binding->location, binding->count, base + binding->offset);
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef REFLECT_H
+#define REFLECT_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+// What a linked program says about its uniforms, read once after linking so
+// that nothing is looked up by name afterwards.
+typedef struct {
+  char name[64];    // without the "[0]" of arrays
+  GLint location;   // -1 for members of a uniform block
+  GLenum type;
+  GLint size;       // number of array elements, 1 otherwise
+  GLint blockIndex; // -1 for plain uniforms
+  GLint offset;     // byte offset inside the block, -1 for plain uniforms
+} UniformInfo;
+
+typedef struct {
+  char name[64];
+  GLuint index;
+  GLint dataSize;
+} UniformBlockInfo;
+
+typedef struct {
+  unsigned int program;
+  UniformInfo *uniforms;
+  size_t uniformCount;
+  UniformBlockInfo *blocks;
+  size_t blockCount;
+} ProgramReflection;
+
+int reflectProgram(ProgramReflection *reflection, unsigned int program);
+void reflectionFree(ProgramReflection *reflection);
+
+const UniformInfo *reflectionUniform(const ProgramReflection *reflection, const char *name);
+const UniformBlockInfo *reflectionBlock(const ProgramReflection *reflection, const char *name);
+
+// Points the named block at a uniform buffer binding. Returns 0 if the
+// program has no such block, e.g. when a permutation compiled it out.
+int reflectionBindBlock(const ProgramReflection *reflection, const char *name, GLuint binding);
+
+// One field of a parameter struct, bound to the uniform of the same name.
+typedef struct {
+  const char *name;
+  GLenum type;   // GL type the field holds, e.g. GL_FLOAT_VEC4 or GL_SAMPLER_2D
+  size_t offset; // offsetof the field in the struct
+  GLsizei count; // array elements in the field
+} UniformField;
+
+typedef void (*UniformSetter)(GLint location, GLsizei count, const void *data);
+
+typedef struct {
+  GLint location;
+  GLsizei count;
+  size_t offset;
+  UniformSetter set;
+} UniformBinding;
+
+// The fields of a parameter struct that a program actually uses, each with
+// its location and a setter picked for its type up front, so applying the
+// struct is a straight walk over the bindings.
+typedef struct {
+  UniformBinding *bindings;
+  size_t count;
+} UniformLayout;
+
+// Fields the program does not use are left out. Returns 0 and prints the
+// field if its type does not match the uniform's.
+int uniformLayoutInit(UniformLayout *layout, const ProgramReflection *reflection,
+                      const UniformField *fields, size_t fieldCount);
+void uniformLayoutFree(UniformLayout *layout);
+
+// Sets every bound field from `params`. The program must be current.
+void uniformLayoutApply(const UniformLayout *layout, const void *params);
+
+#endif
@@ -0,0 +1,113 @@
+#include "ringbuffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the ring only ever binds itself here, so it does not disturb the
+// GL_ARRAY_BUFFER or GL_UNIFORM_BUFFER bindings of the caller
+#define RING_TARGET GL_COPY_WRITE_BUFFER
+
+int ringBufferInit(RingBuffer *ring, size_t frameSize) {
+  memset(ring, 0, sizeof(*ring));
+  // keep every region start aligned for any use of the buffer
+  ring->regionSize = (frameSize + 255) & ~(size_t)255;
+  ring->region = RING_FRAMES - 1;
+  size_t size = ring->regionSize * RING_FRAMES;
+
+  glGenBuffers(1, &ring->buffer);
+  glBindBuffer(RING_TARGET, ring->buffer);
+  if (GLAD_GL_ARB_buffer_storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(RING_TARGET, size, NULL, flags);
+    ring->mapped = glMapBufferRange(RING_TARGET, 0, size, flags);
+    ring->persistent = ring->mapped != NULL;
+    if (!ring->persistent) {
+      // immutable storage cannot be respecified, start over with a new name
+      glDeleteBuffers(1, &ring->buffer);
+      glGenBuffers(1, &ring->buffer);
+      glBindBuffer(RING_TARGET, ring->buffer);
+    }
+  }
+  if (!ring->persistent) {
+    glBufferData(RING_TARGET, size, NULL, GL_STREAM_DRAW);
+  }
+  glBindBuffer(RING_TARGET, 0);
+  return ring->buffer != 0;
+}
+
+void ringBufferFree(RingBuffer *ring) {
+  for (int i = 0; i < RING_FRAMES; ++i) {
+    if (ring->fences[i]) {
+      glDeleteSync(ring->fences[i]);
+    }
+  }
+  if (ring->persistent) {
+    glBindBuffer(RING_TARGET, ring->buffer);
+    glUnmapBuffer(RING_TARGET);
+    glBindBuffer(RING_TARGET, 0);
+  }
+  glDeleteBuffers(1, &ring->buffer);
+  memset(ring, 0, sizeof(*ring));
+}
+
+void ringBufferBegin(RingBuffer *ring) {
+  // everything submitted so far may read the region we are leaving
+  if (ring->fences[ring->region]) {
+    glDeleteSync(ring->fences[ring->region]);
+  }
+  ring->fences[ring->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  ring->region = (ring->region + 1) % RING_FRAMES;
+  ring->offset = 0;
+  GLsync fence = ring->fences[ring->region];
+
+  if (ring->persistent) {
+    // the mapping never goes away, so the only option is to wait
+    GLenum status = GL_ALREADY_SIGNALED;
+    if (fence) {
+      while ((status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000)) == GL_TIMEOUT_EXPIRED)
+        ;
+    }
+    // the fence says nothing, so make sure of it the slow way
+    if (status == GL_WAIT_FAILED) {
+      fprintf(stderr, "ring buffer: waiting for the GPU failed, finishing instead\n");
+      glFinish();
+    }
+    return;
+  }
+
+  glBindBuffer(RING_TARGET, ring->buffer);
+  GLenum status = fence ? glClientWaitSync(fence, 0, 0) : GL_ALREADY_SIGNALED;
+  if (status == GL_WAIT_FAILED) {
+    fprintf(stderr, "ring buffer: waiting for the GPU failed\n");
+  }
+  if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+    // Still in use, or maybe: orphan the storage instead of stalling. The
+    // driver hands us fresh memory and frees the old one once the GPU is
+    // done with it.
+    glBufferData(RING_TARGET, ring->regionSize * RING_FRAMES, NULL, GL_STREAM_DRAW);
+  }
+  ring->mapped = glMapBufferRange(RING_TARGET, ring->region * ring->regionSize, ring->regionSize,
+                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+  glBindBuffer(RING_TARGET, 0);
+}
+
+void *ringBufferAlloc(RingBuffer *ring, size_t size, size_t alignment, size_t *offset) {
+  size_t start = (ring->offset + alignment - 1) & ~(alignment - 1);
+  if (ring->mapped == NULL || start + size > ring->regionSize) {
+    return NULL;
+  }
+  ring->offset = start + size;
+  *offset = ring->region * ring->regionSize + start;
+  return ring->persistent ? ring->mapped + *offset : ring->mapped + start;
+}
+
+void ringBufferCommit(RingBuffer *ring) {
+  if (ring->persistent || ring->mapped == NULL) {
+    return;
+  }
+  glBindBuffer(RING_TARGET, ring->buffer);
+  glUnmapBuffer(RING_TARGET);
+  glBindBuffer(RING_TARGET, 0);
+  ring->mapped = NULL;
+}
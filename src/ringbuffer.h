@@ -0,0 +1,43 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+// frames the CPU may run ahead of the GPU before it has to wait
+#define RING_FRAMES 3
+
+// One buffer object split into RING_FRAMES regions, used round-robin for data
+// that is rewritten every frame: uniform blocks, instance attributes and
+// transient vertices. A fence per region keeps the CPU from overwriting data
+// the GPU has not consumed yet.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistently and
+// coherently, and allocations are plain pointer bumps. On plain GL 3.3 each
+// region is mapped unsynchronized at the start of the frame (or the buffer is
+// orphaned if its fence has not passed) and unmapped by ringBufferCommit.
+typedef struct {
+  unsigned int buffer;
+  int persistent;
+  size_t regionSize;
+  unsigned char *mapped;  // whole buffer when persistent, current region otherwise
+  unsigned int region;
+  size_t offset;
+  GLsync fences[RING_FRAMES];
+} RingBuffer;
+
+int ringBufferInit(RingBuffer *ring, size_t frameSize);
+void ringBufferFree(RingBuffer *ring);
+
+// Move on to the next region. Call once per frame, before any ringBufferAlloc.
+void ringBufferBegin(RingBuffer *ring);
+
+// Returns a write pointer for `size` bytes, and their offset into
+// ring->buffer through *offset, or NULL if the frame's region is full.
+// `alignment` must be a power of two.
+void *ringBufferAlloc(RingBuffer *ring, size_t size, size_t alignment, size_t *offset);
+
+// Make this frame's writes visible to GL. Call before drawing with them.
+void ringBufferCommit(RingBuffer *ring);
+
+#endif
@@ -0,0 +1,237 @@
+#include "shader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+
+#include "assetpack.h"
+
+// info log - for storing error messages, etc. Thread local so that shaders
+// can be built on a background context without clobbering the main thread's.
+_Thread_local char infoLog[512];
+
+char *readShaderSource(const char *path) {
+  Asset asset;
+  if (!assetRead(path, &asset)) {
+    fprintf(stderr, "%s: not found\n", path);
+    return NULL;
+  }
+  char *source = malloc(asset.size + 1);
+  if (source) {
+    memcpy(source, asset.data, asset.size);
+    source[asset.size] = 0;
+  }
+  assetRelease(&asset);
+  return source;
+}
+
+// anything nested deeper than this is taken to be an include cycle
+#define MAX_INCLUDE_DEPTH 16
+
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+} SourceBuffer;
+
+static int appendSource(SourceBuffer *out, const char *text, size_t length) {
+  if (out->length + length + 1 > out->capacity) {
+    size_t capacity = out->capacity ? out->capacity : 4096;
+    while (capacity < out->length + length + 1) {
+      capacity *= 2;
+    }
+    char *data = realloc(out->data, capacity);
+    if (data == NULL) {
+      return 0;
+    }
+    out->data = data;
+    out->capacity = capacity;
+  }
+  memcpy(out->data + out->length, text, length);
+  out->length += length;
+  out->data[out->length] = 0;
+  return 1;
+}
+
+// If `line` is the preprocessor directive `name`, returns what follows it.
+static const char *directive(const char *line, const char *name) {
+  while (*line == ' ' || *line == '\t') {
+    line++;
+  }
+  if (*line++ != '#') {
+    return NULL;
+  }
+  while (*line == ' ' || *line == '\t') {
+    line++;
+  }
+  size_t length = strlen(name);
+  if (strncmp(line, name, length) != 0 || (line[length] != ' ' && line[length] != '\t' && line[length] != '"')) {
+    return NULL;
+  }
+  return line + length;
+}
+
+static int expandIncludes(SourceBuffer *out, const char *path, int depth) {
+  if (depth > MAX_INCLUDE_DEPTH) {
+    fprintf(stderr, "%s: includes nested too deeply\n", path);
+    return 0;
+  }
+  char *source = readShaderSource(path);
+  if (source == NULL) {
+    return 0;
+  }
+  int ok = 1;
+  for (const char *line = source; *line && ok; ) {
+    const char *end = strchr(line, '\n');
+    size_t length = end ? (size_t)(end - line) + 1 : strlen(line);
+    const char *rest = directive(line, "include");
+    if (rest == NULL) {
+      ok = appendSource(out, line, length);
+      line += length;
+      continue;
+    }
+
+    // #include "file", relative to the directory of this file
+    const char *name = strchr(rest, '"');
+    const char *nameEnd = name ? strchr(name + 1, '"') : NULL;
+    if (nameEnd == NULL || (end && nameEnd > end)) {
+      fprintf(stderr, "%s: malformed #include\n", path);
+      ok = 0;
+      break;
+    }
+    name++;
+    char includePath[MAXPATHLEN];
+    const char *slash = strrchr(path, '/');
+    int dirLength = slash ? (int)(slash - path) + 1 : 0;
+    snprintf(includePath, sizeof(includePath), "%.*s%.*s", dirLength, path, (int)(nameEnd - name), name);
+    ok = expandIncludes(out, includePath, depth + 1);
+    // the included file might not end with a newline
+    if (ok && out->length > 0 && out->data[out->length - 1] != '\n') {
+      ok = appendSource(out, "\n", 1);
+    }
+    line += length;
+  }
+  free(source);
+  return ok;
+}
+
+char *preprocessShader(const char *path, const ShaderDefine *defines, size_t defineCount) {
+  SourceBuffer expanded = {0};
+  if (!expandIncludes(&expanded, path, 0) || expanded.data == NULL) {
+    free(expanded.data);
+    return NULL;
+  }
+
+  // #version must come before anything but comments, so the defines go
+  // right after it
+  size_t split = 0;
+  for (const char *line = expanded.data; *line; ) {
+    const char *end = strchr(line, '\n');
+    size_t length = end ? (size_t)(end - line) + 1 : strlen(line);
+    if (directive(line, "version")) {
+      split = (size_t)(line - expanded.data) + length;
+      break;
+    }
+    line += length;
+  }
+
+  SourceBuffer out = {0};
+  int ok = appendSource(&out, expanded.data, split);
+  if (ok && split > 0 && out.data[split - 1] != '\n') {
+    ok = appendSource(&out, "\n", 1);
+  }
+  for (size_t i = 0; i < defineCount && ok; ++i) {
+    char line[256];
+    int length = snprintf(line, sizeof(line), "#define %s%s%s\n", defines[i].name,
+                          defines[i].value ? " " : "", defines[i].value ? defines[i].value : "");
+    ok = length > 0 && (size_t)length < sizeof(line) && appendSource(&out, line, (size_t)length);
+  }
+  ok = ok && appendSource(&out, expanded.data + split, expanded.length - split);
+  free(expanded.data);
+  if (!ok) {
+    fprintf(stderr, "%s: could not preprocess\n", path);
+    free(out.data);
+    return NULL;
+  }
+  return out.data;
+}
+
+static void reportBuildErrors(ProgramBuild *build) {
+  unsigned int shaders[2] = {build->vertexShader, build->fragmentShader};
+  const char *stages[2] = {"vertex", "fragment"};
+  for (int i = 0; i < 2; ++i) {
+    int compiled;
+    glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+      glGetShaderInfoLog(shaders[i], sizeof(infoLog), NULL, infoLog);
+      fprintf(stderr, "%s: %s shader could not be made: %s\n", build->name, stages[i], infoLog);
+    }
+  }
+  glGetProgramInfoLog(build->program, sizeof(infoLog), NULL, infoLog);
+  fprintf(stderr, "%s: shader program could not be made: %s\n", build->name, infoLog);
+}
+
+int buildShaderPrograms(ProgramBuild *builds, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    ProgramBuild *b = &builds[i];
+    b->vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(b->vertexShader, 1, &b->vertexSource, NULL);
+    glCompileShader(b->vertexShader);
+    b->fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(b->fragmentShader, 1, &b->fragmentSource, NULL);
+    glCompileShader(b->fragmentShader);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    ProgramBuild *b = &builds[i];
+    b->program = glCreateProgram();
+    if (GLAD_GL_ARB_get_program_binary) {
+      // lets the program cache save the linked binary to disk
+      glProgramParameteri(b->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glAttachShader(b->program, b->vertexShader);
+    glAttachShader(b->program, b->fragmentShader);
+    glLinkProgram(b->program);
+    b->linked = -1;
+  }
+
+  // Without the extension the first status query simply blocks until that
+  // program is done, while the rest keep compiling behind it.
+  size_t pending = count;
+  while (pending > 0) {
+    for (size_t i = 0; i < count; ++i) {
+      ProgramBuild *b = &builds[i];
+      if (b->linked != -1) {
+        continue;
+      }
+      if (GLAD_GL_KHR_parallel_shader_compile) {
+        int done;
+        glGetProgramiv(b->program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) {
+          continue;
+        }
+      }
+      glGetProgramiv(b->program, GL_LINK_STATUS, &b->linked);
+      if (!b->linked) {
+        reportBuildErrors(b);
+      }
+      pending--;
+    }
+    if (pending > 0) {
+      usleep(100);
+    }
+  }
+
+  int ok = 1;
+  for (size_t i = 0; i < count; ++i) {
+    ProgramBuild *b = &builds[i];
+    glDetachShader(b->program, b->vertexShader);
+    glDetachShader(b->program, b->fragmentShader);
+    glDeleteShader(b->vertexShader);
+    glDeleteShader(b->fragmentShader);
+    b->vertexShader = b->fragmentShader = 0;
+    ok = ok && b->linked;
+  }
+  return ok;
+}
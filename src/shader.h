@@ -0,0 +1,44 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+// error message of the last failed shader compile or link on this thread
+extern _Thread_local char infoLog[512];
+
+// Whole file as a NUL terminated string to be freed by the caller, or NULL.
+// Comes from the mounted asset pack if it has the file (see assetpack.h).
+char *readShaderSource(const char *path);
+
+// A `#define name value` injected by preprocessShader; `value` may be NULL.
+typedef struct {
+  const char *name;
+  const char *value;
+} ShaderDefine;
+
+// Reads a shader and expands `#include "file"` lines, resolved relative to
+// the file containing them. The defines go right after the `#version` line,
+// so a single source can be specialized (#ifdef, constants) without copies.
+// Returns a string to be freed by the caller, or NULL if a file is missing.
+char *preprocessShader(const char *path, const ShaderDefine *defines, size_t defineCount);
+
+// One program for buildShaderPrograms. `name` is only used in error messages.
+typedef struct {
+  const char *name;
+  const char *vertexSource;
+  const char *fragmentSource;
+  unsigned int program;
+  int linked;
+  unsigned int vertexShader;
+  unsigned int fragmentShader;
+} ProgramBuild;
+
+// Compile and link several programs, submitting every compile and link before
+// asking for any status. Asking right away makes the driver finish each one
+// in turn; this way drivers with compiler threads can overlap them. With
+// KHR_parallel_shader_compile, programs are collected as they complete.
+// Errors are printed to stderr. Returns 1 if every program linked.
+int buildShaderPrograms(ProgramBuild *builds, size_t count);
+
+#endif
@@ -0,0 +1,224 @@
+#include "shadercache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include "atomicfile.h"
+#include "hash.h"
+
+// prefix of every saved program binary
+#define BINARY_MAGIC "GLPB"
+
+typedef struct {
+  char magic[4];
+  uint32_t format;
+  uint32_t length;
+} BinaryHeader;
+
+typedef struct {
+  uint64_t key;
+  char *source;
+} SourceEntry;
+
+typedef struct {
+  uint64_t key;
+  unsigned int program;
+} ProgramEntry;
+
+// A scene only uses a handful of permutations, so plain arrays searched
+// front to back are plenty.
+struct ShaderCache {
+  char binaryDir[MAXPATHLEN]; // empty when binaries are not saved
+  uint64_t driverHash;
+  SourceEntry *sources;
+  size_t sourceCount;
+  size_t sourceCapacity;
+  ProgramEntry *programs;
+  size_t programCount;
+  size_t programCapacity;
+};
+
+static int grow(void **array, size_t *capacity, size_t count, size_t size) {
+  if (count < *capacity) {
+    return 1;
+  }
+  size_t newCapacity = *capacity ? *capacity * 2 : 8;
+  void *grown = realloc(*array, newCapacity * size);
+  if (grown == NULL) {
+    return 0;
+  }
+  *array = grown;
+  *capacity = newCapacity;
+  return 1;
+}
+
+ShaderCache *shaderCacheCreate(const char *binaryDir) {
+  ShaderCache *cache = calloc(1, sizeof(ShaderCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  // a binary is only good for the driver that produced it
+  const char *strings[] = {
+    (const char *)glGetString(GL_VENDOR),
+    (const char *)glGetString(GL_RENDERER),
+    (const char *)glGetString(GL_VERSION),
+    (const char *)glGetString(GL_SHADING_LANGUAGE_VERSION),
+  };
+  cache->driverHash = HASH_SEED;
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+    cache->driverHash = hashString(cache->driverHash, strings[i]);
+  }
+
+  int formats = 0;
+  if (GLAD_GL_ARB_get_program_binary) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  }
+  if (binaryDir && formats > 0) {
+    if (mkdir(binaryDir, 0755) == 0 || errno == EEXIST) {
+      strncpy(cache->binaryDir, binaryDir, MAXPATHLEN - 1);
+    } else {
+      perror("mkdir");
+    }
+  }
+  return cache;
+}
+
+void shaderCacheDestroy(ShaderCache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < cache->sourceCount; ++i) {
+    free(cache->sources[i].source);
+  }
+  for (size_t i = 0; i < cache->programCount; ++i) {
+    glDeleteProgram(cache->programs[i].program);
+  }
+  free(cache->sources);
+  free(cache->programs);
+  free(cache);
+}
+
+void shaderCacheForgetSources(ShaderCache *cache) {
+  for (size_t i = 0; i < cache->sourceCount; ++i) {
+    free(cache->sources[i].source);
+  }
+  cache->sourceCount = 0;
+}
+
+const char *shaderCacheSource(ShaderCache *cache, const char *path, const ShaderDefine *defines, size_t defineCount) {
+  uint64_t key = hashString(HASH_SEED, path);
+  for (size_t i = 0; i < defineCount; ++i) {
+    key = hashString(hashString(key, defines[i].name), defines[i].value);
+  }
+  for (size_t i = 0; i < cache->sourceCount; ++i) {
+    if (cache->sources[i].key == key) {
+      return cache->sources[i].source;
+    }
+  }
+
+  if (!grow((void **)&cache->sources, &cache->sourceCapacity, cache->sourceCount, sizeof(SourceEntry))) {
+    return NULL;
+  }
+  char *source = preprocessShader(path, defines, defineCount);
+  if (source == NULL) {
+    return NULL;
+  }
+  cache->sources[cache->sourceCount++] = (SourceEntry){key, source};
+  return source;
+}
+
+static void binaryPath(ShaderCache *cache, uint64_t key, char *path) {
+  snprintf(path, MAXPATHLEN, "%s/%016llx.bin", cache->binaryDir, (unsigned long long)key);
+}
+
+static unsigned int loadBinary(ShaderCache *cache, uint64_t key) {
+  char path[MAXPATHLEN];
+  binaryPath(cache, key, path);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return 0;
+  }
+  BinaryHeader header;
+  void *binary = NULL;
+  unsigned int program = 0;
+  if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, BINARY_MAGIC, 4) == 0 &&
+      (binary = malloc(header.length)) != NULL && fread(binary, 1, header.length, file) == header.length) {
+    program = glCreateProgram();
+    glProgramBinary(program, header.format, binary, (GLsizei)header.length);
+    int linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+      // the driver was updated or the file is damaged; it gets rebuilt
+      glDeleteProgram(program);
+      program = 0;
+    }
+  }
+  free(binary);
+  fclose(file);
+  return program;
+}
+
+static void saveBinary(ShaderCache *cache, uint64_t key, unsigned int program) {
+  int length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  void *binary = length > 0 ? malloc(length) : NULL;
+  if (binary == NULL) {
+    return;
+  }
+  GLenum format;
+  glGetProgramBinary(program, length, NULL, &format, binary);
+  BinaryHeader header = {{'G', 'L', 'P', 'B'}, format, (uint32_t)length};
+
+  char path[MAXPATHLEN];
+  binaryPath(cache, key, path);
+  AtomicFile file;
+  atomicFileOpen(&file, path);
+  atomicFileWrite(&file, &header, sizeof(header));
+  atomicFileWrite(&file, binary, (size_t)length);
+  atomicFileClose(&file, 1);
+  free(binary);
+}
+
+unsigned int shaderCacheProgram(ShaderCache *cache, const char *vertexPath, const char *fragmentPath,
+                                const ShaderDefine *defines, size_t defineCount) {
+  const char *vertexSource = shaderCacheSource(cache, vertexPath, defines, defineCount);
+  const char *fragmentSource = shaderCacheSource(cache, fragmentPath, defines, defineCount);
+  if (vertexSource == NULL || fragmentSource == NULL) {
+    return 0;
+  }
+
+  // keyed by the preprocessed text rather than the file names, so that two
+  // define sets that come out the same share a program
+  uint64_t key = hashString(hashString(HASH_SEED, vertexSource), fragmentSource);
+  for (size_t i = 0; i < cache->programCount; ++i) {
+    if (cache->programs[i].key == key) {
+      return cache->programs[i].program;
+    }
+  }
+  if (!grow((void **)&cache->programs, &cache->programCapacity, cache->programCount, sizeof(ProgramEntry))) {
+    return 0;
+  }
+
+  uint64_t binaryKey = hashBytes(key, &cache->driverHash, sizeof(cache->driverHash));
+  unsigned int program = cache->binaryDir[0] ? loadBinary(cache, binaryKey) : 0;
+  if (program == 0) {
+    ProgramBuild build = {vertexPath, vertexSource, fragmentSource};
+    if (!buildShaderPrograms(&build, 1)) {
+      if (build.program) {
+        glDeleteProgram(build.program);
+      }
+      return 0;
+    }
+    program = build.program;
+    if (cache->binaryDir[0]) {
+      saveBinary(cache, binaryKey, program);
+    }
+  }
+  cache->programs[cache->programCount++] = (ProgramEntry){key, program};
+  return program;
+}
@@ -0,0 +1,32 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <stddef.h>
+
+#include "shader.h"
+
+// Hands out one linked program per shader permutation, that is per pair of
+// source files and set of defines. Within a process each permutation is
+// preprocessed and compiled once. With GL_ARB_get_program_binary, linked
+// programs are also saved under `binaryDir` and loaded from there by later
+// runs, so a permutation is only compiled once per machine and driver.
+typedef struct ShaderCache ShaderCache;
+
+// `binaryDir` may be NULL to keep everything in memory. Needs a current context.
+ShaderCache *shaderCacheCreate(const char *binaryDir);
+
+// Deletes every program handed out by the cache.
+void shaderCacheDestroy(ShaderCache *cache);
+
+// Drops the preprocessed sources, so that the files are read again once
+// they have changed. Programs already built stay, keyed by their text.
+void shaderCacheForgetSources(ShaderCache *cache);
+
+// Preprocessed source for a file and set of defines, owned by the cache.
+const char *shaderCacheSource(ShaderCache *cache, const char *path, const ShaderDefine *defines, size_t defineCount);
+
+// The program for a permutation, owned by the cache, or 0 if it does not build.
+unsigned int shaderCacheProgram(ShaderCache *cache, const char *vertexPath, const char *fragmentPath,
+                                const ShaderDefine *defines, size_t defineCount);
+
+#endif
@@ -0,0 +1,258 @@
+#include "shaderwatch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "shader.h"
+
+// how long to wait for an editor to finish writing before compiling
+#define SETTLE_USEC 50000
+// how often the stop flag (and, without inotify, the files) are checked
+#define POLL_MSEC 100
+
+struct ShaderWatch {
+  GLFWwindow *context;
+  pthread_t thread;
+  atomic_int quit;
+  char paths[2][MAXPATHLEN];
+  ShaderDefine *defines;
+  size_t defineCount;
+
+  // a linked program waiting to be picked up by shaderWatchPoll
+  pthread_mutex_t lock;
+  unsigned int ready;
+  GLsync readyFence;
+};
+
+static void rebuild(ShaderWatch *watch) {
+  char *vertexSource = preprocessShader(watch->paths[0], watch->defines, watch->defineCount);
+  char *fragmentSource = preprocessShader(watch->paths[1], watch->defines, watch->defineCount);
+  ProgramBuild build = {"shader reload", vertexSource, fragmentSource};
+  int linked = vertexSource && fragmentSource && buildShaderPrograms(&build, 1);
+  free(vertexSource);
+  free(fragmentSource);
+  if (!linked) {
+    if (build.program) {
+      glDeleteProgram(build.program);
+    }
+    fprintf(stderr, "Shader reload failed, keeping the current program\n");
+    return;
+  }
+
+  // the main context may only use the program once this context is done with it
+  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+  pthread_mutex_lock(&watch->lock);
+  if (watch->ready) {
+    // nobody picked up the previous one, it is stale now
+    glDeleteProgram(watch->ready);
+    glDeleteSync(watch->readyFence);
+  }
+  watch->ready = build.program;
+  watch->readyFence = fence;
+  pthread_mutex_unlock(&watch->lock);
+  printf("Shaders reloaded\n");
+}
+
+// Included files can change too, so any shader source next to the watched
+// ones triggers a rebuild.
+static int isShaderFile(const char *name) {
+  const char *dot = strrchr(name, '.');
+  return dot && (strcmp(dot, ".vert") == 0 || strcmp(dot, ".frag") == 0 || strcmp(dot, ".glsl") == 0);
+}
+
+#ifdef __linux__
+static int waitForChange(ShaderWatch *watch, int fd) {
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd pfd = {fd, POLLIN, 0};
+  int changed = 0;
+  while (!changed && !atomic_load(&watch->quit)) {
+    if (poll(&pfd, 1, POLL_MSEC) <= 0) {
+      continue;
+    }
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (char *p = buffer; p < buffer + len; ) {
+        struct inotify_event *event = (struct inotify_event *)p;
+        if (event->len && isShaderFile(event->name)) {
+          changed = 1;
+        }
+        p += sizeof(struct inotify_event) + event->len;
+      }
+    }
+  }
+  return changed;
+}
+#else
+// latest modification time of the shader sources in the watched directories
+static struct timespec newestChange(ShaderWatch *watch) {
+  struct timespec newest = {0, 0};
+  for (int i = 0; i < 2; ++i) {
+    char dir[MAXPATHLEN];
+    strncpy(dir, watch->paths[i], sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = 0;
+    char *dirPath = dirname(dir);
+    DIR *d = opendir(dirPath);
+    if (d == NULL) {
+      continue;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+      char path[MAXPATHLEN];
+      struct stat st;
+      snprintf(path, sizeof(path), "%s/%s", dirPath, entry->d_name);
+      if (isShaderFile(entry->d_name) && stat(path, &st) == 0 &&
+          (st.st_mtimespec.tv_sec > newest.tv_sec ||
+           (st.st_mtimespec.tv_sec == newest.tv_sec && st.st_mtimespec.tv_nsec > newest.tv_nsec))) {
+        newest = st.st_mtimespec;
+      }
+    }
+    closedir(d);
+  }
+  return newest;
+}
+
+static int waitForChange(ShaderWatch *watch, struct timespec *mtime) {
+  while (!atomic_load(&watch->quit)) {
+    usleep(POLL_MSEC * 1000);
+    struct timespec newest = newestChange(watch);
+    if (newest.tv_sec != mtime->tv_sec || newest.tv_nsec != mtime->tv_nsec) {
+      *mtime = newest;
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif
+
+static void *watchMain(void *arg) {
+  ShaderWatch *watch = arg;
+  glfwMakeContextCurrent(watch->context);
+  if (GLAD_GL_KHR_parallel_shader_compile) {
+    // let the driver use as many compiler threads as it likes
+    glMaxShaderCompilerThreadsKHR(0xffffffffu);
+  }
+
+#ifdef __linux__
+  // watch the directories rather than the files: editors often save by
+  // writing a new file and renaming it over the old one
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  for (int i = 0; i < 2 && fd >= 0; ++i) {
+    char dir[MAXPATHLEN];
+    strncpy(dir, watch->paths[i], sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = 0;
+    inotify_add_watch(fd, dirname(dir), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  }
+  if (fd < 0) {
+    perror("inotify_init1");
+  }
+  while (fd >= 0 && waitForChange(watch, fd)) {
+    usleep(SETTLE_USEC);
+    // drop the events caused by the rest of the save
+    char drain[4096];
+    while (read(fd, drain, sizeof(drain)) > 0)
+      ;
+    rebuild(watch);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+#else
+  struct timespec mtime = newestChange(watch);
+  while (waitForChange(watch, &mtime)) {
+    usleep(SETTLE_USEC);
+    rebuild(watch);
+  }
+#endif
+
+  glfwMakeContextCurrent(NULL);
+  return NULL;
+}
+
+static void freeWatch(ShaderWatch *watch) {
+  for (size_t i = 0; i < watch->defineCount; ++i) {
+    free((char *)watch->defines[i].name);
+    free((char *)watch->defines[i].value);
+  }
+  free(watch->defines);
+  pthread_mutex_destroy(&watch->lock);
+  free(watch);
+}
+
+ShaderWatch *shaderWatchStart(GLFWwindow *window, const char *vertexPath, const char *fragmentPath,
+                              const ShaderDefine *defines, size_t defineCount) {
+  ShaderWatch *watch = calloc(1, sizeof(ShaderWatch));
+  if (watch == NULL) {
+    return NULL;
+  }
+  strncpy(watch->paths[0], vertexPath, MAXPATHLEN - 1);
+  strncpy(watch->paths[1], fragmentPath, MAXPATHLEN - 1);
+  pthread_mutex_init(&watch->lock, NULL);
+  // the caller's defines may not outlive this call
+  watch->defines = calloc(defineCount ? defineCount : 1, sizeof(ShaderDefine));
+  if (watch->defines == NULL) {
+    freeWatch(watch);
+    return NULL;
+  }
+  for (size_t i = 0; i < defineCount; ++i) {
+    watch->defines[i].name = strdup(defines[i].name);
+    watch->defines[i].value = defines[i].value ? strdup(defines[i].value) : NULL;
+    watch->defineCount++;
+  }
+
+  // GLFW only creates windows on the main thread; the context hints set up
+  // for the main window still apply
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  watch->context = glfwCreateWindow(1, 1, "shader compiler", NULL, window);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+  if (watch->context == NULL) {
+    fprintf(stderr, "Failed to create the shader compiler context\n");
+    freeWatch(watch);
+    return NULL;
+  }
+  if (pthread_create(&watch->thread, NULL, watchMain, watch) != 0) {
+    glfwDestroyWindow(watch->context);
+    freeWatch(watch);
+    return NULL;
+  }
+  return watch;
+}
+
+unsigned int shaderWatchPoll(ShaderWatch *watch) {
+  unsigned int program = 0;
+  pthread_mutex_lock(&watch->lock);
+  if (watch->ready && glClientWaitSync(watch->readyFence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+    program = watch->ready;
+    glDeleteSync(watch->readyFence);
+    watch->ready = 0;
+    watch->readyFence = NULL;
+  }
+  pthread_mutex_unlock(&watch->lock);
+  return program;
+}
+
+void shaderWatchStop(ShaderWatch *watch) {
+  if (watch == NULL) {
+    return;
+  }
+  atomic_store(&watch->quit, 1);
+  pthread_join(watch->thread, NULL);
+  glfwDestroyWindow(watch->context);
+  if (watch->ready) {
+    glDeleteProgram(watch->ready);
+    glDeleteSync(watch->readyFence);
+  }
+  freeWatch(watch);
+}
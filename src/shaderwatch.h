@@ -0,0 +1,29 @@
+#ifndef SHADERWATCH_H
+#define SHADERWATCH_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "shader.h"
+
+// Watches a vertex and a fragment shader source file, along with the shader
+// sources next to them that they may include, and whenever one of them
+// changes, preprocesses them with `defines` and rebuilds the program on a
+// background thread with its own GL context shared with the main one. A program is only handed over once it
+// has linked; on a compile or link error the log is printed and the program
+// in use is kept.
+typedef struct ShaderWatch ShaderWatch;
+
+// Must be called on the main thread, with `window`'s context current.
+ShaderWatch *shaderWatchStart(GLFWwindow *window, const char *vertexPath, const char *fragmentPath,
+                              const ShaderDefine *defines, size_t defineCount);
+
+// Returns a freshly linked program that is ready to be used by the main
+// context, or 0 if there is none. The caller owns the returned program.
+unsigned int shaderWatchPoll(ShaderWatch *watch);
+
+// Must be called on the main thread.
+void shaderWatchStop(ShaderWatch *watch);
+
+#endif
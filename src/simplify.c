@@ -0,0 +1,372 @@
+#include "simplify.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The planes around one position summed as a symmetric 4x4 matrix, so
+// that the squared distance from a point to all of them is a quadratic
+// form. Each plane counts by the area of its triangle.
+typedef struct {
+  double a00, a01, a02, a11, a12, a22; // n n^T
+  double b0, b1, b2;                   // n d
+  double c;                            // d d
+  double weight;
+} Quadric;
+
+typedef struct {
+  uint32_t from; // vertex moved
+  uint32_t to;   // vertex it lands on
+  double cost;
+} Collapse;
+
+struct Simplifier {
+  const MeshVertex *vertices;
+  size_t vertexCount;
+  uint32_t *indices; // what is left of the triangles
+  size_t indexCount;
+  double worst;      // largest cost of a collapse so far
+  uint32_t *remap;            // vertex -> first vertex at the same position
+  unsigned char *locked;      // by remapped vertex
+  Quadric *quadrics;          // by remapped vertex
+  uint32_t *adjacency;        // triangles around each remapped vertex,
+  uint32_t *adjacencyOffsets; // from these, vertexCount + 1 of them
+  unsigned char *touched;     // by remapped vertex, in this pass
+  uint32_t *collapseTo;       // by vertex, in this pass
+  Collapse *collapses;
+};
+
+static void quadricAddPlane(Quadric *q, const double n[3], double d, double weight) {
+  q->a00 += weight * n[0] * n[0];
+  q->a01 += weight * n[0] * n[1];
+  q->a02 += weight * n[0] * n[2];
+  q->a11 += weight * n[1] * n[1];
+  q->a12 += weight * n[1] * n[2];
+  q->a22 += weight * n[2] * n[2];
+  q->b0 += weight * n[0] * d;
+  q->b1 += weight * n[1] * d;
+  q->b2 += weight * n[2] * d;
+  q->c += weight * d * d;
+  q->weight += weight;
+}
+
+static void quadricAdd(Quadric *q, const Quadric *r) {
+  q->a00 += r->a00;
+  q->a01 += r->a01;
+  q->a02 += r->a02;
+  q->a11 += r->a11;
+  q->a12 += r->a12;
+  q->a22 += r->a22;
+  q->b0 += r->b0;
+  q->b1 += r->b1;
+  q->b2 += r->b2;
+  q->c += r->c;
+  q->weight += r->weight;
+}
+
+// Mean squared distance from `p` to the planes of `q` and `r` together.
+static double collapseCost(const Quadric *q, const Quadric *r, const float *p) {
+  Quadric sum = *q;
+  quadricAdd(&sum, r);
+  double x = p[0], y = p[1], z = p[2];
+  double e = sum.a00 * x * x + sum.a11 * y * y + sum.a22 * z * z +
+             2.0 * (sum.a01 * x * y + sum.a02 * x * z + sum.a12 * y * z) +
+             2.0 * (sum.b0 * x + sum.b1 * y + sum.b2 * z) + sum.c;
+  return sum.weight > 0.0 && e > 0.0 ? e / sum.weight : 0.0;
+}
+
+static uint64_t hashPosition(const float *p) {
+  uint32_t bits[3];
+  // +0.0f turns -0 into 0, so the two weld
+  float q[3] = {p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f};
+  memcpy(bits, q, sizeof(bits));
+  uint64_t h = bits[0] * 0x9e3779b97f4a7c15ull;
+  h ^= bits[1] * 0xc2b2ae3d27d4eb4full;
+  h ^= bits[2] * 0x165667b19e3779f9ull;
+  return h >> 32;
+}
+
+static int samePosition(const float *a, const float *b) {
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+static size_t tableSizeFor(size_t count) {
+  size_t size = 16;
+  while (size < count * 2) {
+    size *= 2;
+  }
+  return size;
+}
+
+// Vertices that differ only in their attributes become one position, and
+// those positions are locked: collapsing one of them would pull its
+// attribute seam apart.
+static int weldPositions(Simplifier *s, const MeshVertex *vertices, size_t vertexCount) {
+  size_t tableSize = tableSizeFor(vertexCount);
+  uint32_t *table = calloc(tableSize, sizeof(uint32_t)); // vertex + 1, 0 for empty
+  if (table == NULL) {
+    return 0;
+  }
+  for (size_t v = 0; v < vertexCount; ++v) {
+    const float *p = vertices[v].position;
+    size_t slot = hashPosition(p) & (tableSize - 1);
+    while (table[slot] != 0 && !samePosition(vertices[table[slot] - 1].position, p)) {
+      slot = (slot + 1) & (tableSize - 1);
+    }
+    if (table[slot] == 0) {
+      table[slot] = (uint32_t)v + 1;
+      s->remap[v] = (uint32_t)v;
+    } else {
+      s->remap[v] = table[slot] - 1;
+      s->locked[s->remap[v]] = 1;
+    }
+  }
+  free(table);
+  return 1;
+}
+
+static uint64_t edgeKey(uint32_t a, uint32_t b) {
+  return (uint64_t)a << 32 | b;
+}
+
+static size_t findEdge(const uint64_t *table, size_t tableSize, uint64_t key) {
+  size_t slot = (size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (tableSize - 1);
+  while (table[slot] != UINT64_MAX && table[slot] != key) {
+    slot = (slot + 1) & (tableSize - 1);
+  }
+  return slot;
+}
+
+// Locks both ends of every edge that only one triangle has: moving them
+// would eat into the outline of the mesh.
+static int lockBorders(Simplifier *s, const uint32_t *indices, size_t indexCount) {
+  size_t tableSize = tableSizeFor(indexCount);
+  uint64_t *table = malloc(tableSize * sizeof(uint64_t));
+  if (table == NULL) {
+    return 0;
+  }
+  memset(table, 0xff, tableSize * sizeof(uint64_t));
+  for (size_t i = 0; i < indexCount; ++i) {
+    uint32_t a = s->remap[indices[i]], b = s->remap[indices[i - i % 3 + (i + 1) % 3]];
+    table[findEdge(table, tableSize, edgeKey(a, b))] = edgeKey(a, b);
+  }
+  for (size_t i = 0; i < indexCount; ++i) {
+    uint32_t a = s->remap[indices[i]], b = s->remap[indices[i - i % 3 + (i + 1) % 3]];
+    if (table[findEdge(table, tableSize, edgeKey(b, a))] == UINT64_MAX) {
+      s->locked[a] = s->locked[b] = 1;
+    }
+  }
+  free(table);
+  return 1;
+}
+
+static void triangleNormal(const float *p0, const float *p1, const float *p2, double n[3]) {
+  double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+  double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+  n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static void addQuadrics(Simplifier *s, const MeshVertex *vertices, const uint32_t *indices, size_t indexCount) {
+  for (size_t i = 0; i < indexCount; i += 3) {
+    const float *p0 = vertices[indices[i]].position;
+    double n[3];
+    triangleNormal(p0, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position, n);
+    double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0.0) {
+      continue;
+    }
+    n[0] /= length;
+    n[1] /= length;
+    n[2] /= length;
+    double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+    for (int k = 0; k < 3; ++k) {
+      quadricAddPlane(&s->quadrics[s->remap[indices[i + k]]], n, d, length * 0.5);
+    }
+  }
+}
+
+static void buildAdjacency(Simplifier *s, size_t vertexCount, const uint32_t *indices, size_t indexCount) {
+  uint32_t *offsets = s->adjacencyOffsets;
+  memset(offsets, 0, (vertexCount + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < indexCount; ++i) {
+    offsets[s->remap[indices[i]]]++;
+  }
+  uint32_t start = 0;
+  for (size_t v = 0; v <= vertexCount; ++v) {
+    uint32_t count = offsets[v];
+    offsets[v] = start;
+    start += count;
+  }
+  // filling moves each offset to the end of its range, the start of the next
+  for (size_t i = 0; i < indexCount; ++i) {
+    s->adjacency[offsets[s->remap[indices[i]]]++] = (uint32_t)(i / 3);
+  }
+  memmove(offsets + 1, offsets, vertexCount * sizeof(uint32_t));
+  offsets[0] = 0;
+}
+
+static int compareCollapses(const void *a, const void *b) {
+  double x = ((const Collapse *)a)->cost, y = ((const Collapse *)b)->cost;
+  return x < y ? -1 : x > y;
+}
+
+// Whether moving `from` onto `to` keeps every triangle around it facing the
+// way it did, counting the triangles of the edge, which vanish, as fine.
+static int keepsOrientation(const Simplifier *s, const MeshVertex *vertices, const uint32_t *indices,
+                            uint32_t from, uint32_t to) {
+  uint32_t wFrom = s->remap[from], wTo = s->remap[to];
+  const float *target = vertices[to].position;
+  for (uint32_t a = s->adjacencyOffsets[wFrom]; a < s->adjacencyOffsets[wFrom + 1]; ++a) {
+    const uint32_t *triangle = indices + 3 * (size_t)s->adjacency[a];
+    const float *before[3], *after[3];
+    int onEdge = 0;
+    for (int k = 0; k < 3; ++k) {
+      uint32_t w = s->remap[triangle[k]];
+      onEdge |= w == wTo;
+      before[k] = vertices[triangle[k]].position;
+      after[k] = w == wFrom ? target : before[k];
+    }
+    if (onEdge) {
+      continue;
+    }
+    double n0[3], n1[3];
+    triangleNormal(before[0], before[1], before[2], n0);
+    triangleNormal(after[0], after[1], after[2], n1);
+    double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+    double lengths = sqrt((n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]) * (n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]));
+    // more than about 75 degrees of turn, or collapsed to nothing
+    if (dot <= 0.25 * lengths) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// One round of collapses, cheapest first, none of them touching a
+// triangle another has changed, since its cost and orientation test would
+// no longer hold. Returns how many were made.
+static size_t collapsePass(Simplifier *s, size_t targetIndexCount, double limit) {
+  const MeshVertex *vertices = s->vertices;
+  uint32_t *indices = s->indices;
+  // one candidate an edge, the cheaper way round; an edge inside the mesh
+  // comes up in two triangles, once each way
+  size_t candidates = 0;
+  for (size_t i = 0; i < s->indexCount; ++i) {
+    uint32_t a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+    uint32_t wa = s->remap[a], wb = s->remap[b];
+    if (wa > wb || (s->locked[wa] && s->locked[wb])) {
+      continue;
+    }
+    double toB = s->locked[wa] ? INFINITY : collapseCost(&s->quadrics[wa], &s->quadrics[wb], vertices[b].position);
+    double toA = s->locked[wb] ? INFINITY : collapseCost(&s->quadrics[wb], &s->quadrics[wa], vertices[a].position);
+    Collapse collapse = toB <= toA ? (Collapse){a, b, toB} : (Collapse){b, a, toA};
+    if (collapse.cost <= limit) {
+      s->collapses[candidates++] = collapse;
+    }
+  }
+  qsort(s->collapses, candidates, sizeof(Collapse), compareCollapses);
+  buildAdjacency(s, s->vertexCount, indices, s->indexCount);
+  memset(s->touched, 0, s->vertexCount);
+  for (size_t v = 0; v < s->vertexCount; ++v) {
+    s->collapseTo[v] = (uint32_t)v;
+  }
+
+  size_t made = 0, removed = 0;
+  for (size_t c = 0; c < candidates && s->indexCount - removed > targetIndexCount; ++c) {
+    const Collapse *collapse = &s->collapses[c];
+    uint32_t wFrom = s->remap[collapse->from], wTo = s->remap[collapse->to];
+    if (s->touched[wFrom] || s->touched[wTo] ||
+        !keepsOrientation(s, vertices, indices, collapse->from, collapse->to)) {
+      continue;
+    }
+    // an unlocked position has only the one vertex, so remapping it moves
+    // every corner there
+    s->collapseTo[collapse->from] = collapse->to;
+    quadricAdd(&s->quadrics[wTo], &s->quadrics[wFrom]);
+    for (uint32_t a = s->adjacencyOffsets[wFrom]; a < s->adjacencyOffsets[wFrom + 1]; ++a) {
+      const uint32_t *triangle = indices + 3 * (size_t)s->adjacency[a];
+      int onEdge = 0;
+      for (int k = 0; k < 3; ++k) {
+        s->touched[s->remap[triangle[k]]] = 1;
+        onEdge |= s->remap[triangle[k]] == wTo;
+      }
+      removed += onEdge ? 3 : 0;
+    }
+    s->worst = collapse->cost > s->worst ? collapse->cost : s->worst;
+    made++;
+  }
+
+  // apply the collapses, dropping the triangles they flattened
+  size_t kept = 0;
+  for (size_t i = 0; i < s->indexCount; i += 3) {
+    uint32_t a = s->collapseTo[indices[i]], b = s->collapseTo[indices[i + 1]], c = s->collapseTo[indices[i + 2]];
+    uint32_t wa = s->remap[a], wb = s->remap[b], wc = s->remap[c];
+    if (wa != wb && wb != wc && wc != wa) {
+      indices[kept++] = a;
+      indices[kept++] = b;
+      indices[kept++] = c;
+    }
+  }
+  s->indexCount = kept;
+  return made;
+}
+
+Simplifier *simplifierCreate(const MeshVertex *vertices, size_t vertexCount, const uint32_t *indices,
+                             size_t indexCount) {
+  Simplifier *s = calloc(1, sizeof(Simplifier));
+  if (s == NULL) {
+    return NULL;
+  }
+  size_t vertices1 = vertexCount ? vertexCount : 1, indices1 = indexCount ? indexCount : 1;
+  s->vertices = vertices;
+  s->vertexCount = vertexCount;
+  s->indices = malloc(indices1 * sizeof(uint32_t));
+  s->indexCount = indexCount;
+  s->remap = malloc(vertices1 * sizeof(uint32_t));
+  s->locked = calloc(vertices1, 1);
+  s->quadrics = calloc(vertices1, sizeof(Quadric));
+  s->adjacency = malloc(indices1 * sizeof(uint32_t));
+  s->adjacencyOffsets = malloc((vertexCount + 1) * sizeof(uint32_t));
+  s->touched = malloc(vertices1);
+  s->collapseTo = malloc(vertices1 * sizeof(uint32_t));
+  s->collapses = malloc(indices1 * sizeof(Collapse));
+  if (!s->indices || !s->remap || !s->locked || !s->quadrics || !s->adjacency || !s->adjacencyOffsets ||
+      !s->touched || !s->collapseTo || !s->collapses || !weldPositions(s, vertices, vertexCount) ||
+      !lockBorders(s, indices, indexCount)) {
+    simplifierDestroy(s);
+    return NULL;
+  }
+  memcpy(s->indices, indices, indexCount * sizeof(uint32_t));
+  addQuadrics(s, vertices, indices, indexCount);
+  return s;
+}
+
+void simplifierDestroy(Simplifier *s) {
+  if (s == NULL) {
+    return;
+  }
+  free(s->indices);
+  free(s->remap);
+  free(s->locked);
+  free(s->quadrics);
+  free(s->adjacency);
+  free(s->adjacencyOffsets);
+  free(s->touched);
+  free(s->collapseTo);
+  free(s->collapses);
+  free(s);
+}
+
+size_t simplifierRun(Simplifier *s, size_t targetIndexCount, float maxError, float *error) {
+  double limit = (double)maxError * maxError;
+  while (s->indexCount > targetIndexCount && collapsePass(s, targetIndexCount, limit) > 0) {
+  }
+  *error = (float)sqrt(s->worst);
+  return s->indexCount;
+}
+
+const uint32_t *simplifierIndices(const Simplifier *s) {
+  return s->indices;
+}
@@ -0,0 +1,37 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "meshfile.h"
+
+// Simplifies a triangle list by collapsing edges, cheapest first by the
+// quadric error metric: every position keeps the sum of the planes of the
+// triangles that were around it in the original mesh, and moving it onto a
+// neighbour costs the mean squared distance from there to those planes.
+//
+// Collapses move a vertex onto one of its neighbours, so the result indexes
+// the same vertices and can share their buffer. Vertices where the
+// attributes split (texture seams, hard edges) and those on open borders
+// are kept in place, which keeps the outline and the texture mapping
+// intact, and no collapse is made that would turn a triangle over.
+typedef struct Simplifier Simplifier;
+
+// Copies the indices; the vertices must outlive the simplifier.
+Simplifier *simplifierCreate(const MeshVertex *vertices, size_t vertexCount, const uint32_t *indices,
+                             size_t indexCount);
+void simplifierDestroy(Simplifier *simplifier);
+
+// Collapses until no more than `targetIndexCount` indices are left or the
+// next collapse would cost more than `maxError`, in model units. Can be
+// called again with a smaller target to carry on from there; the planes
+// are always those of the original, so the error stays measured against
+// it. Returns the indices left and, in `error`, the largest error any
+// collapse so far has made.
+size_t simplifierRun(Simplifier *simplifier, size_t targetIndexCount, float maxError, float *error);
+
+// The triangles left, valid until the next simplifierRun.
+const uint32_t *simplifierIndices(const Simplifier *simplifier);
+
+#endif
@@ -0,0 +1,4 @@
+// The stb_image implementation, on its own so that it is compiled once
+// rather than with every change to the files that use it.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
@@ -0,0 +1,313 @@
+#include "texarray.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <stb_image.h>
+
+#include "bcn.h"
+#include "hash.h"
+#include "mipmap.h"
+#include "texfile.h"
+
+// The block format behind an S3TC internal format, if it is one we decode.
+static int bcFormatOf(GLenum internalFormat, BcFormat *format) {
+  switch (internalFormat) {
+  case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    *format = BC1;
+    return 1;
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    *format = BC3;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// bytes in one layer of `level`
+static size_t levelSize(GLenum internalFormat, GLsizei width, GLsizei height, int level) {
+  int w = mipLevelSize(width, level), h = mipLevelSize(height, level);
+  BcFormat format;
+  if (bcFormatOf(internalFormat, &format)) {
+    return bcImageSize(format, w, h);
+  }
+  return (size_t)w * h * 4;
+}
+
+int textureArrayInit(TextureArray *array, GLenum internalFormat, GLsizei width, GLsizei height,
+                     GLsizei levels, GLsizei capacity) {
+  memset(array, 0, sizeof(*array));
+  array->internalFormat = internalFormat;
+  array->width = width;
+  array->height = height;
+  array->levels = levels;
+  array->capacity = capacity;
+  glGenTextures(1, &array->texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, array->texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  for (int level = 0; level < levels; ++level) {
+    GLsizei w = mipLevelSize(width, level), h = mipLevelSize(height, level);
+    if (internalFormat == GL_RGBA8) {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, w, h, capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    } else {
+      GLsizei size = (GLsizei)(levelSize(internalFormat, width, height, level) * capacity);
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, w, h, capacity, 0, size, NULL);
+    }
+  }
+  return array->texture != 0;
+}
+
+void textureArrayFree(TextureArray *array) {
+  glDeleteTextures(1, &array->texture);
+  memset(array, 0, sizeof(*array));
+}
+
+int textureArrayAdd(TextureArray *array, int levelCount, const unsigned char *const *levels, const size_t *sizes) {
+  if (array->layers == array->capacity) {
+    return -1;
+  }
+  for (int level = 0; level < levelCount && level < array->levels; ++level) {
+    GLsizei w = mipLevelSize(array->width, level), h = mipLevelSize(array->height, level);
+    if (array->internalFormat == GL_RGBA8) {
+      // rows of RGBA8 are always 4-byte aligned
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, array->layers, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, levels[level]);
+    } else {
+      glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, array->layers, w, h, 1, array->internalFormat,
+                                (GLsizei)sizes[level], levels[level]);
+    }
+  }
+  return array->layers++;
+}
+
+typedef struct {
+  const TextureSource *source;
+  const char *bakeDir;
+  int loaded;
+  GLenum internalFormat;
+  int width;
+  int height;
+  int levels;       // levels of the array it goes to
+  int loadedLevels; // levels in `data`; the rest are generated by GL
+  const unsigned char *data[TEXTURE_MAX_LEVELS];
+  size_t sizes[TEXTURE_MAX_LEVELS];
+  TextureFile file;
+  unsigned char *owned[TEXTURE_MAX_LEVELS];
+} LoadedImage;
+
+static void freeImage(LoadedImage *image) {
+  textureFileFree(&image->file);
+  for (int level = 0; level < TEXTURE_MAX_LEVELS; ++level) {
+    free(image->owned[level]);
+    image->owned[level] = NULL;
+  }
+}
+
+// Loads a texture file: S3TC from tools/texconv, or RGBA8 baked by us.
+static int loadFile(LoadedImage *image, const char *path) {
+  BcFormat format;
+  if (path == NULL || !textureFileRead(&image->file, path)) {
+    return 0;
+  }
+  int compressed = bcFormatOf(image->file.format, &format);
+  if (!compressed && image->file.format != GL_RGBA8) {
+    fprintf(stderr, "%s: unsupported format 0x%x\n", path, image->file.format);
+    textureFileFree(&image->file);
+    return 0;
+  }
+  image->width = image->file.width;
+  image->height = image->file.height;
+  image->levels = image->loadedLevels = image->file.levels;
+  for (int level = 0; level < image->levels; ++level) {
+    if (image->file.size[level] != levelSize(image->file.format, image->width, image->height, level)) {
+      fprintf(stderr, "%s: level %d has the wrong size\n", path, level);
+      textureFileFree(&image->file);
+      return 0;
+    }
+  }
+
+  if (!compressed || GLAD_GL_EXT_texture_compression_s3tc) {
+    image->internalFormat = image->file.format;
+    for (int level = 0; level < image->levels; ++level) {
+      image->data[level] = image->file.data[level];
+      image->sizes[level] = image->file.size[level];
+    }
+    return 1;
+  }
+
+  // no S3TC: decode on the CPU and upload RGBA8, still with all the levels
+  image->internalFormat = GL_RGBA8;
+  for (int level = 0; level < image->levels; ++level) {
+    int w = mipLevelSize(image->width, level), h = mipLevelSize(image->height, level);
+    image->owned[level] = malloc((size_t)w * h * 4);
+    if (image->owned[level] == NULL) {
+      freeImage(image);
+      return 0;
+    }
+    bcDecodeImage(format, image->file.data[level], w, h, image->owned[level]);
+    image->data[level] = image->owned[level];
+    image->sizes[level] = (size_t)w * h * 4;
+  }
+  textureFileFree(&image->file);
+  return 1;
+}
+
+// Where the mips of a plain image are baked: keyed by everything that
+// changes them, including the source file's size and modification time.
+static int bakePath(const LoadedImage *image, char *path) {
+  struct stat st;
+  if (image->bakeDir == NULL || stat(image->source->path, &st) != 0) {
+    return 0;
+  }
+  uint64_t key = hashString(HASH_SEED, image->source->path);
+  int64_t stamp[5] = {image->source->flip, image->source->srgb, (int64_t)st.st_size, (int64_t)st.st_mtime, TEXTURE_FILE_VERSION};
+  key = hashBytes(key, stamp, sizeof(stamp));
+  snprintf(path, MAXPATHLEN, "%s/%016llx.ltex", image->bakeDir, (unsigned long long)key);
+  return 1;
+}
+
+static int loadImage(LoadedImage *image) {
+  const TextureSource *source = image->source;
+  if (loadFile(image, source->compressedPath)) {
+    return 1;
+  }
+  char baked[MAXPATHLEN];
+  int bake = bakePath(image, baked);
+  if (bake && loadFile(image, baked)) {
+    return 1;
+  }
+
+  int channels;
+  Asset encoded;
+  stbi_set_flip_vertically_on_load_thread(source->flip);
+  if (assetRead(source->path, &encoded)) {
+    image->owned[0] = stbi_load_from_memory(encoded.data, (int)encoded.size, &image->width, &image->height, &channels, 4);
+    assetRelease(&encoded);
+  }
+  if (image->owned[0] == NULL) {
+    fprintf(stderr, "Failed to load texture %s\n", source->path);
+    return 0;
+  }
+  image->internalFormat = GL_RGBA8;
+  image->levels = mipLevelCount(image->width, image->height);
+  if (image->levels > TEXTURE_MAX_LEVELS || !mipBuildChain(image->owned, image->width, image->height, source->srgb)) {
+    // leave the mips to glGenerateMipmap
+    image->loadedLevels = 1;
+  } else {
+    image->loadedLevels = image->levels;
+  }
+  for (int level = 0; level < image->loadedLevels; ++level) {
+    image->data[level] = image->owned[level];
+    image->sizes[level] = levelSize(GL_RGBA8, image->width, image->height, level);
+  }
+  if (bake && image->loadedLevels == image->levels) {
+    textureFileWrite(baked, GL_RGBA8, image->width, image->height, image->levels, image->owned, image->sizes);
+  }
+  return 1;
+}
+
+static void loadImageJob(void *data, unsigned int thread) {
+  LoadedImage *image = data;
+  image->loaded = loadImage(image);
+}
+
+static int sameArray(const LoadedImage *a, const LoadedImage *b) {
+  return a->internalFormat == b->internalFormat && a->width == b->width && a->height == b->height &&
+         a->levels == b->levels && a->loadedLevels == b->loadedLevels;
+}
+
+int texturePackLoad(TexturePack *pack, JobSystem *jobs, const char *bakeDir,
+                    const TextureSource *sources, size_t count, int dropLevels, TextureSlot *slots) {
+  memset(pack, 0, sizeof(*pack));
+  LoadedImage *images = calloc(count ? count : 1, sizeof(LoadedImage));
+  int *arrayOf = malloc((count ? count : 1) * sizeof(int));
+  pack->arrays = calloc(count ? count : 1, sizeof(TextureArray));
+  if (images == NULL || arrayOf == NULL || pack->arrays == NULL) {
+    free(images);
+    free(arrayOf);
+    free(pack->arrays);
+    pack->arrays = NULL;
+    return 0;
+  }
+  if (bakeDir && mkdir(bakeDir, 0755) != 0 && errno != EEXIST) {
+    perror("mkdir");
+    bakeDir = NULL;
+  }
+
+  // everything up to the upload happens on the job threads
+  JobCounter loaded = {0};
+  for (size_t i = 0; i < count; ++i) {
+    images[i].source = &sources[i];
+    images[i].bakeDir = bakeDir;
+    jobSubmit(jobs, loadImageJob, &images[i], &loaded);
+  }
+  jobWait(jobs, &loaded);
+
+  // group the images; arrayOf[i] is the array image i goes to
+  for (size_t i = 0; i < count; ++i) {
+    arrayOf[i] = -1;
+    if (!images[i].loaded) {
+      continue;
+    }
+    for (size_t j = 0; j < i && arrayOf[i] == -1; ++j) {
+      if (arrayOf[j] != -1 && sameArray(&images[i], &images[j])) {
+        arrayOf[i] = arrayOf[j];
+      }
+    }
+    if (arrayOf[i] == -1) {
+      arrayOf[i] = (int)pack->count++;
+    }
+  }
+
+  for (size_t a = 0; a < pack->count; ++a) {
+    const LoadedImage *first = NULL;
+    GLsizei layers = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (arrayOf[i] == (int)a) {
+        first = first ? first : &images[i];
+        layers++;
+      }
+    }
+    // level `drop` of the images becomes level 0 of the array
+    int drop = dropLevels < first->loadedLevels ? dropLevels : first->loadedLevels - 1;
+    TextureArray *array = &pack->arrays[a];
+    textureArrayInit(array, first->internalFormat, mipLevelSize(first->width, drop), mipLevelSize(first->height, drop),
+                     first->levels - drop, layers);
+    for (size_t i = 0; i < count; ++i) {
+      if (arrayOf[i] == (int)a) {
+        slots[i].array = (int)a;
+        slots[i].layer = textureArrayAdd(array, images[i].loadedLevels - drop, images[i].data + drop, images[i].sizes + drop);
+      }
+    }
+    if (first->loadedLevels < first->levels) {
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    for (int level = 0; level < array->levels; ++level) {
+      pack->bytes += levelSize(array->internalFormat, array->width, array->height, level) * array->capacity;
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (arrayOf[i] == -1) {
+      slots[i].array = slots[i].layer = -1;
+    }
+    freeImage(&images[i]);
+  }
+  free(images);
+  free(arrayOf);
+  return 1;
+}
+
+void texturePackFree(TexturePack *pack) {
+  for (size_t i = 0; i < pack->count; ++i) {
+    textureArrayFree(&pack->arrays[i]);
+  }
+  free(pack->arrays);
+  memset(pack, 0, sizeof(*pack));
+}
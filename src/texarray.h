@@ -0,0 +1,73 @@
+#ifndef TEXARRAY_H
+#define TEXARRAY_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+#include "jobs.h"
+
+// Images of one size and format stored as the layers of a single
+// GL_TEXTURE_2D_ARRAY. Draws using any of them share one binding and pick
+// their image with a layer index, so switching images needs no rebind.
+typedef struct {
+  unsigned int texture;
+  GLenum internalFormat; // GL_RGBA8, or S3TC when the images were compressed offline
+  GLsizei width;
+  GLsizei height;
+  GLsizei levels;
+  GLsizei layers;
+  GLsizei capacity;
+} TextureArray;
+
+// Allocates every level. Leaves the array bound to GL_TEXTURE_2D_ARRAY on
+// the active unit.
+int textureArrayInit(TextureArray *array, GLenum internalFormat, GLsizei width, GLsizei height,
+                     GLsizei levels, GLsizei capacity);
+void textureArrayFree(TextureArray *array);
+
+// Uploads levels 0 .. levelCount - 1 of an image into the next free layer of
+// the bound array and returns the layer, or -1 if the array is full. RGBA8
+// levels are tightly packed; `sizes` is only read for compressed formats.
+int textureArrayAdd(TextureArray *array, int levelCount, const unsigned char *const *levels, const size_t *sizes);
+
+// An image for texturePackLoad. `compressedPath` names a texture file made
+// by tools/texconv from the same image, which is used instead of `path` when
+// it exists; it may be NULL. `flip` flips `path` vertically on load, and
+// `srgb` filters its mips in linear light.
+typedef struct {
+  const char *path;
+  int flip;
+  int srgb;
+  const char *compressedPath;
+} TextureSource;
+
+// Where texturePackLoad put an image, or -1 in both for one that failed to load.
+typedef struct {
+  int array;
+  int layer;
+} TextureSlot;
+
+// Images sharing a size and format share an array. Plain images are
+// converted to RGBA8, whatever their channels, and their mips are built on
+// the CPU (see mipmap.h). Compressed ones are uploaded as they are with all
+// their levels, or decoded to RGBA8 on drivers without S3TC. Either way
+// every level is uploaded explicitly.
+typedef struct {
+  TextureArray *arrays;
+  size_t count;
+  size_t bytes; // video memory taken by all the arrays
+} TexturePack;
+
+// Reading, decoding and mip building run as jobs on `jobs`, one per image;
+// only the uploads happen on the calling thread. With `bakeDir`, the mip
+// chains built for plain images are saved there and reused by later runs
+// for as long as the source file is unchanged. `dropLevels` leaves out that
+// many of the largest levels, keeping at least one.
+//
+// Returns 0 only if memory ran out; images that fail to load are reported
+// and get a slot of -1.
+int texturePackLoad(TexturePack *pack, JobSystem *jobs, const char *bakeDir,
+                    const TextureSource *sources, size_t count, int dropLevels, TextureSlot *slots);
+void texturePackFree(TexturePack *pack);
+
+#endif
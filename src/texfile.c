@@ -0,0 +1,77 @@
+#include "texfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomicfile.h"
+
+int textureFileRead(TextureFile *file, const char *path) {
+  memset(file, 0, sizeof(*file));
+  if (!assetRead(path, &file->contents)) {
+    return 0;
+  }
+  const unsigned char *contents = file->contents.data;
+  size_t length = file->contents.size;
+
+  TextureFileHeader header;
+  int ok = 1;
+  if (length >= sizeof(header)) {
+    memcpy(&header, contents, sizeof(header));
+    ok = memcmp(header.magic, TEXTURE_FILE_MAGIC, 4) == 0 && header.version == TEXTURE_FILE_VERSION &&
+         header.levels >= 1 && header.levels <= TEXTURE_MAX_LEVELS &&
+         sizeof(header) + header.levels * 2 * sizeof(uint32_t) <= length;
+  } else {
+    ok = 0;
+  }
+  for (uint32_t i = 0; ok && i < header.levels; ++i) {
+    uint32_t range[2];
+    memcpy(range, contents + sizeof(header) + i * sizeof(range), sizeof(range));
+    ok = (size_t)range[0] + range[1] <= length;
+    file->data[i] = contents + range[0];
+    file->size[i] = range[1];
+  }
+  if (!ok) {
+    fprintf(stderr, "%s: not a texture file\n", path);
+    textureFileFree(file);
+    return 0;
+  }
+  file->format = header.format;
+  file->width = (int)header.width;
+  file->height = (int)header.height;
+  file->levels = (int)header.levels;
+  return 1;
+}
+
+void textureFileFree(TextureFile *file) {
+  assetRelease(&file->contents);
+  memset(file, 0, sizeof(*file));
+}
+
+int textureFileWrite(const char *path, uint32_t format, int width, int height, int levels,
+                     unsigned char *const *data, const size_t *sizes) {
+  TextureFileHeader header = {{'L', 'T', 'E', 'X'}, TEXTURE_FILE_VERSION, format,
+                              (uint32_t)width, (uint32_t)height, (uint32_t)levels};
+  uint32_t ranges[TEXTURE_MAX_LEVELS][2];
+  size_t offset = sizeof(header) + levels * sizeof(ranges[0]);
+  for (int i = 0; i < levels; ++i) {
+    offset = (offset + 15) & ~(size_t)15;
+    ranges[i][0] = (uint32_t)offset;
+    ranges[i][1] = (uint32_t)sizes[i];
+    offset += sizes[i];
+  }
+
+  AtomicFile f;
+  atomicFileOpen(&f, path);
+  atomicFileWrite(&f, &header, sizeof(header));
+  atomicFileWrite(&f, ranges, levels * sizeof(ranges[0]));
+  for (int i = 0; i < levels; ++i) {
+    atomicFilePadTo(&f, ranges[i][0]);
+    atomicFileWrite(&f, data[i], sizes[i]);
+  }
+  if (!atomicFileClose(&f, 1)) {
+    fprintf(stderr, "%s: could not be written\n", path);
+    return 0;
+  }
+  return 1;
+}
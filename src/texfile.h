@@ -0,0 +1,48 @@
+#ifndef TEXFILE_H
+#define TEXFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "assetpack.h"
+
+// A texture with its whole mip chain, stored exactly as it is uploaded:
+//
+//   TextureFileHeader
+//   uint32_t offset, size  for each level, offsets from the start of the file
+//   level data             each level starting on a 16 byte boundary
+//
+// All fields are little endian. `format` is the GL internal format of the
+// levels, e.g. GL_COMPRESSED_RGBA_S3TC_DXT5_EXT.
+#define TEXTURE_FILE_MAGIC "LTEX"
+#define TEXTURE_FILE_VERSION 1
+#define TEXTURE_MAX_LEVELS 16
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levels;
+} TextureFileHeader;
+
+typedef struct {
+  uint32_t format;
+  int width;
+  int height;
+  int levels;
+  const unsigned char *data[TEXTURE_MAX_LEVELS];
+  size_t size[TEXTURE_MAX_LEVELS];
+  Asset contents; // the whole file, which data points into
+} TextureFile;
+
+// Reads through assetRead, so from the mounted asset pack when it has the
+// file, without a copy. Returns 0 if the file is missing or malformed.
+int textureFileRead(TextureFile *file, const char *path);
+void textureFileFree(TextureFile *file);
+
+int textureFileWrite(const char *path, uint32_t format, int width, int height, int levels,
+                     unsigned char *const *data, const size_t *sizes);
+
+#endif
@@ -0,0 +1,215 @@
+#include "texmanager.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  TextureSource *sources;
+  size_t count;
+  TexturePack pack;
+  TextureSlot *slots;
+  int resident;
+  int everLoaded;
+  int dropped; // largest levels left out
+  uint32_t lastUsed;
+} ManagedTexture;
+
+struct TextureManager {
+  JobSystem *jobs;
+  char *bakeDir;
+  size_t budget;
+  size_t used;
+  ManagedTexture *textures;
+  size_t count;
+  size_t capacity;
+  uint32_t frame;
+  size_t loads;
+  size_t reloads;
+  size_t evictions;
+};
+
+TextureManager *textureManagerCreate(JobSystem *jobs, const char *bakeDir, size_t budget) {
+  TextureManager *manager = calloc(1, sizeof(TextureManager));
+  if (manager == NULL) {
+    return NULL;
+  }
+  manager->jobs = jobs;
+  manager->bakeDir = bakeDir ? strdup(bakeDir) : NULL;
+  manager->budget = budget;
+  manager->frame = 1;
+  return manager;
+}
+
+static void unload(TextureManager *manager, ManagedTexture *texture) {
+  manager->used -= texture->pack.bytes;
+  texturePackFree(&texture->pack);
+  texture->resident = 0;
+}
+
+void textureManagerDestroy(TextureManager *manager) {
+  if (manager == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < manager->count; ++i) {
+    ManagedTexture *texture = &manager->textures[i];
+    if (texture->resident) {
+      unload(manager, texture);
+    }
+    for (size_t j = 0; j < texture->count; ++j) {
+      free((char *)texture->sources[j].path);
+      free((char *)texture->sources[j].compressedPath);
+    }
+    free(texture->sources);
+    free(texture->slots);
+  }
+  free(manager->textures);
+  free(manager->bakeDir);
+  free(manager);
+}
+
+int textureManagerAdd(TextureManager *manager, const TextureSource *sources, size_t count) {
+  if (manager->count == manager->capacity) {
+    size_t capacity = manager->capacity ? manager->capacity * 2 : 8;
+    ManagedTexture *textures = realloc(manager->textures, capacity * sizeof(ManagedTexture));
+    if (textures == NULL) {
+      return -1;
+    }
+    manager->textures = textures;
+    manager->capacity = capacity;
+  }
+  ManagedTexture *texture = &manager->textures[manager->count];
+  memset(texture, 0, sizeof(*texture));
+  texture->sources = calloc(count ? count : 1, sizeof(TextureSource));
+  texture->slots = calloc(count ? count : 1, sizeof(TextureSlot));
+  if (texture->sources == NULL || texture->slots == NULL) {
+    free(texture->sources);
+    free(texture->slots);
+    return -1;
+  }
+  texture->count = count;
+  for (size_t i = 0; i < count; ++i) {
+    texture->sources[i] = sources[i];
+    texture->sources[i].path = strdup(sources[i].path);
+    texture->sources[i].compressedPath = sources[i].compressedPath ? strdup(sources[i].compressedPath) : NULL;
+  }
+  return (int)manager->count++;
+}
+
+// (Re)loads a texture with `dropped` levels left out.
+static int load(TextureManager *manager, ManagedTexture *texture, int dropped) {
+  if (texture->resident) {
+    unload(manager, texture);
+  }
+  if (!texturePackLoad(&texture->pack, manager->jobs, manager->bakeDir, texture->sources, texture->count, dropped,
+                       texture->slots)) {
+    return 0;
+  }
+  if (texture->everLoaded) {
+    manager->reloads++;
+  } else {
+    manager->loads++;
+  }
+  texture->everLoaded = 1;
+  texture->resident = 1;
+  texture->dropped = dropped;
+  manager->used += texture->pack.bytes;
+  return 1;
+}
+
+// Whether a texture has a level it could do without.
+static int canDrop(const ManagedTexture *texture) {
+  for (size_t i = 0; i < texture->pack.count; ++i) {
+    if (texture->pack.arrays[i].levels > 1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Evicts textures not used this frame, least recently used first, then
+// drops levels of the largest textures, until everything fits or nothing
+// more can go.
+static void enforceBudget(TextureManager *manager) {
+  while (manager->used > manager->budget) {
+    ManagedTexture *victim = NULL;
+    for (size_t i = 0; i < manager->count; ++i) {
+      ManagedTexture *texture = &manager->textures[i];
+      if (texture->resident && texture->lastUsed != manager->frame &&
+          (victim == NULL || texture->lastUsed < victim->lastUsed)) {
+        victim = texture;
+      }
+    }
+    if (victim == NULL) {
+      break;
+    }
+    unload(manager, victim);
+    manager->evictions++;
+  }
+  while (manager->used > manager->budget) {
+    ManagedTexture *largest = NULL;
+    for (size_t i = 0; i < manager->count; ++i) {
+      ManagedTexture *texture = &manager->textures[i];
+      if (texture->resident && canDrop(texture) && (largest == NULL || texture->pack.bytes > largest->pack.bytes)) {
+        largest = texture;
+      }
+    }
+    if (largest == NULL || !load(manager, largest, largest->dropped + 1)) {
+      break;
+    }
+  }
+}
+
+void textureManagerFrame(TextureManager *manager) {
+  manager->frame++;
+  // A level at most quadruples a texture's size, so five times the current
+  // size is a safe guess at what one more level would take. One texture a
+  // frame at most, to spread the loads out.
+  for (size_t i = 0; i < manager->count; ++i) {
+    ManagedTexture *texture = &manager->textures[i];
+    if (texture->resident && texture->dropped > 0 &&
+        manager->used + 4 * texture->pack.bytes <= manager->budget) {
+      load(manager, texture, texture->dropped - 1);
+      break;
+    }
+  }
+}
+
+const TexturePack *textureManagerUse(TextureManager *manager, int index, TextureSlot *slots) {
+  ManagedTexture *texture = &manager->textures[index];
+  texture->lastUsed = manager->frame;
+  if (!texture->resident) {
+    // a texture that lost levels before it was evicted starts out without
+    // them again
+    if (!load(manager, texture, texture->dropped)) {
+      return NULL;
+    }
+    enforceBudget(manager);
+  }
+  if (slots) {
+    memcpy(slots, texture->slots, texture->count * sizeof(TextureSlot));
+  }
+  return &texture->pack;
+}
+
+void textureManagerSetBudget(TextureManager *manager, size_t budget) {
+  manager->budget = budget;
+  enforceBudget(manager);
+}
+
+void textureManagerStats(const TextureManager *manager, TextureManagerStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->budget = manager->budget;
+  stats->used = manager->used;
+  for (size_t i = 0; i < manager->count; ++i) {
+    const ManagedTexture *texture = &manager->textures[i];
+    if (texture->resident) {
+      stats->resident++;
+      stats->droppedLevels += (size_t)texture->dropped;
+    }
+  }
+  stats->loads = manager->loads;
+  stats->reloads = manager->reloads;
+  stats->evictions = manager->evictions;
+}
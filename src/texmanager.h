@@ -0,0 +1,52 @@
+#ifndef TEXMANAGER_H
+#define TEXMANAGER_H
+
+#include <stddef.h>
+
+#include "jobs.h"
+#include "texarray.h"
+
+// Keeps the video memory taken by textures, all levels counted, within a
+// budget. Each managed texture is a TexturePack made from a list of
+// sources, loaded when it is first used. When a load goes over budget, the
+// least recently used textures are deleted, to be loaded again if they are
+// used again. If that is not enough, the largest textures are loaded again
+// without their largest level, one level at a time, rather than failing;
+// they get their levels back once there is room.
+typedef struct TextureManager TextureManager;
+
+typedef struct {
+  size_t budget;
+  size_t used;          // bytes of all resident textures
+  size_t resident;      // textures loaded
+  size_t droppedLevels; // levels left out, summed over resident textures
+  size_t loads;         // first loads
+  size_t reloads;       // loads after an eviction, or with more or fewer levels
+  size_t evictions;
+} TextureManagerStats;
+
+// Loads go through texturePackLoad on `jobs`, with `bakeDir`.
+TextureManager *textureManagerCreate(JobSystem *jobs, const char *bakeDir, size_t budget);
+void textureManagerDestroy(TextureManager *manager);
+
+// Registers a texture made of `count` sources, copied along with their
+// paths. Nothing is loaded yet. Returns its handle, or -1.
+int textureManagerAdd(TextureManager *manager, const TextureSource *sources, size_t count);
+
+// Starts a new frame for the LRU order, and gives a dropped level back to
+// a texture if it now fits. Call once per frame before textureManagerUse.
+void textureManagerFrame(TextureManager *manager);
+
+// Loads the texture if needed and marks it used this frame, which keeps it
+// from being evicted until the next frame. Returns NULL only if memory ran
+// out; the pack stays valid until the next call into the manager, and its
+// textures may be replaced between frames. `slots` may be NULL. Binds on
+// the active unit when it loads.
+const TexturePack *textureManagerUse(TextureManager *manager, int texture, TextureSlot *slots);
+
+// Evicts and drops levels right away if the budget shrinks.
+void textureManagerSetBudget(TextureManager *manager, size_t budget);
+
+void textureManagerStats(const TextureManager *manager, TextureManagerStats *stats);
+
+#endif
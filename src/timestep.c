@@ -0,0 +1,67 @@
+#include "timestep.h"
+
+#include <sched.h>
+#include <time.h>
+
+// how early sleeping stops, to make up for the scheduler waking us late
+#define PACER_SPIN 0.0015
+
+double timeNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void timestepInit(FixedTimestep *timestep, double rate, double now) {
+  timestep->step = 1.0 / rate;
+  timestep->accumulator = 0.0;
+  timestep->last = now;
+  timestep->maxSteps = 8;
+  timestep->steps = 0;
+}
+
+unsigned int timestepAdvance(FixedTimestep *timestep, double now) {
+  timestep->accumulator += now - timestep->last;
+  timestep->last = now;
+  unsigned int steps = 0;
+  while (timestep->accumulator >= timestep->step && steps < timestep->maxSteps) {
+    timestep->accumulator -= timestep->step;
+    steps++;
+  }
+  if (timestep->accumulator >= timestep->step) {
+    timestep->accumulator = 0.0;
+  }
+  timestep->steps += steps;
+  return steps;
+}
+
+unsigned int timestepTick(FixedTimestep *timestep) {
+  timestep->accumulator = 0.0;
+  timestep->steps++;
+  return 1;
+}
+
+float timestepAlpha(const FixedTimestep *timestep) {
+  return (float)(timestep->accumulator / timestep->step);
+}
+
+void framePacerInit(FramePacer *pacer, double rate, double now) {
+  pacer->interval = 1.0 / rate;
+  pacer->deadline = now + pacer->interval;
+}
+
+void framePacerWait(FramePacer *pacer) {
+  double now = timeNow();
+  double left = pacer->deadline - now - PACER_SPIN;
+  if (left > 0.0) {
+    struct timespec ts = {(time_t)left, (long)((left - (double)(time_t)left) * 1e9)};
+    nanosleep(&ts, NULL);
+  }
+  while ((now = timeNow()) < pacer->deadline) {
+    sched_yield();
+  }
+  pacer->deadline += pacer->interval;
+  if (pacer->deadline < now) {
+    pacer->deadline = now + pacer->interval;
+  }
+}
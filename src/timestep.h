@@ -0,0 +1,47 @@
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+// Simulation at a fixed rate, whatever the frame rate: each frame adds the
+// time since the last one to an accumulator and runs as many whole steps
+// as it holds. What is left over, as a fraction of a step, is how far to
+// interpolate between the last two steps when drawing.
+typedef struct {
+  double step; // seconds
+  double accumulator;
+  double last;
+  // steps run at most per frame; after a stall the simulation falls behind
+  // rather than taking ever longer frames to catch up
+  unsigned int maxSteps;
+  unsigned long long steps; // run in all
+} FixedTimestep;
+
+// `rate` steps a second, starting at `now` (see timeNow).
+void timestepInit(FixedTimestep *timestep, double rate, double now);
+
+// Returns the number of steps to run this frame.
+unsigned int timestepAdvance(FixedTimestep *timestep, double now);
+
+// Runs exactly one step, whatever the clock says, for frames that have to
+// come out the same however long they took to make. Returns 1.
+unsigned int timestepTick(FixedTimestep *timestep);
+
+// From 0 to 1, how far the frame is past the last step.
+float timestepAlpha(const FixedTimestep *timestep);
+
+// Holds frames to a target rate by sleeping, for when vsync does not.
+typedef struct {
+  double interval; // seconds
+  double deadline; // when the next frame is due
+} FramePacer;
+
+void framePacerInit(FramePacer *pacer, double rate, double now);
+
+// Sleeps until the next frame is due, spinning on sched_yield for the last
+// millisecond or so, since sleeps overshoot. A frame that starts late moves
+// the schedule instead of shortening the frames after it.
+void framePacerWait(FramePacer *pacer);
+
+// Seconds on a monotonic clock.
+double timeNow(void);
+
+#endif
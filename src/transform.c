@@ -0,0 +1,318 @@
+#include "transform.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRANSFORM_SSE 1
+#endif
+
+#define TRANSFORM_ALIGN 32
+#define TRANSFORM_BATCH 4
+
+static void *allocZeroed(size_t size) {
+  // aligned_alloc wants the size to be a multiple of the alignment
+  size = (size + TRANSFORM_ALIGN - 1) & ~(size_t)(TRANSFORM_ALIGN - 1);
+  void *p = aligned_alloc(TRANSFORM_ALIGN, size);
+  if (p) {
+    memset(p, 0, size);
+  }
+  return p;
+}
+
+// the current lanes, in the order of `previous`
+static void currentLanes(TransformStore *store, float **lanes[TRANSFORM_LANES]) {
+  float **all[TRANSFORM_LANES] = {
+    &store->px, &store->py, &store->pz,
+    &store->qx, &store->qy, &store->qz, &store->qw,
+    &store->sx, &store->sy, &store->sz,
+  };
+  memcpy(lanes, all, sizeof(all));
+}
+
+int transformStoreInit(TransformStore *store, size_t capacity) {
+  // whole batches only, so the last one can be built without bounds checks
+  capacity = (capacity + TRANSFORM_BATCH - 1) & ~(size_t)(TRANSFORM_BATCH - 1);
+  if (capacity == 0) {
+    capacity = TRANSFORM_BATCH;
+  }
+  memset(store, 0, sizeof(*store));
+  float **lanes[TRANSFORM_LANES];
+  currentLanes(store, lanes);
+  int ok = 1;
+  for (size_t i = 0; i < TRANSFORM_LANES; ++i) {
+    *lanes[i] = allocZeroed(capacity * sizeof(float));
+    store->previous[i] = allocZeroed(capacity * sizeof(float));
+    ok = ok && *lanes[i] != NULL && store->previous[i] != NULL;
+  }
+  store->dirty = calloc((capacity + 31) / 32, sizeof(uint32_t));
+  store->moving = calloc((capacity + 31) / 32, sizeof(uint32_t));
+  store->alpha = 1.0f;
+  store->world = allocZeroed(capacity * sizeof(mat4));
+  store->count = 0;
+  store->capacity = capacity;
+  if (!ok || !store->dirty || !store->moving || !store->world) {
+    transformStoreFree(store);
+    return 0;
+  }
+  // unused slots hold the identity transform
+  for (size_t i = 0; i < capacity; ++i) {
+    store->qw[i] = 1.0f;
+    store->sx[i] = store->sy[i] = store->sz[i] = 1.0f;
+  }
+  return 1;
+}
+
+void transformStoreFree(TransformStore *store) {
+  free(store->px); free(store->py); free(store->pz);
+  free(store->qx); free(store->qy); free(store->qz); free(store->qw);
+  free(store->sx); free(store->sy); free(store->sz);
+  for (size_t i = 0; i < TRANSFORM_LANES; ++i) {
+    free(store->previous[i]);
+  }
+  free(store->dirty);
+  free(store->moving);
+  free(store->world);
+  memset(store, 0, sizeof(*store));
+}
+
+static void markDirty(TransformStore *store, size_t index) {
+  store->dirty[index / 32] |= 1u << (index % 32);
+  store->moving[index / 32] |= 1u << (index % 32);
+}
+
+size_t transformAdd(TransformStore *store, vec3 position, float angle, vec3 axis, vec3 scale) {
+  if (store->count == store->capacity) {
+    return (size_t)-1;
+  }
+  size_t index = store->count++;
+  transformSetPosition(store, index, position);
+  transformSetRotation(store, index, angle, axis);
+  transformSetScale(store, index, scale);
+  // appears where it is, rather than moving there from the origin
+  float **lanes[TRANSFORM_LANES];
+  currentLanes(store, lanes);
+  for (size_t l = 0; l < TRANSFORM_LANES; ++l) {
+    store->previous[l][index] = (*lanes[l])[index];
+  }
+  store->moving[index / 32] &= ~(1u << (index % 32));
+  return index;
+}
+
+void transformSetPosition(TransformStore *store, size_t index, vec3 position) {
+  store->px[index] = position[0];
+  store->py[index] = position[1];
+  store->pz[index] = position[2];
+  markDirty(store, index);
+}
+
+void transformSetRotation(TransformStore *store, size_t index, float angle, vec3 axis) {
+  // same convention as glm_rotate: the axis does not have to be normalized
+  float len = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  float s = sinf(angle * 0.5f) / len;
+  store->qx[index] = axis[0] * s;
+  store->qy[index] = axis[1] * s;
+  store->qz[index] = axis[2] * s;
+  store->qw[index] = cosf(angle * 0.5f);
+  markDirty(store, index);
+}
+
+void transformSetScale(TransformStore *store, size_t index, vec3 scale) {
+  store->sx[index] = scale[0];
+  store->sy[index] = scale[1];
+  store->sz[index] = scale[2];
+  markDirty(store, index);
+}
+
+void transformBeginStep(TransformStore *store) {
+  float **lanes[TRANSFORM_LANES];
+  currentLanes(store, lanes);
+  for (size_t w = 0; w < (store->count + 31) / 32; ++w) {
+    if (store->moving[w] == 0) {
+      continue;
+    }
+    // whole words at a time; transforms that did not move just copy their
+    // unchanged state. Those that moved are built once more, at rest.
+    size_t begin = w * 32;
+    size_t n = store->capacity - begin < 32 ? store->capacity - begin : 32;
+    for (size_t l = 0; l < TRANSFORM_LANES; ++l) {
+      memcpy(store->previous[l] + begin, *lanes[l] + begin, n * sizeof(float));
+    }
+    store->dirty[w] |= store->moving[w];
+    store->moving[w] = 0;
+  }
+}
+
+void transformSetAlpha(TransformStore *store, float alpha) {
+  store->alpha = alpha < 0.0f ? 0.0f : alpha > 1.0f ? 1.0f : alpha;
+}
+
+// Writes the batch of four transforms starting at i, `alpha` of the way
+// from the previous state to the current one, into `out`, lane by lane.
+// Quaternions take the shorter way round and are normalized again.
+static void interpolateBatch(TransformStore *s, size_t i, float alpha, float out[TRANSFORM_LANES][4]) {
+  float **lanes[TRANSFORM_LANES];
+  currentLanes(s, lanes);
+#ifdef TRANSFORM_SSE
+  __m128 a = _mm_set1_ps(alpha);
+  __m128 from[TRANSFORM_LANES], to[TRANSFORM_LANES];
+  for (int l = 0; l < TRANSFORM_LANES; ++l) {
+    from[l] = _mm_load_ps(s->previous[l] + i);
+    to[l] = _mm_load_ps(*lanes[l] + i);
+  }
+  __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(from[3], to[3]), _mm_mul_ps(from[4], to[4])),
+                          _mm_add_ps(_mm_mul_ps(from[5], to[5]), _mm_mul_ps(from[6], to[6])));
+  __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+  for (int l = 3; l < 7; ++l) {
+    from[l] = _mm_xor_ps(from[l], flip);
+  }
+  __m128 mixed[TRANSFORM_LANES];
+  for (int l = 0; l < TRANSFORM_LANES; ++l) {
+    mixed[l] = _mm_add_ps(from[l], _mm_mul_ps(_mm_sub_ps(to[l], from[l]), a));
+  }
+  __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(mixed[3], mixed[3]), _mm_mul_ps(mixed[4], mixed[4])),
+                                         _mm_add_ps(_mm_mul_ps(mixed[5], mixed[5]), _mm_mul_ps(mixed[6], mixed[6]))));
+  for (int l = 3; l < 7; ++l) {
+    mixed[l] = _mm_div_ps(mixed[l], length);
+  }
+  for (int l = 0; l < TRANSFORM_LANES; ++l) {
+    _mm_store_ps(out[l], mixed[l]);
+  }
+#else
+  for (int j = 0; j < TRANSFORM_BATCH; ++j) {
+    float from[TRANSFORM_LANES], to[TRANSFORM_LANES];
+    for (int l = 0; l < TRANSFORM_LANES; ++l) {
+      from[l] = s->previous[l][i + j];
+      to[l] = (*lanes[l])[i + j];
+    }
+    float dot = from[3] * to[3] + from[4] * to[4] + from[5] * to[5] + from[6] * to[6];
+    for (int l = 3; dot < 0.0f && l < 7; ++l) {
+      from[l] = -from[l];
+    }
+    for (int l = 0; l < TRANSFORM_LANES; ++l) {
+      out[l][j] = from[l] + (to[l] - from[l]) * alpha;
+    }
+    float length = sqrtf(out[3][j] * out[3][j] + out[4][j] * out[4][j] + out[5][j] * out[5][j] + out[6][j] * out[6][j]);
+    for (int l = 3; l < 7; ++l) {
+      out[l][j] /= length;
+    }
+  }
+#endif
+}
+
+// Build world = T * R * S for a batch of four transforms, from the lanes
+// px to sz of each, four floats apiece, into world[0] to world[3].
+static void buildBatch(const float *const *lanes, mat4 *world) {
+  const float *px = lanes[0], *py = lanes[1], *pz = lanes[2];
+  const float *qx = lanes[3], *qy = lanes[4], *qz = lanes[5], *qw = lanes[6];
+  const float *sxs = lanes[7], *sys = lanes[8], *szs = lanes[9];
+#ifdef TRANSFORM_SSE
+  __m128 x = _mm_load_ps(qx), y = _mm_load_ps(qy);
+  __m128 z = _mm_load_ps(qz), w = _mm_load_ps(qw);
+  __m128 sx = _mm_load_ps(sxs), sy = _mm_load_ps(sys), sz = _mm_load_ps(szs);
+  __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+
+  __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+  __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+  __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+  // one register per matrix element, one lane per object
+  __m128 c0[4], c1[4], c2[4], c3[4];
+  c0[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+  c0[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+  c0[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+  c0[3] = zero;
+  c1[0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+  c1[1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+  c1[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+  c1[3] = zero;
+  c2[0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+  c2[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+  c2[2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+  c2[3] = zero;
+  c3[0] = _mm_load_ps(px);
+  c3[1] = _mm_load_ps(py);
+  c3[2] = _mm_load_ps(pz);
+  c3[3] = one;
+
+  // transposing each column group turns lanes back into per-object columns
+  _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+  _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+  _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+  _MM_TRANSPOSE4_PS(c3[0], c3[1], c3[2], c3[3]);
+  for (int l = 0; l < 4; ++l) {
+    _mm_store_ps(world[l][0], c0[l]);
+    _mm_store_ps(world[l][1], c1[l]);
+    _mm_store_ps(world[l][2], c2[l]);
+    _mm_store_ps(world[l][3], c3[l]);
+  }
+#else
+  for (int j = 0; j < TRANSFORM_BATCH; ++j) {
+    float x = qx[j], y = qy[j], z = qz[j], w = qw[j];
+    float *m = (float *)world[j];
+    m[0] = (1.0f - 2.0f * (y * y + z * z)) * sxs[j];
+    m[1] = 2.0f * (x * y + w * z) * sxs[j];
+    m[2] = 2.0f * (x * z - w * y) * sxs[j];
+    m[3] = 0.0f;
+    m[4] = 2.0f * (x * y - w * z) * sys[j];
+    m[5] = (1.0f - 2.0f * (x * x + z * z)) * sys[j];
+    m[6] = 2.0f * (y * z + w * x) * sys[j];
+    m[7] = 0.0f;
+    m[8] = 2.0f * (x * z + w * y) * szs[j];
+    m[9] = 2.0f * (y * z - w * x) * szs[j];
+    m[10] = (1.0f - 2.0f * (x * x + y * y)) * szs[j];
+    m[11] = 0.0f;
+    m[12] = px[j];
+    m[13] = py[j];
+    m[14] = pz[j];
+    m[15] = 1.0f;
+  }
+#endif
+}
+
+size_t transformUpdate(TransformStore *store) {
+  return transformUpdateRange(store, 0, store->count);
+}
+
+size_t transformUpdateRange(TransformStore *store, size_t begin, size_t end) {
+  size_t rebuilt = 0;
+  if (end > store->count) {
+    end = store->count;
+  }
+  float **lanes[TRANSFORM_LANES];
+  currentLanes(store, lanes);
+  for (size_t w = begin / 32; w < (end + 31) / 32; ++w) {
+    // moving transforms are between steps, so they change every frame
+    uint32_t moving = store->moving[w];
+    uint32_t bits = store->dirty[w] | moving;
+    if (bits == 0) {
+      continue;
+    }
+    // each nibble of the word is one batch
+    for (int b = 0; b < 32; b += TRANSFORM_BATCH) {
+      uint32_t batch = (bits >> b) & 0xf;
+      if (batch == 0) {
+        continue;
+      }
+      size_t i = w * 32 + b;
+      const float *batchLanes[TRANSFORM_LANES];
+      _Alignas(16) float mixed[TRANSFORM_LANES][4];
+      if ((moving >> b) & 0xf) {
+        interpolateBatch(store, i, store->alpha, mixed);
+        for (int l = 0; l < TRANSFORM_LANES; ++l) {
+          batchLanes[l] = mixed[l];
+        }
+      } else {
+        for (int l = 0; l < TRANSFORM_LANES; ++l) {
+          batchLanes[l] = *lanes[l] + i;
+        }
+      }
+      buildBatch(batchLanes, store->world + i);
+      rebuilt += __builtin_popcount(batch);
+    }
+    store->dirty[w] = 0;
+  }
+  return rebuilt;
+}
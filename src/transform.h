@@ -0,0 +1,58 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cglm/cglm.h>
+
+// Translation, rotation (unit quaternion) and scale of every object, one array
+// per component, plus the world matrices built from them. A set bit in
+// `dirty` means the matching world matrix is stale; transformUpdate rebuilds
+// only those, four at a time, into the contiguous `world` array so it can be
+// uploaded as is.
+//
+// For a fixed timestep simulation, transformBeginStep keeps the state from
+// before each step; the world matrices of transforms changed in the last
+// step are then built that fraction `alpha` of the way from the kept state
+// to the current one, so that they move smoothly at any frame rate.
+#define TRANSFORM_LANES 10
+
+typedef struct {
+  float *px, *py, *pz;
+  float *qx, *qy, *qz, *qw;
+  float *sx, *sy, *sz;
+  float *previous[TRANSFORM_LANES]; // px to sz before the last step
+  uint32_t *dirty;
+  uint32_t *moving; // changed during the last step
+  float alpha;
+  mat4 *world;
+  size_t count;
+  size_t capacity;
+} TransformStore;
+
+int transformStoreInit(TransformStore *store, size_t capacity);
+void transformStoreFree(TransformStore *store);
+
+// Returns the index of the new transform, or (size_t)-1 if the store is full.
+size_t transformAdd(TransformStore *store, vec3 position, float angle, vec3 axis, vec3 scale);
+
+void transformSetPosition(TransformStore *store, size_t index, vec3 position);
+void transformSetRotation(TransformStore *store, size_t index, float angle, vec3 axis);
+void transformSetScale(TransformStore *store, size_t index, vec3 scale);
+
+// Call before each simulation step: keeps the current state as the one to
+// interpolate from, for the transforms the step is about to change.
+void transformBeginStep(TransformStore *store);
+
+// How far the frame is between the previous and the current step, from 0
+// to 1. Takes effect for the next transformUpdate.
+void transformSetAlpha(TransformStore *store, float alpha);
+
+// Rebuild the world matrices of dirty transforms and return how many were rebuilt.
+size_t transformUpdate(TransformStore *store);
+
+// Same, restricted to transforms [begin, end). `begin` must be a multiple of
+// 32 so that ranges handed to different threads never share a dirty word.
+size_t transformUpdateRange(TransformStore *store, size_t begin, size_t end);
+
+#endif
@@ -0,0 +1,599 @@
+#include "vtex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "bcn.h"
+
+// pages read from disk at once
+#define VT_MAX_LOADS 16
+// feedback readbacks that may be in flight
+#define VT_FEEDBACK_BUFFERS 2
+// pages seen in feedback this many frames back are never evicted
+#define VT_KEEP_FRAMES 2
+
+enum {
+  LOAD_FREE,
+  LOAD_RUNNING,
+  LOAD_DONE,
+  LOAD_FAILED,
+};
+
+typedef struct {
+  struct VirtualTextureSet *set;
+  int image;
+  uint32_t page;
+  unsigned char *data;       // as uploaded
+  unsigned char *compressed; // as read, when pages are decoded for drivers without S3TC
+  atomic_int state;
+} PageLoad;
+
+// Per page state of one image, all indexed like the pages of its file.
+typedef struct {
+  VirtualTextureFile file;
+  int *slot;              // cache slot, -1 when not resident
+  uint32_t *lastUsed;     // frame the page was last asked for
+  unsigned char *loading;
+  unsigned char *table;   // page table entries, 4 bytes each
+  int dirty;
+} VirtualImage;
+
+typedef struct {
+  int image; // -1 when free
+  uint32_t page;
+  int pinned;
+} CacheSlot;
+
+typedef struct {
+  int image;
+  uint32_t page;
+  int level;
+} PageRequest;
+
+typedef struct {
+  unsigned int buffer;
+  size_t capacity;
+  GLsync fence; // NULL when the buffer is free
+  int width;
+  int height;
+} FeedbackReadback;
+
+struct VirtualTextureSet {
+  JobSystem *jobs;
+  VirtualImage *images;
+  size_t count;
+  uint32_t frame;
+
+  GLenum tableUnit;
+  GLenum cacheUnit;
+  unsigned int pageTable;
+  unsigned int cache;
+  GLenum cacheFormat;
+  int decode; // pages are S3TC but the driver lacks it
+  BcFormat bcFormat;
+  size_t uploadBytes;
+  int cacheSide;
+  CacheSlot *slots;
+  int slotCount;
+
+  PageLoad loads[VT_MAX_LOADS];
+  JobCounter loading;
+  PageRequest *requests;
+  size_t requestCount;
+  size_t requestCapacity;
+
+  unsigned int framebuffer;
+  unsigned int renderbuffers[2];
+  int feedbackWidth;
+  int feedbackHeight;
+  int feedbackComplete;
+  FeedbackReadback readbacks[VT_FEEDBACK_BUFFERS];
+  unsigned int nextReadback;
+
+  size_t loaded;
+  size_t evictions;
+};
+
+// A free slot, or else the least recently used page that is neither pinned
+// nor in recent feedback. Scanning is cheap next to the upload that follows.
+static int findSlot(VirtualTextureSet *set) {
+  int victim = -1;
+  uint32_t oldest = set->frame;
+  for (int i = 0; i < set->slotCount; ++i) {
+    const CacheSlot *slot = &set->slots[i];
+    if (slot->image == -1) {
+      return i;
+    }
+    uint32_t used = set->images[slot->image].lastUsed[slot->page];
+    if (!slot->pinned && set->frame - used >= VT_KEEP_FRAMES && used < oldest) {
+      oldest = used;
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+// Uploads a page into the cache, which must be bound on the active unit.
+// Returns 0 if every slot is taken by a page still in use.
+static int placePage(VirtualTextureSet *set, int image, uint32_t page, int pinned, const unsigned char *data) {
+  int index = findSlot(set);
+  if (index == -1) {
+    return 0;
+  }
+  CacheSlot *slot = &set->slots[index];
+  if (slot->image != -1) {
+    set->images[slot->image].slot[slot->page] = -1;
+    set->images[slot->image].dirty = 1;
+    set->evictions++;
+  }
+  GLint x = index % set->cacheSide * VT_PAGE_STRIDE, y = index / set->cacheSide * VT_PAGE_STRIDE;
+  if (set->cacheFormat == GL_RGBA8) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VT_PAGE_STRIDE, VT_PAGE_STRIDE, GL_RGBA, GL_UNSIGNED_BYTE, data);
+  } else {
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VT_PAGE_STRIDE, VT_PAGE_STRIDE, set->cacheFormat,
+                              (GLsizei)set->uploadBytes, data);
+  }
+  *slot = (CacheSlot){image, page, pinned};
+  set->images[image].slot[page] = index;
+  set->images[image].dirty = 1;
+  set->loaded++;
+  return 1;
+}
+
+static int readPage(const VirtualTextureSet *set, const PageLoad *load) {
+  const VirtualTextureFile *file = &set->images[load->image].file;
+  if (!set->decode) {
+    return vtFileReadPage(file, load->page, load->data);
+  }
+  if (!vtFileReadPage(file, load->page, load->compressed)) {
+    return 0;
+  }
+  bcDecodeImage(set->bcFormat, load->compressed, VT_PAGE_STRIDE, VT_PAGE_STRIDE, load->data);
+  return 1;
+}
+
+static void loadPage(void *data, unsigned int thread) {
+  PageLoad *load = data;
+  int ok = readPage(load->set, load);
+  atomic_store_explicit(&load->state, ok ? LOAD_DONE : LOAD_FAILED, memory_order_release);
+}
+
+// Rebuilds the page table of an image from the coarsest level down: a page
+// that is not resident takes the entry of the page above it. The table must
+// be bound on the active unit.
+static void updateTable(VirtualTextureSet *set, int index) {
+  VirtualImage *image = &set->images[index];
+  const VirtualTextureFile *file = &image->file;
+  for (int level = file->levels - 1; level >= 0; --level) {
+    for (int y = 0; y < file->pagesY[level]; ++y) {
+      for (int x = 0; x < file->pagesX[level]; ++x) {
+        uint32_t page = vtPageIndex(file, level, x, y);
+        unsigned char *entry = image->table + 4 * page;
+        int slot = image->slot[page];
+        if (slot >= 0) {
+          entry[0] = (unsigned char)(slot % set->cacheSide);
+          entry[1] = (unsigned char)(slot / set->cacheSide);
+          entry[2] = (unsigned char)level;
+          entry[3] = 255;
+        } else {
+          // the coarsest level is pinned, so there is always a page above
+          memcpy(entry, image->table + 4 * vtPageIndex(file, level + 1, x / 2, y / 2), 4);
+        }
+      }
+    }
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, index, file->pagesX[level], file->pagesY[level], 1,
+                    GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, image->table + 4 * file->firstPage[level]);
+  }
+  image->dirty = 0;
+}
+
+static int bcFormatOf(GLenum internalFormat, BcFormat *format) {
+  switch (internalFormat) {
+  case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    *format = BC1;
+    return 1;
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    *format = BC3;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int openImages(VirtualTextureSet *set, const char *const *paths) {
+  for (size_t i = 0; i < set->count; ++i) {
+    VirtualImage *image = &set->images[i];
+    if (!vtFileOpen(&image->file, paths[i])) {
+      return 0;
+    }
+    const VirtualTextureFile *first = &set->images[0].file;
+    if (image->file.width != first->width || image->file.height != first->height || image->file.format != first->format) {
+      fprintf(stderr, "%s: size or format differs from %s\n", paths[i], paths[0]);
+      return 0;
+    }
+    // page coordinates are bytes in the page table and the feedback
+    if (image->file.pagesX[0] > 256 || image->file.pagesY[0] > 256) {
+      fprintf(stderr, "%s: too large\n", paths[i]);
+      return 0;
+    }
+    uint32_t pages = image->file.pageCount;
+    image->slot = malloc(pages * sizeof(int));
+    image->lastUsed = calloc(pages, sizeof(uint32_t));
+    image->loading = calloc(pages, 1);
+    image->table = calloc(pages, 4);
+    if (!image->slot || !image->lastUsed || !image->loading || !image->table) {
+      return 0;
+    }
+    for (uint32_t page = 0; page < pages; ++page) {
+      image->slot[page] = -1;
+    }
+    image->dirty = 1;
+  }
+  return 1;
+}
+
+static int createTextures(VirtualTextureSet *set) {
+  const VirtualTextureFile *file = &set->images[0].file;
+  int side = set->cacheSide * VT_PAGE_STRIDE;
+
+  glActiveTexture(set->cacheUnit);
+  glGenTextures(1, &set->cache);
+  glBindTexture(GL_TEXTURE_2D, set->cache);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  if (set->cacheFormat == GL_RGBA8) {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, side, side, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  } else {
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, set->cacheFormat, side, side, 0,
+                           (GLsizei)bcImageSize(set->bcFormat, side, side), NULL);
+  }
+
+  // integer textures can only be sampled with GL_NEAREST
+  glActiveTexture(set->tableUnit);
+  glGenTextures(1, &set->pageTable);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, set->pageTable);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, file->levels - 1);
+  for (int level = 0; level < file->levels; ++level) {
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8UI, file->pagesX[level], file->pagesY[level], (GLsizei)set->count,
+                 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+  }
+
+  glGenFramebuffers(1, &set->framebuffer);
+  glGenRenderbuffers(2, set->renderbuffers);
+  for (int i = 0; i < VT_FEEDBACK_BUFFERS; ++i) {
+    glGenBuffers(1, &set->readbacks[i].buffer);
+  }
+  return set->cache && set->pageTable && set->framebuffer;
+}
+
+// Loads the coarsest level of every image, which is never evicted, so every
+// page table entry has something to point at.
+static int pinCoarsestLevel(VirtualTextureSet *set) {
+  glActiveTexture(set->cacheUnit);
+  PageLoad *load = &set->loads[0];
+  for (size_t i = 0; i < set->count; ++i) {
+    const VirtualTextureFile *file = &set->images[i].file;
+    int level = file->levels - 1;
+    for (uint32_t page = file->firstPage[level]; page < file->pageCount; ++page) {
+      load->image = (int)i;
+      load->page = page;
+      if (!readPage(set, load) || !placePage(set, (int)i, page, 1, load->data)) {
+        fprintf(stderr, "Could not make the coarsest virtual texture pages resident\n");
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+VirtualTextureSet *vtCreate(JobSystem *jobs, const char *const *paths, size_t count, int cacheSide,
+                            GLenum tableUnit, GLenum cacheUnit) {
+  // image 255 marks feedback pixels that saw nothing
+  if (count == 0 || count > 254) {
+    fprintf(stderr, "Virtual texture sets hold 1 to 254 images\n");
+    return NULL;
+  }
+  VirtualTextureSet *set = calloc(1, sizeof(VirtualTextureSet));
+  if (set == NULL) {
+    return NULL;
+  }
+  set->jobs = jobs;
+  set->count = count;
+  set->frame = VT_KEEP_FRAMES;
+  set->tableUnit = tableUnit;
+  set->cacheUnit = cacheUnit;
+  set->images = calloc(count, sizeof(VirtualImage));
+  for (size_t i = 0; set->images && i < count; ++i) {
+    set->images[i].file.fd = -1;
+  }
+  if (set->images == NULL || !openImages(set, paths)) {
+    vtDestroy(set);
+    return NULL;
+  }
+
+  const VirtualTextureFile *file = &set->images[0].file;
+  set->cacheFormat = file->format;
+  set->uploadBytes = file->pageBytes;
+  if (bcFormatOf(file->format, &set->bcFormat)) {
+    if (!GLAD_GL_EXT_texture_compression_s3tc) {
+      set->decode = 1;
+      set->cacheFormat = GL_RGBA8;
+      set->uploadBytes = (size_t)VT_PAGE_STRIDE * VT_PAGE_STRIDE * 4;
+    }
+  } else if (file->format != GL_RGBA8) {
+    fprintf(stderr, "%s: unsupported page format 0x%x\n", paths[0], file->format);
+    vtDestroy(set);
+    return NULL;
+  }
+
+  // slot coordinates are bytes in the page table
+  GLint maxSize;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  set->cacheSide = cacheSide;
+  if (set->cacheSide > maxSize / VT_PAGE_STRIDE) {
+    set->cacheSide = maxSize / VT_PAGE_STRIDE;
+  }
+  if (set->cacheSide > 256) {
+    set->cacheSide = 256;
+  }
+  set->slotCount = set->cacheSide * set->cacheSide;
+  set->slots = malloc(set->slotCount * sizeof(CacheSlot));
+  for (int i = 0; set->slots && i < set->slotCount; ++i) {
+    set->slots[i].image = -1;
+  }
+  int ok = set->slots != NULL;
+  for (int i = 0; ok && i < VT_MAX_LOADS; ++i) {
+    set->loads[i].set = set;
+    set->loads[i].data = malloc(set->uploadBytes);
+    set->loads[i].compressed = set->decode ? malloc(file->pageBytes) : NULL;
+    ok = set->loads[i].data && (!set->decode || set->loads[i].compressed);
+  }
+
+  GLint active;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+  ok = ok && createTextures(set) && pinCoarsestLevel(set);
+  if (ok) {
+    glActiveTexture(set->tableUnit);
+    for (size_t i = 0; i < count; ++i) {
+      updateTable(set, (int)i);
+    }
+  }
+  glActiveTexture(active);
+  if (!ok) {
+    vtDestroy(set);
+    return NULL;
+  }
+  return set;
+}
+
+void vtDestroy(VirtualTextureSet *set) {
+  if (set == NULL) {
+    return;
+  }
+  jobWait(set->jobs, &set->loading);
+  for (int i = 0; i < VT_FEEDBACK_BUFFERS; ++i) {
+    if (set->readbacks[i].fence) {
+      glDeleteSync(set->readbacks[i].fence);
+    }
+    glDeleteBuffers(1, &set->readbacks[i].buffer);
+  }
+  glDeleteFramebuffers(1, &set->framebuffer);
+  glDeleteRenderbuffers(2, set->renderbuffers);
+  glDeleteTextures(1, &set->pageTable);
+  glDeleteTextures(1, &set->cache);
+  for (int i = 0; i < VT_MAX_LOADS; ++i) {
+    free(set->loads[i].data);
+    free(set->loads[i].compressed);
+  }
+  for (size_t i = 0; set->images && i < set->count; ++i) {
+    VirtualImage *image = &set->images[i];
+    vtFileClose(&image->file);
+    free(image->slot);
+    free(image->lastUsed);
+    free(image->loading);
+    free(image->table);
+  }
+  free(set->images);
+  free(set->slots);
+  free(set->requests);
+  free(set);
+}
+
+void vtShaderInfo(const VirtualTextureSet *set, GLint info[4]) {
+  const VirtualTextureFile *file = &set->images[0].file;
+  info[0] = file->pagesX[0];
+  info[1] = file->pagesY[0];
+  info[2] = file->levels;
+  info[3] = set->cacheSide;
+}
+
+int vtFeedbackBegin(VirtualTextureSet *set, int width, int height) {
+  if (set->readbacks[set->nextReadback].fence != NULL) {
+    return 0;
+  }
+  int w = width / VT_FEEDBACK_SCALE > 0 ? width / VT_FEEDBACK_SCALE : 1;
+  int h = height / VT_FEEDBACK_SCALE > 0 ? height / VT_FEEDBACK_SCALE : 1;
+  glBindFramebuffer(GL_FRAMEBUFFER, set->framebuffer);
+  if (w != set->feedbackWidth || h != set->feedbackHeight) {
+    set->feedbackWidth = w;
+    set->feedbackHeight = h;
+    glBindRenderbuffer(GL_RENDERBUFFER, set->renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8UI, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, set->renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, set->renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, set->renderbuffers[1]);
+    set->feedbackComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!set->feedbackComplete) {
+      fprintf(stderr, "The virtual texture feedback framebuffer is incomplete\n");
+    }
+  }
+  if (!set->feedbackComplete) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return 0;
+  }
+  glViewport(0, 0, w, h);
+  static const GLuint nothing[4] = {255, 255, 255, 255};
+  static const GLfloat farthest = 1.0f;
+  glClearBufferuiv(GL_COLOR, 0, nothing);
+  glClearBufferfv(GL_DEPTH, 0, &farthest);
+  return 1;
+}
+
+void vtFeedbackEnd(VirtualTextureSet *set, int width, int height) {
+  FeedbackReadback *readback = &set->readbacks[set->nextReadback];
+  size_t bytes = (size_t)set->feedbackWidth * set->feedbackHeight * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+  if (readback->capacity < bytes) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)bytes, NULL, GL_STREAM_READ);
+    readback->capacity = bytes;
+  }
+  // lands in the buffer once the GPU gets there; vtUpdate picks it up when
+  // the fence says so
+  glReadPixels(0, 0, set->feedbackWidth, set->feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+  readback->width = set->feedbackWidth;
+  readback->height = set->feedbackHeight;
+  readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, width, height);
+  set->nextReadback = (set->nextReadback + 1) % VT_FEEDBACK_BUFFERS;
+}
+
+// Marks a page and the pages above it, its fallbacks, as used this frame,
+// and queues those that are not resident.
+static void requestPage(VirtualTextureSet *set, const unsigned char *texel) {
+  int x = texel[0], y = texel[1], level = texel[2];
+  if (texel[3] >= set->count) {
+    return;
+  }
+  VirtualImage *image = &set->images[texel[3]];
+  const VirtualTextureFile *file = &image->file;
+  if (level >= file->levels || x >= file->pagesX[level] || y >= file->pagesY[level]) {
+    return;
+  }
+  for (; level < file->levels; ++level, x /= 2, y /= 2) {
+    uint32_t page = vtPageIndex(file, level, x, y);
+    if (image->lastUsed[page] == set->frame) {
+      // and so were the ones above it
+      return;
+    }
+    image->lastUsed[page] = set->frame;
+    if (image->slot[page] >= 0 || image->loading[page]) {
+      continue;
+    }
+    if (set->requestCount == set->requestCapacity) {
+      size_t capacity = set->requestCapacity ? set->requestCapacity * 2 : 64;
+      PageRequest *requests = realloc(set->requests, capacity * sizeof(PageRequest));
+      if (requests == NULL) {
+        return;
+      }
+      set->requests = requests;
+      set->requestCapacity = capacity;
+    }
+    set->requests[set->requestCount++] = (PageRequest){texel[3], page, level};
+  }
+}
+
+static void readFeedback(VirtualTextureSet *set) {
+  for (int i = 0; i < VT_FEEDBACK_BUFFERS; ++i) {
+    FeedbackReadback *readback = &set->readbacks[i];
+    if (readback->fence == NULL) {
+      continue;
+    }
+    GLenum status = glClientWaitSync(readback->fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      continue;
+    }
+    glDeleteSync(readback->fence);
+    readback->fence = NULL;
+    size_t bytes = (size_t)readback->width * readback->height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+    const unsigned char *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_READ_BIT);
+    if (pixels) {
+      for (size_t p = 0; p < bytes; p += 4) {
+        requestPage(set, pixels + p);
+      }
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+}
+
+// coarse pages first: they cover more of the screen, and the finer ones
+// look wrong without them
+static int compareRequests(const void *a, const void *b) {
+  return ((const PageRequest *)b)->level - ((const PageRequest *)a)->level;
+}
+
+void vtUpdate(VirtualTextureSet *set) {
+  set->frame++;
+  readFeedback(set);
+
+  GLint active;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+  glActiveTexture(set->cacheUnit);
+  for (int i = 0; i < VT_MAX_LOADS; ++i) {
+    PageLoad *load = &set->loads[i];
+    int state = atomic_load_explicit(&load->state, memory_order_acquire);
+    if (state == LOAD_DONE || state == LOAD_FAILED) {
+      // a page that finds no slot is dropped, and asked for again by the
+      // next feedback if it is still wanted
+      if (state == LOAD_DONE) {
+        placePage(set, load->image, load->page, 0, load->data);
+      }
+      set->images[load->image].loading[load->page] = 0;
+      atomic_store_explicit(&load->state, LOAD_FREE, memory_order_relaxed);
+    }
+  }
+
+  qsort(set->requests, set->requestCount, sizeof(PageRequest), compareRequests);
+  size_t next = 0;
+  for (int i = 0; i < VT_MAX_LOADS && next < set->requestCount; ++i) {
+    PageLoad *load = &set->loads[i];
+    if (atomic_load_explicit(&load->state, memory_order_relaxed) != LOAD_FREE) {
+      continue;
+    }
+    const PageRequest *request = &set->requests[next++];
+    load->image = request->image;
+    load->page = request->page;
+    atomic_store_explicit(&load->state, LOAD_RUNNING, memory_order_relaxed);
+    set->images[request->image].loading[request->page] = 1;
+    jobSubmit(set->jobs, loadPage, load, &set->loading);
+  }
+  // the rest are asked for again by later feedback
+  set->requestCount = 0;
+
+  glActiveTexture(set->tableUnit);
+  for (size_t i = 0; i < set->count; ++i) {
+    if (set->images[i].dirty) {
+      updateTable(set, (int)i);
+    }
+  }
+  glActiveTexture(active);
+}
+
+void vtStats(const VirtualTextureSet *set, VirtualTextureStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->slots = (size_t)set->slotCount;
+  for (int i = 0; i < set->slotCount; ++i) {
+    stats->resident += set->slots[i].image != -1;
+  }
+  int side = set->cacheSide * VT_PAGE_STRIDE;
+  stats->cacheBytes = set->cacheFormat == GL_RGBA8 ? (size_t)side * side * 4 : bcImageSize(set->bcFormat, side, side);
+  for (size_t i = 0; i < set->count; ++i) {
+    stats->cacheBytes += set->images[i].file.pageCount * 4;
+    stats->virtualBytes += set->images[i].file.pageCount * set->uploadBytes;
+  }
+  stats->loads = set->loaded;
+  stats->evictions = set->evictions;
+}
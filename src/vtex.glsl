@@ -0,0 +1,49 @@
+// Virtual texture sampling, see vtex.h. VT_PAGE_SIZE, VT_PAGE_BORDER and,
+// for the feedback pass, VT_FEEDBACK_SCALE are defined by the application.
+
+// One layer per image, one level per stored level. Each entry holds the
+// cache slot of the finest resident page covering that page, and its level.
+uniform usampler2DArray pageTable;
+uniform sampler2D pageCache;
+// pages across and down at level 0, levels, cache slots per side
+uniform ivec4 vtInfo;
+
+#ifdef VT_FEEDBACK
+// the feedback pass renders at lower resolution, so its derivatives are that
+// much larger than on screen
+#define VT_LEVEL_BIAS (-log2(float(VT_FEEDBACK_SCALE)))
+#else
+#define VT_LEVEL_BIAS 0.0
+#endif
+
+// Level of detail wanted at uv, from its screen space derivatives. Must be
+// called in uniform control flow.
+int vtLevel(vec2 uv)
+{
+    vec2 texels = uv * vec2(vtInfo.xy * VT_PAGE_SIZE);
+    vec2 dx = dFdx(texels), dy = dFdy(texels);
+    float level = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + VT_LEVEL_BIAS;
+    return int(clamp(level, 0.0, float(vtInfo.z - 1)));
+}
+
+// Bilinear sample of an image, from the finest page of `level` or above
+// that is resident. Past the last stored level it stays at that level.
+vec4 vtSample(vec2 uv, int image, int level)
+{
+    uv = fract(uv);
+    ivec2 pages = vtInfo.xy >> level;
+    ivec2 page = min(ivec2(uv * vec2(pages)), pages - 1);
+    uvec4 entry = texelFetch(pageTable, ivec3(page, image), level);
+    vec2 inPage = fract(uv * vec2(vtInfo.xy >> int(entry.z)));
+    float stride = float(VT_PAGE_SIZE + 2 * VT_PAGE_BORDER);
+    vec2 texel = vec2(entry.xy) * stride + float(VT_PAGE_BORDER) + inPage * float(VT_PAGE_SIZE);
+    return textureLod(pageCache, texel / (stride * float(vtInfo.w)), 0.0);
+}
+
+// The page a pixel wants, for the feedback buffer: x, y, level, image.
+uvec4 vtFeedback(vec2 uv, int image, int level)
+{
+    ivec2 pages = vtInfo.xy >> level;
+    ivec2 page = min(ivec2(fract(uv) * vec2(pages)), pages - 1);
+    return uvec4(page, level, image);
+}
@@ -0,0 +1,61 @@
+#ifndef VTEX_H
+#define VTEX_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+#include "jobs.h"
+#include "vtfile.h"
+
+// Virtual texturing: images baked into pages by tools/vtbake stay on disk,
+// and only the pages the camera currently needs are kept on the GPU, in a
+// fixed size page cache. A page table per image says where each page is,
+// falling back to the finest resident page above it, so whatever has not
+// streamed in yet draws blurrier rather than missing. See vtex.glsl.
+//
+// Each frame the scene is also drawn at a fraction of the resolution with
+// the VT_FEEDBACK shader permutation, which writes the page every pixel
+// wants. That image is read back asynchronously, and the pages it names are
+// read on worker threads and uploaded, evicting the least recently used.
+
+// The feedback pass renders at 1/VT_FEEDBACK_SCALE of the framebuffer
+#define VT_FEEDBACK_SCALE 8
+
+typedef struct VirtualTextureSet VirtualTextureSet;
+
+typedef struct {
+  size_t slots;        // pages the cache holds
+  size_t resident;     // pages in it
+  size_t cacheBytes;   // video memory of the cache and page tables
+  size_t virtualBytes; // all pages of all images, as uploaded
+  size_t loads;        // pages uploaded since the start
+  size_t evictions;
+} VirtualTextureStats;
+
+// Opens the virtual textures at `paths`, which must share size and format,
+// as the layers of one set, in order. The cache holds cacheSide x cacheSide
+// pages; the page tables are bound to `tableUnit` and the cache to
+// `cacheUnit`, and stay there. The coarsest level of every image is loaded
+// before returning and never evicted. Returns NULL after printing why.
+VirtualTextureSet *vtCreate(JobSystem *jobs, const char *const *paths, size_t count, int cacheSide,
+                            GLenum tableUnit, GLenum cacheUnit);
+void vtDestroy(VirtualTextureSet *set);
+
+// The vtInfo uniform of vtex.glsl.
+void vtShaderInfo(const VirtualTextureSet *set, GLint info[4]);
+
+// Bracket the feedback pass. Begin binds and clears the feedback
+// framebuffer, sized for a width x height framebuffer, and returns 0 if the
+// pass should be skipped because earlier readbacks are still in flight. End
+// starts the readback and rebinds the default framebuffer.
+int vtFeedbackBegin(VirtualTextureSet *set, int width, int height);
+void vtFeedbackEnd(VirtualTextureSet *set, int width, int height);
+
+// Once per frame: reads back finished feedback without waiting for any,
+// starts loading the pages it asks for, uploads the pages that finished
+// loading and updates the page tables.
+void vtUpdate(VirtualTextureSet *set);
+
+void vtStats(const VirtualTextureSet *set, VirtualTextureStats *stats);
+
+#endif
@@ -0,0 +1,122 @@
+#include "vtfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "atomicfile.h"
+#include "assetpack.h"
+
+static int isPowerOfTwo(int n) {
+  return n > 0 && (n & (n - 1)) == 0;
+}
+
+int vtLevelCount(int width, int height) {
+  if (!isPowerOfTwo(width) || !isPowerOfTwo(height) || width < VT_PAGE_SIZE || height < VT_PAGE_SIZE) {
+    return 0;
+  }
+  int levels = 1;
+  while ((width >> levels) >= VT_PAGE_SIZE && (height >> levels) >= VT_PAGE_SIZE && levels < VT_MAX_LEVELS) {
+    ++levels;
+  }
+  return levels;
+}
+
+// Fills in the page layout of every level from the size.
+static void layoutPages(VirtualTextureFile *file) {
+  file->pageCount = 0;
+  for (int level = 0; level < file->levels; ++level) {
+    file->pagesX[level] = (file->width >> level) / VT_PAGE_SIZE;
+    file->pagesY[level] = (file->height >> level) / VT_PAGE_SIZE;
+    file->firstPage[level] = file->pageCount;
+    file->pageCount += (uint32_t)(file->pagesX[level] * file->pagesY[level]);
+  }
+}
+
+int vtFileOpen(VirtualTextureFile *file, const char *path) {
+  memset(file, 0, sizeof(*file));
+  file->fd = -1;
+  VirtualTextureHeader header;
+  off_t length = 0;
+  const AssetEntry *entry = assetMounted() ? assetPackFind(assetMounted(), path) : NULL;
+  int ok;
+  if (entry && entry->compression == ASSET_STORED) {
+    file->mapped = assetPackBase(assetMounted()) + entry->offset;
+    length = (off_t)entry->storedSize;
+    ok = length >= (off_t)sizeof(header);
+    if (ok) {
+      memcpy(&header, file->mapped, sizeof(header));
+    }
+  } else {
+    struct stat st;
+    file->fd = open(path, O_RDONLY);
+    if (file->fd == -1) {
+      return 0;
+    }
+    ok = pread(file->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && fstat(file->fd, &st) == 0;
+    length = ok ? st.st_size : 0;
+  }
+  ok = ok && memcmp(header.magic, VT_FILE_MAGIC, 4) == 0 && header.version == VT_FILE_VERSION &&
+       header.pageBytes > 0 && (int)header.levels == vtLevelCount((int)header.width, (int)header.height);
+  if (ok) {
+    file->format = header.format;
+    file->width = (int)header.width;
+    file->height = (int)header.height;
+    file->levels = (int)header.levels;
+    file->pageBytes = header.pageBytes;
+    layoutPages(file);
+    ok = VT_DATA_OFFSET + (off_t)file->pageCount * file->pageBytes <= length;
+  }
+  if (!ok) {
+    fprintf(stderr, "%s: not a virtual texture\n", path);
+    vtFileClose(file);
+    return 0;
+  }
+  return 1;
+}
+
+void vtFileClose(VirtualTextureFile *file) {
+  if (file->fd >= 0) {
+    close(file->fd);
+  }
+  memset(file, 0, sizeof(*file));
+  file->fd = -1;
+}
+
+uint32_t vtPageIndex(const VirtualTextureFile *file, int level, int x, int y) {
+  return file->firstPage[level] + (uint32_t)(y * file->pagesX[level] + x);
+}
+
+int vtFileReadPage(const VirtualTextureFile *file, uint32_t index, void *dst) {
+  off_t offset = VT_DATA_OFFSET + (off_t)index * file->pageBytes;
+  if (index >= file->pageCount) {
+    return 0;
+  }
+  if (file->mapped) {
+    memcpy(dst, file->mapped + offset, file->pageBytes);
+    return 1;
+  }
+  return pread(file->fd, dst, file->pageBytes, offset) == (ssize_t)file->pageBytes;
+}
+
+int vtFileWrite(const char *path, uint32_t format, int width, int height, size_t pageBytes,
+                unsigned char *const *pages, uint32_t pageCount) {
+  VirtualTextureHeader header = {{'L', 'V', 'T', 'X'}, VT_FILE_VERSION, format, (uint32_t)width,
+                                 (uint32_t)height, (uint32_t)vtLevelCount(width, height), (uint32_t)pageBytes};
+
+  AtomicFile f;
+  atomicFileOpen(&f, path);
+  atomicFileWrite(&f, &header, sizeof(header));
+  atomicFilePadTo(&f, VT_DATA_OFFSET);
+  for (uint32_t i = 0; i < pageCount; ++i) {
+    atomicFileWrite(&f, pages[i], pageBytes);
+  }
+  if (!atomicFileClose(&f, 1)) {
+    fprintf(stderr, "%s: could not be written\n", path);
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,74 @@
+#ifndef VTFILE_H
+#define VTFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A virtual texture: an image and its mips cut into square pages, each
+// stored with a border of the neighbouring texels so that a page can be
+// filtered on its own wherever it lands in the page cache.
+//
+//   VirtualTextureHeader
+//   pages                  from VT_DATA_OFFSET, pageBytes each, level 0
+//                          first, each level in row order
+//
+// All fields are little endian. `format` is the GL internal format of the
+// pages: GL_RGBA8, or S3TC as made by tools/vtbake. Only levels with at
+// least one whole page on each side are stored, so the coarsest level is a
+// few pages that always stay resident.
+#define VT_FILE_MAGIC "LVTX"
+#define VT_FILE_VERSION 1
+#define VT_PAGE_SIZE 128
+#define VT_PAGE_BORDER 4
+#define VT_PAGE_STRIDE (VT_PAGE_SIZE + 2 * VT_PAGE_BORDER)
+#define VT_MAX_LEVELS 16
+// pages start on a file system block, so reading one touches as few as possible
+#define VT_DATA_OFFSET 4096
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levels;
+  uint32_t pageBytes;
+} VirtualTextureHeader;
+
+// An open virtual texture. Only the header is read up front; pages are read
+// as they are needed, from any thread.
+typedef struct {
+  int fd;
+  const unsigned char *mapped; // the file inside the mounted asset pack, or NULL
+  uint32_t format;
+  int width;
+  int height;
+  int levels;
+  size_t pageBytes;
+  int pagesX[VT_MAX_LEVELS];
+  int pagesY[VT_MAX_LEVELS];
+  uint32_t firstPage[VT_MAX_LEVELS]; // index of the level's first page
+  uint32_t pageCount;
+} VirtualTextureFile;
+
+// Levels stored for a width x height image, or 0 if either side is not a
+// power of two of at least VT_PAGE_SIZE.
+int vtLevelCount(int width, int height);
+
+// Uses the mounted asset pack if it holds the file uncompressed, else the
+// file system. Returns 0 if the file is missing or malformed.
+int vtFileOpen(VirtualTextureFile *file, const char *path);
+void vtFileClose(VirtualTextureFile *file);
+
+// Index of the page at (x, y) of `level`.
+uint32_t vtPageIndex(const VirtualTextureFile *file, int level, int x, int y);
+
+// Reads page `index` into `dst`, which holds pageBytes. Safe to call from
+// several threads at once.
+int vtFileReadPage(const VirtualTextureFile *file, uint32_t index, void *dst);
+
+// Writes `pageCount` pages of `pageBytes` each, in file order.
+int vtFileWrite(const char *path, uint32_t format, int width, int height, size_t pageBytes,
+                unsigned char *const *pages, uint32_t pageCount);
+
+#endif
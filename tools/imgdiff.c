@@ -0,0 +1,144 @@
+// Compares frames rendered by hello-world with reference images, within a
+// tolerance (see src/imagediff.h), and writes an image of where they
+// differ for every pair that does not match.
+//
+// usage: imgdiff [-t delta] [-p percent] [-d diffs] expected actual
+//   -t  how far a channel may be off before its pixel counts, 8 by default
+//   -p  percentage of pixels that may count before the images differ, 0.1
+//       by default
+//   -d  directory for the diff images, named after the frames; none if not
+//       given
+//
+// `expected` and `actual` are two PNG files, or two directories, in which
+// case every PNG in `expected` is compared with the one of the same name in
+// `actual`. Exits with 1 if any pair differs or is missing.
+//
+// References and frames come from the same headless run, e.g. on Mesa's
+// software rasterizer so that they do not depend on the GPU:
+//
+//   LIBGL_ALWAYS_SOFTWARE=1 build/hello-world -B 60 -C golden/%03lu.png
+//   ... change something ...
+//   LIBGL_ALWAYS_SOFTWARE=1 build/hello-world -B 60 -C frames/%03lu.png
+//   build/imgdiff -d diffs golden frames
+//
+// Optimizations should leave the frames alone; comparing runs with and
+// without them, like -l for one draw at a time instead of instancing,
+// shows that they do. `make test` does all of this for a few fixed scenes,
+// against the references in tests/reference.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <stb_image.h>
+
+#include "imagediff.h"
+#include "png.h"
+
+static int isDirectory(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static int endsWith(const char *string, const char *suffix) {
+  size_t length = strlen(string), suffixLength = strlen(suffix);
+  return length >= suffixLength && strcmp(string + length - suffixLength, suffix) == 0;
+}
+
+// Returns 1 if the two images match. `name` names the diff image.
+static int comparePair(const char *expectedPath, const char *actualPath, const char *name,
+                       const ImageTolerance *tolerance, const char *diffDir) {
+  int ew, eh, aw, ah, channels;
+  unsigned char *expected = stbi_load(expectedPath, &ew, &eh, &channels, 3);
+  if (expected == NULL) {
+    fprintf(stderr, "%s: %s\n", expectedPath, stbi_failure_reason());
+    return 0;
+  }
+  unsigned char *actual = stbi_load(actualPath, &aw, &ah, &channels, 3);
+  if (actual == NULL) {
+    fprintf(stderr, "%s: %s\n", actualPath, stbi_failure_reason());
+    stbi_image_free(expected);
+    return 0;
+  }
+  if (ew != aw || eh != ah) {
+    printf("%s: %dx%d, expected %dx%d\n", name, aw, ah, ew, eh);
+    stbi_image_free(expected);
+    stbi_image_free(actual);
+    return 0;
+  }
+
+  unsigned char *diff = diffDir ? malloc((size_t)ew * eh * 3) : NULL;
+  ImageDifference difference;
+  int match = imageCompare(expected, actual, ew, eh, 3, tolerance, &difference, diff);
+  printf("%s: %s, %zu of %zu pixels differ (%.3f%%), largest delta %d, mean %.3f\n", name, match ? "match" : "DIFFER",
+         difference.differing, difference.pixels, 100.0 * difference.differing / difference.pixels, difference.maxDelta,
+         difference.meanDelta);
+  if (!match && diff) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", diffDir, name);
+    pngWrite(path, diff, ew, eh, 3, (size_t)ew * 3);
+  }
+  free(diff);
+  stbi_image_free(expected);
+  stbi_image_free(actual);
+  return match;
+}
+
+int main(int argc, char **argv) {
+  ImageTolerance tolerance = {8, 0.001};
+  const char *diffDir = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:p:d:")) != -1) {
+    switch (opt) {
+    case 't':
+      tolerance.threshold = atoi(optarg);
+      break;
+    case 'p':
+      tolerance.maxDiffering = atof(optarg) / 100.0;
+      break;
+    case 'd':
+      diffDir = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t delta] [-p percent] [-d diffs] expected actual\n", argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, "usage: %s [-t delta] [-p percent] [-d diffs] expected actual\n", argv[0]);
+    return 1;
+  }
+  const char *expected = argv[optind], *actual = argv[optind + 1];
+  if (diffDir) {
+    mkdir(diffDir, 0755);
+  }
+
+  if (!isDirectory(expected)) {
+    const char *name = strrchr(actual, '/') ? strrchr(actual, '/') + 1 : actual;
+    return comparePair(expected, actual, name, &tolerance, diffDir) ? 0 : 1;
+  }
+
+  DIR *dir = opendir(expected);
+  if (dir == NULL) {
+    perror(expected);
+    return 1;
+  }
+  int compared = 0, failed = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (!endsWith(entry->d_name, ".png")) {
+      continue;
+    }
+    char expectedPath[4096], actualPath[4096];
+    snprintf(expectedPath, sizeof(expectedPath), "%s/%s", expected, entry->d_name);
+    snprintf(actualPath, sizeof(actualPath), "%s/%s", actual, entry->d_name);
+    compared++;
+    failed += !comparePair(expectedPath, actualPath, entry->d_name, &tolerance, diffDir);
+  }
+  closedir(dir);
+  printf("%d of %d images match\n", compared - failed, compared);
+  return failed || compared == 0 ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+// Packs files into an asset pack (see src/assetpack.h), each under the
+// path it was given by.
+//
+// usage: mkpack [-u] output files...
+//   -u  store everything uncompressed
+//
+// Virtual textures (.lvtx) are always stored, since their pages are read
+// one at a time straight from the mapping.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "assetpack.h"
+
+static int endsWith(const char *string, const char *suffix) {
+  size_t length = strlen(string), suffixLength = strlen(suffix);
+  return length >= suffixLength && strcmp(string + length - suffixLength, suffix) == 0;
+}
+
+static unsigned char *readFile(const char *path, size_t *size) {
+  struct stat st;
+  FILE *file = stat(path, &st) == 0 ? fopen(path, "rb") : NULL;
+  if (file == NULL) {
+    perror(path);
+    return NULL;
+  }
+  *size = (size_t)st.st_size;
+  unsigned char *data = malloc(*size ? *size : 1);
+  if (data && fread(data, 1, *size, file) != *size) {
+    perror(path);
+    free(data);
+    data = NULL;
+  }
+  fclose(file);
+  return data;
+}
+
+int main(int argc, char **argv) {
+  int store = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "u")) != -1) {
+    switch (opt) {
+    case 'u':
+      store = 1;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-u] output files...\n", argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind < 2) {
+    fprintf(stderr, "usage: %s [-u] output files...\n", argv[0]);
+    return 1;
+  }
+  const char *output = argv[optind];
+  const char *const *names = (const char *const *)argv + optind + 1;
+  size_t count = (size_t)(argc - optind - 1);
+
+  unsigned char **data = calloc(count, sizeof(unsigned char *));
+  size_t *sizes = calloc(count, sizeof(size_t));
+  int *compress = calloc(count, sizeof(int));
+  int ok = data && sizes && compress;
+  size_t total = 0;
+  for (size_t i = 0; ok && i < count; ++i) {
+    data[i] = readFile(names[i], &sizes[i]);
+    compress[i] = !store && !endsWith(names[i], ".lvtx");
+    total += sizes[i];
+    ok = data[i] != NULL;
+  }
+  ok = ok && assetPackWrite(output, names, (const unsigned char *const *)data, sizes, compress, count);
+
+  struct stat st;
+  if (ok && stat(output, &st) == 0) {
+    printf("%s: %zu assets, %zu -> %lld bytes\n", output, count, total, (long long)st.st_size);
+  }
+  for (size_t i = 0; data && i < count; ++i) {
+    free(data[i]);
+  }
+  free(data);
+  free(sizes);
+  free(compress);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Converts an image into a texture file (see src/texfile.h) holding its
+// whole mip chain compressed to BC1 or BC3, ready for glCompressedTexImage.
+//
+// usage: texconv [-f] [-s] [-1 | -3] [-j threads] input output
+//   -f  flip vertically on load, like stbi_set_flip_vertically_on_load(1)
+//   -s  the image is sRGB: filter the mips in linear light
+//   -1  BC1, no alpha
+//   -3  BC3, with alpha; the default when the image has any transparency
+//   -j  encoder threads besides the main one, 0 (the default) for one per core
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include "bcn.h"
+#include "jobs.h"
+#include "mipmap.h"
+#include "texfile.h"
+
+// rows of 4x4 blocks encoded by one job
+#define BAND_ROWS 8
+
+typedef struct {
+  BcFormat format;
+  const unsigned char *rgba;
+  int width;
+  int height;
+  int firstRow;
+  int lastRow;
+  unsigned char *blocks;
+} EncodeJob;
+
+static void encodeBand(void *data, unsigned int thread) {
+  EncodeJob *job = data;
+  bcEncodeRows(job->format, job->rgba, job->width, job->height, job->firstRow, job->lastRow, job->blocks);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  int flip = 0, srgb = 0, format = -1;
+  unsigned int workers = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "fs13j:")) != -1) {
+    switch (opt) {
+    case 'f':
+      flip = 1;
+      break;
+    case 's':
+      srgb = 1;
+      break;
+    case '1':
+      format = BC1;
+      break;
+    case '3':
+      format = BC3;
+      break;
+    case 'j':
+      workers = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-f] [-s] [-1 | -3] [-j threads] input output\n", argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, "usage: %s [-f] [-s] [-1 | -3] [-j threads] input output\n", argv[0]);
+    return 1;
+  }
+  const char *input = argv[optind], *output = argv[optind + 1];
+
+  int width, height, channels;
+  stbi_set_flip_vertically_on_load(flip);
+  unsigned char *pixels = stbi_load(input, &width, &height, &channels, 4);
+  if (pixels == NULL) {
+    fprintf(stderr, "%s: %s\n", input, stbi_failure_reason());
+    return 1;
+  }
+  if (format == -1) {
+    format = BC1;
+    for (size_t i = 0; i < (size_t)width * height && format == BC1; ++i) {
+      if (pixels[4 * i + 3] != 255) {
+        format = BC3;
+      }
+    }
+  }
+
+  double start = now();
+  int levels = mipLevelCount(width, height);
+  if (levels > TEXTURE_MAX_LEVELS) {
+    fprintf(stderr, "%s: too large\n", input);
+    return 1;
+  }
+  unsigned char *images[TEXTURE_MAX_LEVELS], *blocks[TEXTURE_MAX_LEVELS];
+  size_t sizes[TEXTURE_MAX_LEVELS];
+  size_t jobCount = 0;
+  images[0] = pixels;
+  if (!mipBuildChain(images, width, height, srgb)) {
+    fprintf(stderr, "%s: out of memory\n", input);
+    return 1;
+  }
+  for (int level = 0; level < levels; ++level) {
+    int w = mipLevelSize(width, level), h = mipLevelSize(height, level);
+    sizes[level] = bcImageSize(format, w, h);
+    blocks[level] = malloc(sizes[level]);
+    jobCount += ((h + 3) / 4 + BAND_ROWS - 1) / BAND_ROWS;
+  }
+
+  // every band of every level is independent
+  JobSystem *jobs = jobSystemCreate(workers);
+  EncodeJob *bands = malloc(jobCount * sizeof(EncodeJob));
+  JobCounter done = {0};
+  size_t next = 0;
+  for (int level = 0; level < levels; ++level) {
+    int w = mipLevelSize(width, level), h = mipLevelSize(height, level);
+    for (int row = 0; row < (h + 3) / 4; row += BAND_ROWS) {
+      int last = row + BAND_ROWS < (h + 3) / 4 ? row + BAND_ROWS : (h + 3) / 4;
+      bands[next] = (EncodeJob){format, images[level], w, h, row, last, blocks[level]};
+      jobSubmit(jobs, encodeBand, &bands[next++], &done);
+    }
+  }
+  jobWait(jobs, &done);
+  double elapsed = now() - start;
+  unsigned int threads = jobThreadCount(jobs);
+  jobSystemDestroy(jobs);
+
+  uint32_t glFormat = format == BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  int ok = textureFileWrite(output, glFormat, width, height, levels, blocks, sizes);
+  if (ok) {
+    size_t compressed = 0, uncompressed = 0;
+    for (int level = 0; level < levels; ++level) {
+      compressed += sizes[level];
+      uncompressed += (size_t)mipLevelSize(width, level) * mipLevelSize(height, level) * 4;
+    }
+    printf("%s: %dx%d, %d levels, BC%d, %zu -> %zu bytes in %.1f ms on %u threads\n", output, width, height,
+           levels, format == BC1 ? 1 : 3, uncompressed, compressed, elapsed * 1000.0, threads);
+  }
+
+  for (int level = 0; level < levels; ++level) {
+    if (level > 0) {
+      free(images[level]);
+    }
+    free(blocks[level]);
+  }
+  stbi_image_free(pixels);
+  free(bands);
+  return ok ? 0 : 1;
+}
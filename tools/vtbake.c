@@ -0,0 +1,193 @@
+// Cuts an image and its mips into the pages of a virtual texture (see
+// src/vtfile.h), compressed to BC1 or BC3 unless -u is given.
+//
+// usage: vtbake [-f] [-s] [-u | -1 | -3] [-j threads] input output
+//   -f  flip vertically on load, like stbi_set_flip_vertically_on_load(1)
+//   -s  the image is sRGB: filter the mips in linear light
+//   -u  uncompressed RGBA8 pages
+//   -1  BC1, no alpha
+//   -3  BC3, with alpha; the default when the image has any transparency
+//   -j  threads besides the main one, 0 (the default) for one per core
+//
+// Both sides of the image must be powers of two of at least VT_PAGE_SIZE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include "bcn.h"
+#include "jobs.h"
+#include "mipmap.h"
+#include "vtfile.h"
+
+// format value for uncompressed pages
+#define UNCOMPRESSED -2
+// mips of the largest image stb_image loads
+#define MAX_MIP_LEVELS 32
+
+typedef struct {
+  int format;
+  const unsigned char *level;
+  int width;
+  int height;
+  int x;
+  int y;
+  unsigned char *page;
+  unsigned char **scratch; // one page of RGBA8 per thread
+} PageJob;
+
+// Copies one page with its border out of a level; the border wraps around
+// the edges, as GL_REPEAT would.
+static void cutPage(const unsigned char *level, int width, int height, int x, int y, unsigned char *rgba) {
+  for (int row = 0; row < VT_PAGE_STRIDE; ++row) {
+    int sy = (y * VT_PAGE_SIZE + row - VT_PAGE_BORDER) & (height - 1);
+    for (int column = 0; column < VT_PAGE_STRIDE; ++column) {
+      int sx = (x * VT_PAGE_SIZE + column - VT_PAGE_BORDER) & (width - 1);
+      memcpy(rgba + 4 * (row * VT_PAGE_STRIDE + column), level + 4 * ((size_t)sy * width + sx), 4);
+    }
+  }
+}
+
+static void bakePage(void *data, unsigned int thread) {
+  PageJob *job = data;
+  if (job->format == UNCOMPRESSED) {
+    cutPage(job->level, job->width, job->height, job->x, job->y, job->page);
+    return;
+  }
+  unsigned char *rgba = job->scratch[thread];
+  cutPage(job->level, job->width, job->height, job->x, job->y, rgba);
+  bcEncodeRows(job->format, rgba, VT_PAGE_STRIDE, VT_PAGE_STRIDE, 0, VT_PAGE_STRIDE / 4, job->page);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  int flip = 0, srgb = 0, format = -1;
+  unsigned int workers = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "fsu13j:")) != -1) {
+    switch (opt) {
+    case 'f':
+      flip = 1;
+      break;
+    case 's':
+      srgb = 1;
+      break;
+    case 'u':
+      format = UNCOMPRESSED;
+      break;
+    case '1':
+      format = BC1;
+      break;
+    case '3':
+      format = BC3;
+      break;
+    case 'j':
+      workers = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-f] [-s] [-u | -1 | -3] [-j threads] input output\n", argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, "usage: %s [-f] [-s] [-u | -1 | -3] [-j threads] input output\n", argv[0]);
+    return 1;
+  }
+  const char *input = argv[optind], *output = argv[optind + 1];
+
+  int width, height, channels;
+  stbi_set_flip_vertically_on_load(flip);
+  unsigned char *pixels = stbi_load(input, &width, &height, &channels, 4);
+  if (pixels == NULL) {
+    fprintf(stderr, "%s: %s\n", input, stbi_failure_reason());
+    return 1;
+  }
+  int levels = vtLevelCount(width, height);
+  if (levels == 0) {
+    fprintf(stderr, "%s: %dx%d is not a power of two of at least %d\n", input, width, height, VT_PAGE_SIZE);
+    return 1;
+  }
+  if (format == -1) {
+    format = BC1;
+    for (size_t i = 0; i < (size_t)width * height && format == BC1; ++i) {
+      if (pixels[4 * i + 3] != 255) {
+        format = BC3;
+      }
+    }
+  }
+
+  double start = now();
+  unsigned char *images[MAX_MIP_LEVELS];
+  images[0] = pixels;
+  if (!mipBuildChain(images, width, height, srgb)) {
+    fprintf(stderr, "%s: out of memory\n", input);
+    return 1;
+  }
+
+  size_t pageBytes = format == UNCOMPRESSED ? (size_t)VT_PAGE_STRIDE * VT_PAGE_STRIDE * 4
+                                            : bcImageSize(format, VT_PAGE_STRIDE, VT_PAGE_STRIDE);
+  uint32_t pageCount = 0;
+  for (int level = 0; level < levels; ++level) {
+    pageCount += (uint32_t)(((width >> level) / VT_PAGE_SIZE) * ((height >> level) / VT_PAGE_SIZE));
+  }
+
+  // every page is independent
+  JobSystem *jobs = jobSystemCreate(workers);
+  unsigned int threads = jobThreadCount(jobs);
+  unsigned char **scratch = malloc(threads * sizeof(unsigned char *));
+  for (unsigned int i = 0; i < threads; ++i) {
+    scratch[i] = malloc((size_t)VT_PAGE_STRIDE * VT_PAGE_STRIDE * 4);
+  }
+  unsigned char **pages = malloc(pageCount * sizeof(unsigned char *));
+  PageJob *pageJobs = malloc(pageCount * sizeof(PageJob));
+  JobCounter done = {0};
+  uint32_t next = 0;
+  for (int level = 0; level < levels; ++level) {
+    int w = width >> level, h = height >> level;
+    for (int y = 0; y < h / VT_PAGE_SIZE; ++y) {
+      for (int x = 0; x < w / VT_PAGE_SIZE; ++x) {
+        pages[next] = malloc(pageBytes);
+        pageJobs[next] = (PageJob){format, images[level], w, h, x, y, pages[next], scratch};
+        jobSubmit(jobs, bakePage, &pageJobs[next++], &done);
+      }
+    }
+  }
+  jobWait(jobs, &done);
+  double elapsed = now() - start;
+  jobSystemDestroy(jobs);
+
+  uint32_t glFormat = format == UNCOMPRESSED ? GL_RGBA8
+                      : format == BC1        ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                             : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  int ok = vtFileWrite(output, glFormat, width, height, pageBytes, pages, pageCount);
+  if (ok) {
+    printf("%s: %dx%d, %d levels, %u pages of %zu bytes, %s, in %.1f ms on %u threads\n", output, width, height,
+           levels, pageCount, pageBytes, format == UNCOMPRESSED ? "RGBA8" : format == BC1 ? "BC1" : "BC3",
+           elapsed * 1000.0, threads);
+  }
+
+  for (uint32_t i = 0; i < pageCount; ++i) {
+    free(pages[i]);
+  }
+  for (unsigned int i = 0; i < threads; ++i) {
+    free(scratch[i]);
+  }
+  for (int level = 1; level < mipLevelCount(width, height); ++level) {
+    free(images[level]);
+  }
+  stbi_image_free(pixels);
+  free(pages);
+  free(pageJobs);
+  free(scratch);
+  return ok ? 0 : 1;
+}